@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fstream>
+#include <iterator>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
@@ -10,3 +11,9 @@ inline json read_configuration(std::string filepath) {
     std::ifstream fs(filepath);
     return json::parse(fs);
 }
+
+// Returns an empty string if the file can't be read
+inline std::string read_file(const std::string& filepath) {
+    std::ifstream fs(filepath, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mm::mutators {
+
+// First occurrence of needle in haystack, or nullptr. Blocks of the
+// haystack are tested against the needle's first and last byte at once
+// (AVX2 when the CPU has it, SSE2 otherwise) and only the candidate
+// positions are compared in full.
+const unsigned char* find_bytes(const unsigned char* haystack, std::size_t haystack_size,
+                                const unsigned char* needle, std::size_t needle_size);
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Checksums for derived fields (see derived_field). All of them are
+// one-shot over a contiguous range.
+namespace mm::mutators::checksum {
+
+// CRC-16/CCITT-FALSE: poly 0x1021, init 0xffff, not reflected
+uint16_t crc16(const unsigned char* data, std::size_t size);
+
+// CRC-32 (IEEE 802.3, zlib): slicing-by-8 tables
+uint32_t crc32(const unsigned char* data, std::size_t size);
+
+// CRC-32C (Castagnoli): the SSE4.2 crc32 instruction when the CPU has it,
+// slicing-by-8 tables otherwise
+uint32_t crc32c(const unsigned char* data, std::size_t size);
+
+// RFC 1071 Internet checksum over big endian 16-bit words
+uint16_t internet(const unsigned char* data, std::size_t size);
+
+}
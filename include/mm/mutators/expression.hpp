@@ -0,0 +1,107 @@
+#pragma once
+
+#include <mm/network/flow_table.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Mutation;
+
+namespace mm::mutators {
+
+class field_index;
+
+// Every register of a program holds the same kind of number, chosen when
+// it is compiled (see expression::floating)
+union expression_value {
+    int64_t i;
+    double d;
+};
+
+struct expression_insn {
+    enum op_code : uint8_t {
+        LOAD_IMM,      // dst = imm
+        LOAD_FIELD,    // dst = field at offset, converted from wire order
+        LOAD_COUNTER,  // dst = times this mutation already fired for the sender
+        LOAD_ELAPSED,  // dst = time since the rules were loaded, in units of imm.i ns
+        ADD, SUB, MUL, DIV, MOD,  // dst = a op b
+        NEG,                      // dst = -a
+    };
+    static constexpr uint8_t IMM_B = 1;  // b is imm rather than a register
+    static constexpr uint8_t TARGET = 2; // LOAD_FIELD: offset is from the mutated field's base
+    static constexpr uint8_t BITS = 4;   // LOAD_FIELD: (word & imm) >> a, a bitfield
+
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    uint8_t flags;
+    int32_t type;    // LOAD_FIELD: data_type
+    int32_t offset;  // LOAD_FIELD
+    expression_value imm;
+};
+
+// A mutation's value computed from the packet. Compiled once from text
+// like "value * 0.5" or "entity_id.site + counter"; the result is left in
+// register 0 and stored to the mutated field.
+struct expression {
+    static constexpr int REGISTERS = 16;
+
+    std::vector<expression_insn> code;
+    bool floating = false;       // double registers, otherwise int64 (wrapping)
+    bool uses_clock = false;
+    int32_t counter_slot = -1;   // index into the per-flow counters, if read
+
+    bool empty() const { return code.empty(); }
+};
+
+struct expression_context {
+    uint64_t counter = 0;
+    int64_t elapsed_ns = 0;
+};
+
+// Numbers are decimal, 0x hex or floating point literals. Names an
+// expression may use besides numbers, + - * / % and parentheses:
+//   value                 the field being mutated, before this mutation
+//   <field>               any fixed-offset field of the types file, by the same names rules use
+//   counter               packets from the sender this mutation already changed
+//   elapsed_s/_ms/_us     time since the rules were loaded
+// Arithmetic is in double when the target or any operand is floating
+// point, else in 64-bit integers. Doubles stored to integer fields are
+// truncated and saturate at the field's range.
+//
+// Fills m.program, or m.new_value_* when the text folds to a constant.
+// Logs and returns false on a syntax error or unknown field.
+bool compile_expression(const std::string& text, const field_index& fields, Mutation& m, int32_t& next_counter_slot);
+
+// Computes m.program against packet and writes the result to m's field.
+// target is where m.data_offset counts from: packet itself, or the array
+// element or section end the mutation is anchored to.
+void run_expression(const Mutation& m, unsigned char* packet, unsigned char* target, bool to_network_byte_order, const expression_context& ctx);
+
+// Per-sender counters read by expressions. Pipeline workers each own a
+// disjoint set of senders, so sharding by sender keeps them off each
+// other's locks.
+class flow_counters {
+public:
+    // Returns the slot's current value for sender and increments it
+    uint64_t next(const mm::network::Endpoint* sender, int32_t slot);
+
+private:
+    static constexpr std::size_t SHARDS = 16;
+    static constexpr std::size_t MAX_FLOWS_PER_SHARD = 4096;
+
+    struct key_hash {
+        std::size_t operator()(const mm::network::flow_key& k) const { return k.hash(); }
+    };
+    struct shard {
+        std::mutex mutex;
+        std::unordered_map<mm::network::flow_key, std::vector<uint64_t>, key_hash> flows;
+    };
+    shard shards[SHARDS];
+};
+
+}
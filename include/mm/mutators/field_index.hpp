@@ -0,0 +1,46 @@
+#pragma once
+
+#include "json_rule_based_mutator.hpp"
+
+#include <string>
+#include <vector>
+
+namespace mm::mutators {
+
+// Schema-wide field lookup, built once when the types are loaded.
+//
+// Every field is reachable by its qualified name "PduName.struct.field".
+// The short "struct.field" form is kept as an alias when it is unambiguous,
+// i.e. when every PDU that has it places it at the same offset with the same
+// type (the common PDU header, for instance). Both tables are sorted vectors
+// searched by binary search, so lookups don't depend on PDU order.
+class field_index {
+public:
+    struct entry {
+        std::string key;
+        const packet_description* packet;
+        const packet_description::field* field; // nullptr for an ambiguous alias
+    };
+
+    field_index() = default;
+    explicit field_index(const packet_types& types) { build(types); }
+
+    void build(const packet_types& types);
+
+    // Logs and returns nullptr if the name is unknown or ambiguous.
+    const packet_description::field* find(const std::string& name) const;
+
+    // Same as find() but also yields the PDU the field belongs to. For an
+    // alias shared by several PDUs this is the first of them.
+    const entry* find_entry(const std::string& name) const;
+
+    size_t size() const { return qualified.size(); }
+
+private:
+    static const entry* lookup(const std::vector<entry>& table, const std::string& key);
+
+    std::vector<entry> qualified;
+    std::vector<entry> aliases;
+};
+
+}
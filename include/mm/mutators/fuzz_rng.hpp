@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mm::mutators {
+
+// xoshiro256** for fuzz mutations. Each packet gets its own stream,
+// derived from the run's seed and the packet's index, so the random
+// choices made for a packet don't depend on which thread handled it or
+// what came before, and can be regenerated from the two numbers alone.
+class fuzz_rng {
+public:
+    fuzz_rng(uint64_t seed, uint64_t index);
+
+    uint64_t next() {
+        const uint64_t result = rotl(s[1] * 5, 7) * 9;
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, n), n > 0
+    uint64_t below(uint64_t n) {
+        return uint64_t((unsigned __int128)next() * n >> 64);
+    }
+
+    // Uniform in [0, 1)
+    double unit() {
+        return double(next() >> 11) * 0x1.0p-53;
+    }
+
+    // Random bytes. Runs of 64 bytes or more come from four generators
+    // seeded off this one and stepped side by side (with AVX2 when the CPU
+    // has it); either way the bytes only depend on the stream and size.
+    void fill(unsigned char* out, std::size_t size);
+
+private:
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t s[4];
+};
+
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+// Support code for the headers emitted by mmcodegen (src/codegen) from a
+// types file. Each generated field is a field_desc<T, Offset>, so loads and
+// stores compile down to a fixed-offset memcpy plus a byte swap.
+
+#include "json_rule_based_mutator.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mm::generated {
+
+template<typename T, int Offset>
+struct field_desc {
+    using type = T;
+    static constexpr int offset = Offset;
+    static constexpr int size = sizeof(T);
+};
+
+template<typename T>
+inline T byteswap(T value) {
+    static_assert(std::is_trivially_copyable<T>::value, "byteswap needs a POD");
+    if constexpr (sizeof(T) == 1) {
+        return value;
+    }
+    else {
+        using U = std::conditional_t<sizeof(T) == 2, uint16_t,
+                  std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+        U bits;
+        std::memcpy(&bits, &value, sizeof(T));
+        if constexpr (sizeof(T) == 2)      { bits = __builtin_bswap16(bits); }
+        else if constexpr (sizeof(T) == 4) { bits = __builtin_bswap32(bits); }
+        else                               { bits = __builtin_bswap64(bits); }
+        std::memcpy(&value, &bits, sizeof(T));
+        return value;
+    }
+}
+
+template<typename T>
+inline T from_big_endian(T value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return value;
+#else
+    return byteswap(value);
+#endif
+}
+
+template<typename F>
+inline typename F::type load_be(const unsigned char* packet) {
+    typename F::type value;
+    std::memcpy(&value, packet + F::offset, sizeof(value));
+    return from_big_endian(value);
+}
+
+template<typename F>
+inline void store_be(unsigned char* packet, typename F::type value) {
+    value = from_big_endian(value);
+    std::memcpy(packet + F::offset, &value, sizeof(value));
+}
+
+// Picks the Condition/Mutation value member matching the field's type
+template<typename T>
+inline T condition_value(const Condition& c) {
+    if constexpr (std::is_floating_point<T>::value) { return static_cast<T>(c.value_d); }
+    else if constexpr (std::is_signed<T>::value)    { return static_cast<T>(c.value_i); }
+    else                                            { return static_cast<T>(c.value_u); }
+}
+
+template<typename T>
+inline T mutation_value(const Mutation& m) {
+    if constexpr (std::is_floating_point<T>::value) { return static_cast<T>(m.new_value_d); }
+    else if constexpr (std::is_signed<T>::value)    { return static_cast<T>(m.new_value_i); }
+    else                                            { return static_cast<T>(m.new_value_u); }
+}
+
+// One instantiation per (field, operation); the operation is chosen when
+// the rule is bound, so the per-packet work is a load, a swap and a compare.
+template<typename F, int Operation>
+bool evaluate(const unsigned char* packet, const Condition& c) {
+    using T = typename F::type;
+    const T lhs = load_be<F>(packet);
+    const T rhs = condition_value<T>(c);
+    if constexpr (Operation == OP_EQUAL)                        { return lhs == rhs; }
+    else if constexpr (Operation == OP_NOT_EQUAL)               { return lhs != rhs; }
+    else if constexpr (Operation == OP_LESS_THAN)               { return lhs <  rhs; }
+    else if constexpr (Operation == OP_GREATER_THAN)            { return lhs >  rhs; }
+    else if constexpr (Operation == (OP_LESS_THAN | OP_EQUAL))  { return lhs <= rhs; }
+    else                                                        { return lhs >= rhs; }
+}
+
+template<typename F>
+void mutate(unsigned char* packet, const Mutation& m) {
+    store_be<F>(packet, mutation_value<typename F::type>(m));
+}
+
+using condition_fn = bool (*)(const unsigned char* packet, const Condition& c);
+using mutation_fn  = void (*)(unsigned char* packet, const Mutation& m);
+
+struct accessor {
+    const char* name; // "PduName.struct.field"
+    int offset;
+    data_type type;
+    condition_fn equal;
+    condition_fn not_equal;
+    condition_fn less;
+    condition_fn greater;
+    condition_fn less_equal;
+    condition_fn greater_equal;
+    mutation_fn  store;
+
+    condition_fn condition_for(int operation) const {
+        switch (operation) {
+            case OP_EQUAL:                    return equal;
+            case OP_NOT_EQUAL:                return not_equal;
+            case OP_LESS_THAN:                return less;
+            case OP_GREATER_THAN:             return greater;
+            case OP_LESS_THAN | OP_EQUAL:     return less_equal;
+            case OP_GREATER_THAN | OP_EQUAL:  return greater_equal;
+            default:                          return nullptr;
+        }
+    }
+};
+
+template<typename F>
+constexpr accessor make_accessor(const char* name, data_type type) {
+    return accessor{
+        name, F::offset, type,
+        &evaluate<F, OP_EQUAL>,
+        &evaluate<F, OP_NOT_EQUAL>,
+        &evaluate<F, OP_LESS_THAN>,
+        &evaluate<F, OP_GREATER_THAN>,
+        &evaluate<F, OP_LESS_THAN | OP_EQUAL>,
+        &evaluate<F, OP_GREATER_THAN | OP_EQUAL>,
+        &mutate<F>,
+    };
+}
+
+}
@@ -1,8 +1,14 @@
 #pragma once
 
 #include "packet_mutator.hpp"
+#include "expression.hpp"
+#include "payload_matcher.hpp"
+#include "sender_index.hpp"
+#include "rule_scheduler.hpp"
+#include "fuzz_rng.hpp"
 #include <nlohmann/json.hpp>
 
+#include <string>
 #include <vector>
 
 using json = nlohmann::json;
@@ -15,6 +21,9 @@ enum cond_operation {
     OP_NOT_EQUAL    = 0x00000002,
     OP_LESS_THAN    = 0x00000004,
     OP_GREATER_THAN = 0x00000008,
+    OP_PREFIX       = 0x00000010, // byte arrays only
+    OP_CONTAINS     = 0x00000020, // byte arrays only
+    OP_PAYLOAD      = 0x00000040, // any of Condition::patterns anywhere in the datagram
 };
 
 static int condition_operation_from_string(const std::string& str) {
@@ -24,6 +33,8 @@ static int condition_operation_from_string(const std::string& str) {
     if (str == "<=") return (OP_LESS_THAN | OP_EQUAL);
     if (str == ">")  return OP_GREATER_THAN;
     if (str == ">=") return (OP_GREATER_THAN | OP_EQUAL);
+    if (str == "prefix")   return OP_PREFIX;
+    if (str == "contains") return OP_CONTAINS;
     return OP_INVALID;
 }
 
@@ -82,6 +93,15 @@ inline int data_size_from_type(data_type type) {
 
 inline int data_size_from_type_string(const std::string& type);
 
+// Where a field sits when its offset depends on the packet (see
+// packet_description::sections). data_offset is then relative to the
+// element, or to the end of the section for a field that follows it.
+struct field_anchor {
+    int16_t packet = -1;   // index of the packet type; -1: fixed offset
+    int16_t section = -1;
+    int32_t element = -1;  // array element, or -1 for a field after the section
+};
+
 struct Condition {
     int data_offset;
     int data_size;
@@ -90,6 +110,49 @@ struct Condition {
     double value_d;
     uint64_t value_u;
     int64_t value_i;
+
+    // Specialized accessor from the generated headers, bound after loading
+    // when the field matches a known PDU layout. Never serialized.
+    bool (*evaluate)(const unsigned char* packet, const Condition& c) = nullptr;
+
+    field_anchor anchor{};
+
+    // Bitfield: the condition reads the unsigned word at data_offset and
+    // compares (word & mask) >> shift against value_u. Equality tests on
+    // one word in the same rule are merged into a single mask with shift 0.
+    uint64_t mask = 0;
+    uint8_t shift = 0;
+
+    // ARRAY_TYPE: the pattern. For == and != on a fixed-size field it is
+    // zero-padded to the field's size, so "ABC" matches a marking "ABC\0\0...".
+    // data_size is 0 for a blob, which is compared over its actual length.
+    std::string bytes{};
+
+    // OP_PAYLOAD, written {"payload": ["sig", {"hex": "..."}, ...]}. All
+    // rules' patterns are matched together in one pass over the datagram
+    // (see payload_matcher); value_u is this condition's slot there,
+    // assigned when the rules are bound.
+    std::vector<std::string> patterns{};
+};
+
+// A mutation that writes random data instead of a value:
+//   {"field": "entity_location.x", "fuzz": "random"}                 any value of the field's type
+//   {"field": "force", "fuzz": "random", "min": 0, "max": 3}         uniform in [min, max]
+//   {"field": "entity_marking", "fuzz": "bitflip", "bits": 2}        flip 2 random bits
+//   {"fuzz": "random"} / {"fuzz": "bitflip", "bits": 1}             the whole datagram
+//   {"fuzz": "truncate", "min": 12}                                  cut to a random length >= min
+// Lengths and checksums are still fixed up after a fuzzed field, but not
+// after whole-datagram fuzzing or truncation.
+struct fuzz_spec {
+    enum kind_t : uint8_t { NONE, RANDOM, BITFLIP, TRUNCATE };
+
+    kind_t kind = NONE;
+    bool ranged = false;
+    uint32_t count = 0;   // BITFLIP: bits to flip, TRUNCATE: shortest length
+    double min_d = 0;
+    double max_d = 0;
+    int64_t min_i = 0;
+    int64_t max_i = 0;
 };
 
 struct Mutation 
@@ -102,22 +165,141 @@ struct Mutation
     double new_value_d;
     uint64_t new_value_u;
     int64_t new_value_i;
+
+    // See Condition::evaluate
+    void (*apply)(unsigned char* packet, const Mutation& m) = nullptr;
+
+    // Set for an "expr" mutation that didn't fold to a constant; the
+    // new_value_* members are unused then
+    mm::mutators::expression program{};
+
+    field_anchor anchor{};
+
+    // Bitfield: read-modify-write of the bits in mask, see Condition::mask
+    uint64_t mask = 0;
+    uint8_t shift = 0;
+
+    // ARRAY_TYPE: bytes written from the start of the field, zero-padded
+    // to a fixed-size field's size. A blob keeps its length; a longer value
+    // is cut off at its end.
+    std::string bytes{};
+
+    // Random instead of new_value_*. A fuzz mutation without a field has
+    // type ARRAY_TYPE, offset 0 and size 0: the whole datagram.
+    fuzz_spec fuzz{};
 };
 
 using Mutations = std::vector<Mutation>;
 using Conditions = std::vector<Condition>;
 
+// What happens to a packet that passes a rule's conditions, besides the
+// mutations. Written as "action": one of
+//   "drop"
+//   {"kind": "duplicate", "copies": 3}
+//   {"kind": "redirect", "to": "10.0.0.9:3000"}
+//   {"kind": "delay", "ms": 50}
+// or a list of them. Across the rules a packet passes, a drop wins, the
+// most copies and the longest delay are kept, and the last redirect.
+struct rule_action {
+    bool drop = false;
+    uint16_t copies = 1;
+    uint32_t delay_us = 0;
+    bool redirect = false;
+    mm::network::Endpoint redirect_to;
+
+    bool any() const { return drop || copies != 1 || delay_us || redirect; }
+};
+
 struct Rule {
     Conditions conditions;
     Mutations mutations;
+    rule_action action;
+
+    // Senders the rule applies to, from "from": "10.1.0.0/16" or a list of
+    // them (see sender_scope); empty for every sender
+    std::vector<mm::mutators::sender_scope> from;
+
+    // "name" lets other rules' triggers refer to this one; "active" limits
+    // when the rule applies (see rule_activation)
+    std::string name;
+    mm::mutators::rule_activation active;
+
+    // "probability": chance that a packet passing the conditions is
+    // acted on, drawn from the packet's fuzz stream
+    double probability = 1;
+
+    // Derived fields (one bit each, see json_rule_based_mutator) whose
+    // input bytes this rule's mutations change, and those it writes
+    // directly. Worked out from the types when the rules are loaded;
+    // never serialized.
+    uint64_t touches_derived = 0;
+    uint64_t sets_derived = 0;
+    // Writes a count, length or opcode that dynamic sections are placed by
+    bool touches_layout = false;
 };
 
+// A field the mutator recomputes after a rule changed the bytes it is
+// computed from. Declared on the field in the types file:
+//   {"value": "crc", "type": "uint32", "derived": {"kind": "crc32", "from": "entity_id", "to": "crc"}}
+// "from" and "to" name fields (or structs) of the same packet, or give
+// byte offsets; the range starts at "from" and stops before "to". They
+// default to the start and "end" of the packet. Bytes of the field itself
+// count as zero when they fall inside the range.
+struct derived_field {
+    enum kind_t {
+        LENGTH,             // received size + adjust
+        CRC16,              // CRC-16/CCITT-FALSE
+        CRC32,              // IEEE
+        CRC32C,             // Castagnoli
+        INTERNET_CHECKSUM,  // RFC 1071
+    };
+
+    kind_t kind;
+    int offset;
+    data_type type;
+    int size;
+    int range_begin;
+    int range_end;   // -1: end of packet
+    int adjust;
+};
+
+// A run of bytes whose length is read from the packet. Declared in the
+// types file as
+//   {"array": "articulated_parts", "count": "num_articulated_parts", "data": [ fixed fields ]}
+//   {"blob": "payload", "length": "payload_length", "units": "bits"}
+// Rules address array elements as "articulated_parts[2].value" and a blob
+// as "payload". Fields declared after a section are placed after its end.
+
+struct dynamic_section {
+    enum kind_t { ARRAY, BLOB };
+
+    kind_t kind;
+    int anchor;           // section this one follows, -1: fixed part of the packet
+    int offset;           // start, relative to the anchor's end
+    int count_anchor;     // same for the count/length field
+    int count_offset;
+    data_type count_type;
+    int element_size;     // ARRAY: bytes per element, BLOB: 1
+    int length_divisor;   // BLOB: 8 when the length is in bits, else 1
+};
+
+// Sub-byte fields are declared as bits of an unsigned word:
+//   {"bitfield": "capabilities", "type": "uint32", "data": [
+//       {"value": "fuel_supply", "bits": 1}, {"value": "state", "bits": 2, "bit": 4}]}
+// Bits are counted from the least significant bit of the word as read in
+// network order, allocated upwards unless "bit" places one explicitly.
+// The word itself stays addressable as "capabilities".
 struct packet_description {
     struct field {
         std::string name;
         int offset;
         data_type type;
         std::string type_str;
+        int size; // bytes
+        int anchor = -1;       // dynamic section the offset is relative to
+        bool element = false;  // offset is within one element of that section
+        uint8_t bit_offset = 0; // bitfield: lowest bit within the word at offset
+        uint8_t bit_width = 0;  // bitfield: width in bits, 0 for a whole field
     };
 
     std::string name;
@@ -125,6 +307,8 @@ struct packet_description {
     int opcode;
     std::vector<field> fields;
     std::unordered_map<std::string, const field*> fields_map;
+    std::vector<derived_field> derived;
+    std::vector<dynamic_section> sections;
 
     packet_description(std::string name,
                        std::string opcode_field,
@@ -157,9 +341,14 @@ struct packet_description {
 };
 using packet_types = std::vector<packet_description>;
 
+// Builds the packet layouts described by a types file (see dis_types.json)
+packet_types packet_description_from_json(json j);
+
 
 namespace mm::mutators {
 
+class field_index;
+
 class json_rule_based_mutator : public packet_mutator {
     packet_types packet_types_list;
     std::vector<Rule> rules;
@@ -173,10 +362,103 @@ public:
                        mm::network::EndpointPtr sender,
                        std::size_t bytes) override;
 
+    bool mutate_copy(const mm::network::BufferPtr& in,
+                     mm::network::EndpointPtr sender,
+                     std::size_t bytes,
+                     mm::network::Buffer& out) override;
+
+    uint64_t number_packet() override;
+
+    packet_verdict process_packet(mm::network::BufferPtr readBuf,
+                                  mm::network::EndpointPtr sender,
+                                  std::size_t bytes,
+                                  uint64_t index) override;
+
+    packet_verdict process_copy(const mm::network::BufferPtr& in,
+                                mm::network::EndpointPtr sender,
+                                std::size_t bytes,
+                                mm::network::Buffer& out,
+                                uint64_t index) override;
+
+    void attach(boost::asio::io_context& ctx) override;
+
+    // Seeds the fuzz streams. Without a call the seed is random; either
+    // way it is logged once. A packet's index is its position, from 0, in
+    // the order the mutator's packets were received (see number_packet),
+    // so the same input and seed fuzz the same packets the same way;
+    // at debug level each fuzzed packet also logs its index.
+    void set_fuzz_seed(uint64_t seed);
+
+    // Runs the rules on a packet as the packet_index-th of the run, to
+    // regenerate a fuzzed packet from the logged seed and index
+    packet_verdict replay(mm::network::BufferPtr readBuf,
+                          mm::network::EndpointPtr sender,
+                          std::size_t bytes,
+                          uint64_t packet_index);
+
 private:
-    static std::vector<Rule> parse_rules(const packet_types& packet_types, json data);
+    explicit json_rule_based_mutator(bool to_big_endian);
+
+    // Uses the compiled cache at cache_file when it matches the sources,
+    // otherwise parses the JSON and rewrites the cache.
+    void load(const std::string& typesfile,
+              const std::string& types_text,
+              const std::string& rules_text,
+              const std::string& cache_file);
+
+    static std::vector<Rule> parse_rules(const packet_types& types, const field_index& fields, json data);
+    void bind_generated_accessors();
+    void bind_derived_fields();
+    void bind_dynamic_sections();
+    void bind_payload_patterns();
+    void bind_sender_scopes();
+    void bind_schedule();
+    void bind_fuzz();
+    void fix_derived_fields(unsigned char* packet, std::size_t bytes, uint64_t dirty) const;
+
+    template<typename Writable>
+    packet_verdict run_rules(const unsigned char*& view, std::size_t bytes, const mm::network::Endpoint* sender, Writable&& writable, uint64_t index) const;
+    expression_context context_for(const Mutation& m, const mm::network::Endpoint* sender) const;
+
     const Mutations* next_mutation;
     bool to_network_byte_order;
+
+    std::chrono::steady_clock::time_point loaded_at = std::chrono::steady_clock::now();
+    mutable flow_counters counters;
+
+    // Packet types with derived fields, and which bit each field has in
+    // Rule::touches_derived
+    struct derived_set {
+        int opcode_offset;      // -1: applies to every packet
+        data_type opcode_type;
+        int64_t opcode;
+        std::vector<derived_field> fields;
+        std::vector<uint64_t> bits;
+        std::vector<uint64_t> dependents;  // later fields covering field i
+        uint64_t mask;
+    };
+    std::vector<derived_set> derived_sets;
+
+    // Packet types with dynamic sections
+    struct dynamic_type {
+        int opcode_offset;      // -1: no opcode check
+        data_type opcode_type;
+        int64_t opcode;
+        std::vector<dynamic_section> sections;
+    };
+    std::vector<dynamic_type> dynamic_types;
+    std::vector<int> dynamic_slot;   // packet type index -> dynamic_types index, or -1
+
+    mm::mutators::payload_matcher payload;
+    mm::mutators::sender_index senders;
+    mutable mm::mutators::rule_scheduler schedule;
+
+    // Some rule has a probability or a fuzz mutation; packets are then
+    // numbered for their fuzz streams
+    bool fuzzing = false;
+    uint64_t fuzz_seed;
+    mutable std::atomic<uint64_t> fuzz_packets{0};
+    class layout_cache;
 };
 
 }
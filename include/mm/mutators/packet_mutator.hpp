@@ -2,14 +2,72 @@
 
 #include <mm/network/udp_transport.hpp>
 
+#include <chrono>
+
 namespace mm::mutators{
 
+// What the proxy should do with a packet besides sending it on as
+// mutated. Rules can combine them: a packet can be duplicated and delayed.
+struct packet_verdict {
+    bool mutated = false;
+    bool drop = false;
+    uint16_t copies = 1;                              // duplicate: how many to send in total
+    std::chrono::microseconds delay{0};               // held this long on top of any impairment
+    const mm::network::Endpoint* redirect = nullptr;  // sent here instead; owned by the mutator
+    std::size_t length = 0;                           // truncated: send only this many bytes
+};
+
 struct packet_mutator {
     virtual ~packet_mutator() = default;
 
+    // Called by each proxy that uses the mutator, with the io_context it
+    // runs on, for mutators that need timers
+    virtual void attach(boost::asio::io_context& /*ctx*/) {}
+
     virtual bool mutate_packet(mm::network::BufferPtr readBuf,
                                mm::network::EndpointPtr sender,
                                std::size_t bytes) = 0;
+
+    // Copy-on-write variant used when one packet fans out to several
+    // sinks: in is left untouched and the mutated packet is written to out
+    // only if a rule actually changes it. Returns whether out was written.
+    virtual bool mutate_copy(const mm::network::BufferPtr& in,
+                             mm::network::EndpointPtr sender,
+                             std::size_t bytes,
+                             mm::network::Buffer& out) {
+        out.assign(in->begin(), in->end());
+        auto copy = std::make_shared<mm::network::Buffer>(std::move(out));
+        bool mutated = mutate_packet(copy, sender, bytes);
+        out = std::move(*copy);
+        return mutated;
+    }
+
+    // Numbers the next received packet. The proxy calls it on the receive
+    // thread, in receive order, and passes the number to process_packet or
+    // process_copy, so anything derived from it (a fuzz stream) doesn't
+    // depend on which worker mutates the packet. 0 if not counted.
+    virtual uint64_t number_packet() { return 0; }
+
+    // Same as the two above, for mutators that can also drop, duplicate,
+    // delay or redirect. The proxy calls these; the defaults only mutate.
+    virtual packet_verdict process_packet(mm::network::BufferPtr readBuf,
+                                          mm::network::EndpointPtr sender,
+                                          std::size_t bytes,
+                                          uint64_t /*index*/) {
+        packet_verdict v;
+        v.mutated = mutate_packet(std::move(readBuf), std::move(sender), bytes);
+        return v;
+    }
+
+    virtual packet_verdict process_copy(const mm::network::BufferPtr& in,
+                                        mm::network::EndpointPtr sender,
+                                        std::size_t bytes,
+                                        mm::network::Buffer& out,
+                                        uint64_t /*index*/) {
+        packet_verdict v;
+        v.mutated = mutate_copy(in, std::move(sender), bytes, out);
+        return v;
+    }
 };
 
 }
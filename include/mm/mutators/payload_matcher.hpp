@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mm::mutators {
+
+// Finds which of many byte patterns occur anywhere in a datagram in one
+// pass. The patterns are compiled into an Aho-Corasick automaton, flattened
+// to a DFA over byte classes (bytes no pattern uses share one class), so
+// each input byte costs one table lookup whatever the number of patterns.
+//
+// Patterns are grouped into slots; a slot matches when any of its patterns
+// occurs. json_rule_based_mutator gives each payload condition a slot.
+class payload_matcher {
+public:
+    static constexpr std::size_t MAX_SLOTS = 256;
+    using matches = std::bitset<MAX_SLOTS>;
+
+    void clear();
+    void add(const std::string& pattern, std::size_t slot);
+    void build();
+
+    bool empty() const { return states == 0; }
+
+    // out is overwritten with the slots that matched
+    void scan(const unsigned char* data, std::size_t size, matches& out) const;
+
+private:
+    std::vector<std::pair<std::string, std::size_t>> patterns;
+
+    std::array<uint8_t, 256> byte_class{};
+    std::size_t classes = 0;
+    std::size_t states = 0;
+    std::vector<uint32_t> next;        // states x classes
+    std::vector<uint32_t> out_begin;   // states + 1 offsets into out_slots
+    std::vector<uint16_t> out_slots;
+    matches always;                    // slots with an empty pattern
+};
+
+}
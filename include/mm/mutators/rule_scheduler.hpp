@@ -0,0 +1,124 @@
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mm::mutators {
+
+// A point at which a rule turns on or off, see rule_activation
+struct rule_trigger {
+    enum kind_t : uint8_t {
+        NONE,
+        ELAPSED,     // value ns after the rules were loaded
+        WALL_CLOCK,  // value ns since the Unix epoch
+        PACKETS,     // the mutator's value-th packet
+        HITS,        // the value-th packet that passed rule
+    };
+
+    kind_t kind = NONE;
+    int32_t rule = -1;
+    int64_t value = 0;
+};
+
+// When a rule applies. Written on the rule as
+//   "active": {"from": <trigger>, "until": <trigger>}
+// with either end optional, and a trigger one of
+//   {"seconds": 60}                    60 s after the rules were loaded
+//   {"time": "2026-10-18T14:00:00Z"}   wall clock, UTC
+//   {"packets": 1000}                  from the mutator's 1000th packet on
+//   {"hits": 1000, "rule": "fire"}     after the 1000th packet that passed
+//                                      the rule named "fire"
+// Each trigger fires once. A rule is active from its "from" until its
+// "until"; a rule that has been stopped stays stopped.
+struct rule_activation {
+    rule_trigger from;
+    rule_trigger until;
+
+    bool any() const { return from.kind != rule_trigger::NONE || until.kind != rule_trigger::NONE; }
+};
+
+// Keeps a bit mask of the rules that are currently active. Time triggers
+// run off a timer on the io_context and count triggers fire from the
+// packet that reaches the count, so per packet the mutator only loads the
+// mask (and bumps the counters something waits on).
+class rule_scheduler {
+public:
+    void clear();
+    void build(const std::vector<rule_activation>& activations,
+               const std::vector<std::string>& names,
+               std::chrono::steady_clock::time_point loaded_at);
+
+    // Starts the timer for time triggers. Only the first call does
+    // anything; a mutator shared by several proxies keeps one schedule.
+    void start(boost::asio::io_context& ctx);
+
+    // No rule has an activation, every rule is always active
+    bool empty() const { return num_words == 0; }
+
+    // Overwrites mask with the active rules, or clears inactive ones from it
+    void fill(uint64_t* mask) const;
+    void restrict(uint64_t* mask) const;
+
+    // Counts a packet for PACKETS triggers
+    void on_packet() {
+        if (!packet_triggers.empty()) {
+            count(packets.fetch_add(1, std::memory_order_relaxed) + 1, packet_triggers);
+        }
+    }
+
+    // Counts a packet that passed rule, if a HITS trigger waits on it
+    void on_hit(std::size_t rule) {
+        if (rule < hit_slot.size() && hit_slot[rule] >= 0) {
+            const int32_t slot = hit_slot[rule];
+            count(hits[slot].fetch_add(1, std::memory_order_relaxed) + 1, hit_triggers[slot]);
+        }
+    }
+
+private:
+    struct count_trigger {
+        uint64_t count;
+        uint32_t rule;
+        bool until;
+    };
+    struct timed_trigger {
+        rule_trigger trigger;
+        uint32_t rule;
+        bool until;
+        std::chrono::steady_clock::time_point due;
+    };
+
+    void count(uint64_t n, const std::vector<count_trigger>& triggers);
+    void fire(uint32_t rule, bool until);
+    void arm();
+
+    std::size_t num_words = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> active;
+
+    // Guarded by mutex; only touched when a trigger fires
+    std::mutex mutex;
+    std::vector<uint64_t> scheduled;  // rules with an activation
+    std::vector<uint64_t> started;
+    std::vector<uint64_t> stopped;
+    std::vector<std::string> names;
+
+    std::atomic<uint64_t> packets{0};
+    std::vector<count_trigger> packet_triggers;
+    std::vector<int32_t> hit_slot;    // rule -> index into hits, or -1
+    std::unique_ptr<std::atomic<uint64_t>[]> hits;
+    std::vector<std::vector<count_trigger>> hit_triggers;
+
+    std::chrono::steady_clock::time_point loaded_at;
+    std::vector<timed_trigger> timed;  // sorted by due once started
+    std::size_t next_timed = 0;
+    std::unique_ptr<boost::asio::steady_timer> timer;
+};
+
+}
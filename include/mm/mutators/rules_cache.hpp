@@ -0,0 +1,34 @@
+#pragma once
+
+#include "json_rule_based_mutator.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mm::mutators {
+
+// Compiled binary form of a types file + rule set.
+//
+// The cache file is keyed on a hash of the source JSON text (and the format
+// version), so it is only used while both sources are unchanged. It is
+// memory-mapped on load and bulk-decoded into the runtime structures,
+// skipping JSON parsing and field name resolution entirely.
+//
+// Bump VERSION whenever Rule, Condition, Mutation or packet_description
+// change shape.
+struct rules_cache {
+    static constexpr uint32_t MAGIC   = 0x43524d4d; // "MMRC"
+    static constexpr uint32_t VERSION = 13;
+
+    static uint64_t source_hash(const std::string& types_text, const std::string& rules_text);
+
+    // Returns false if the cache is missing, stale or malformed.
+    static bool load(const std::string& path, uint64_t hash,
+                     packet_types& types, std::vector<Rule>& rules);
+
+    static bool store(const std::string& path, uint64_t hash,
+                      const packet_types& types, const std::vector<Rule>& rules);
+};
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <mm/network/flow_table.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mm::mutators {
+
+// One entry of a rule's "from": the senders the rule applies to.
+//   "10.0.0.5"  "10.0.0.5:3000"  "10.1.0.0/16"  "10.1.0.0/16:3000"
+//   "fe80::1"  "[fe80::1]:3000"  "fe80::/10"  "[fe80::/10]:3000"  "*:3000"
+// IPv4 senders on a dual-stack socket (v4-mapped) count as IPv4, and so
+// do v4-mapped entries: "::ffff:10.0.0.0/104" is "10.0.0.0/8".
+struct sender_scope {
+    std::array<unsigned char, 16> addr{};  // IPv4 in the first four bytes
+    uint8_t prefix = 0;                    // leading bits of addr that must match
+    uint8_t v4 = 0;
+    uint16_t port = 0;                     // 0: any port
+};
+
+// Parses one "from" entry. "*:port" stands for both families, so it
+// fills two scopes; count says how many.
+bool parse_sender_scope(const std::string& text, sender_scope (&out)[2], int& count);
+
+// Which rules apply to a sender. Exact addresses are looked up in a hash
+// map, CIDR ranges by walking a binary trie per address family; each hit
+// carries a bit mask of rules that is or-ed into the result, together
+// with the rules that have no "from" at all. The mutator asks once per
+// packet and then only visits the rules whose bits are set.
+class sender_index {
+public:
+    // Masks of up to this many words fit in the caller's stack buffer
+    static constexpr std::size_t LOCAL_WORDS = 8;
+
+    void clear();
+    void add(const sender_scope& scope, std::size_t rule);
+    void add_any(std::size_t rule);
+    void build(std::size_t num_rules);
+
+    // No rule is scoped, so every rule applies to every sender
+    bool empty() const { return scoped.empty(); }
+    std::size_t words() const { return num_words; }
+
+    // Writes words() words; a null sender only gets the unscoped rules
+    void select(const mm::network::Endpoint* sender, uint64_t* out) const;
+
+    // The first rule at or after from whose bit is set in mask, or n. A
+    // null mask selects every rule.
+    static std::size_t next(const uint64_t* mask, std::size_t from, std::size_t n) {
+        if (!mask) {
+            return from;
+        }
+        std::size_t word = from >> 6;
+        uint64_t bits = from < n ? mask[word] & (~0ull << (from & 63)) : 0;
+        const std::size_t last = (n + 63) >> 6;
+        while (!bits) {
+            if (++word >= last) {
+                return n;
+            }
+            bits = mask[word];
+        }
+        const std::size_t i = (word << 6) + __builtin_ctzll(bits);
+        return i < n ? i : n;
+    }
+
+private:
+    struct node {
+        int32_t child[2] = {-1, -1};
+        int32_t any_port = -1;                          // mask entry
+        std::vector<std::pair<uint16_t, uint32_t>> ports; // port, mask entry
+    };
+    struct key_hash {
+        std::size_t operator()(const mm::network::flow_key& k) const { return k.hash(); }
+    };
+
+    uint32_t new_entry();
+    void set_bit(uint32_t entry, std::size_t rule);
+    void or_entry(uint32_t entry, uint64_t* out) const;
+    void walk(const std::vector<node>& trie, const unsigned char* addr, int bits, uint16_t port, uint64_t* out) const;
+
+    std::vector<std::pair<sender_scope, std::size_t>> scoped;
+    std::vector<std::size_t> unscoped;
+
+    std::size_t num_words = 0;
+    std::vector<uint64_t> masks;  // entries of num_words words; entry 0 is the unscoped rules
+    std::unordered_map<mm::network::flow_key, uint32_t, key_hash> hosts;  // port 0: any port
+    std::vector<node> trie_v4;
+    std::vector<node> trie_v6;
+};
+
+}
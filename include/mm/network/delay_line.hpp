@@ -0,0 +1,107 @@
+#pragma once
+
+#include "udp_transport.hpp"
+#include "object_pool.hpp"
+#include "timer_wheel.hpp"
+
+#include <functional>
+
+namespace mm::network {
+
+// Where a packet goes once released: to dest through via, or through the
+// proxy's own socket when via is null.
+struct packet_route {
+    Endpoint dest;
+    UDPTransportPtr via;
+    std::chrono::microseconds hold{0};  // extra delay a mutator rule asked for
+};
+
+// Holds copies of packets until their release time, then hands them to
+// send. Packets sit in pooled buffers on a timer wheel; a single
+// steady_timer on the io_context ticks the wheel only while something is
+// pending. Must only be used from that io_context.
+class delay_line {
+public:
+    using clock = std::chrono::steady_clock;
+    using send_fn = std::function<void(const unsigned char* data, std::size_t size, const packet_route& route)>;
+
+    delay_line(boost::asio::io_context* ctx, clock::duration tick, send_fn send)
+        :send(std::move(send))
+        ,wheel(tick)
+        ,timer(*ctx) {
+    }
+
+    ~delay_line() {
+        timer.cancel();
+    }
+
+    delay_line(const delay_line&) = delete;
+    delay_line& operator=(const delay_line&) = delete;
+
+    // Sends right away when nothing is due and nothing is queued ahead of it
+    void submit(const unsigned char* data, std::size_t size, const packet_route& route, clock::duration delay) {
+        if (delay.count() <= 0 && wheel.empty()) {
+            send(data, size, route);
+            return;
+        }
+        submit_at(data, size, route, clock::now() + delay);
+    }
+
+    // Bypasses the queue, for callers that order packets themselves
+    void send_now(const unsigned char* data, std::size_t size, const packet_route& route) {
+        send(data, size, route);
+    }
+
+    void submit_at(const unsigned char* data, std::size_t size, const packet_route& route, clock::time_point when) {
+        delayed_packet* pkt = pool.acquire();
+        pkt->data.assign(data, data + size);
+        pkt->route = route;
+        wheel.schedule(pkt, when);
+        arm();
+    }
+
+    std::size_t size() const { return wheel.size(); }
+    bool empty() const { return wheel.empty(); }
+
+private:
+    struct delayed_packet {
+        uint64_t wheel_expiry = 0;
+        delayed_packet* wheel_next = nullptr;
+        Buffer data;
+        packet_route route;
+    };
+
+    void arm() {
+        if (armed) {
+            return;
+        }
+        armed = true;
+        timer.expires_after(wheel.resolution());
+        timer.async_wait([this](const boost::system::error_code& ec) {
+            if (ec) {
+                return; // cancelled, the owner may already be gone
+            }
+            armed = false;
+            on_tick();
+        });
+    }
+
+    void on_tick() {
+        wheel.advance(clock::now(), [this](delayed_packet* pkt) {
+            send(pkt->data.data(), pkt->data.size(), pkt->route);
+            pkt->route.via.reset();
+            pool.release(pkt);
+        });
+        if (!wheel.empty()) {
+            arm();
+        }
+    }
+
+    send_fn send;
+    object_pool<delayed_packet> pool;
+    timer_wheel<delayed_packet> wheel;
+    boost::asio::steady_timer timer;
+    bool armed = false;
+};
+
+}
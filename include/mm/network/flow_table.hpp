@@ -0,0 +1,129 @@
+#pragma once
+
+#include "udp_transport.hpp"
+
+#include <array>
+#include <cstring>
+#include <optional>
+
+namespace mm::network {
+
+// Endpoint flattened to plain bytes so it can be hashed and compared with
+// a couple of word operations. IPv4 addresses are stored v4-mapped.
+struct flow_key {
+    std::array<unsigned char, 16> addr{};
+    uint16_t port = 0;
+
+    flow_key() = default;
+    explicit flow_key(const Endpoint& ep) : port(ep.port()) {
+        const auto a = ep.address();
+        addr = a.is_v4() ? boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped, a.to_v4()).to_bytes()
+                         : a.to_v6().to_bytes();
+    }
+
+    bool operator==(const flow_key& o) const {
+        return port == o.port && std::memcmp(addr.data(), o.addr.data(), addr.size()) == 0;
+    }
+
+    uint64_t hash() const {
+        uint64_t hi, lo;
+        std::memcpy(&hi, addr.data(), 8);
+        std::memcpy(&lo, addr.data() + 8, 8);
+        uint64_t h = (hi * 0x9e3779b97f4a7c15ULL) ^ (lo + port);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+// Fixed-capacity open-addressing (linear probing) map from flow_key to
+// Value. Slots are allocated once, at twice max_entries rounded up to a
+// power of two, so lookups stay short and nothing reallocates under load.
+// Erase shifts the following cluster back instead of leaving tombstones.
+// Not thread-safe.
+template<typename Value>
+class flow_table {
+public:
+    explicit flow_table(std::size_t max_entries)
+        :limit(max_entries) {
+        std::size_t cap = 16;
+        while (cap < max_entries * 2) cap <<= 1;
+        slots.resize(cap);
+        mask = cap - 1;
+    }
+
+    flow_table(const flow_table&) = delete;
+    flow_table& operator=(const flow_table&) = delete;
+
+    Value* find(const flow_key& key) {
+        for (std::size_t i = key.hash() & mask;; i = (i + 1) & mask) {
+            slot& s = slots[i];
+            if (!s.value) return nullptr;
+            if (s.key == key) return &*s.value;
+        }
+    }
+
+    // nullptr when the table is full
+    Value* insert(const flow_key& key, Value value) {
+        for (std::size_t i = key.hash() & mask;; i = (i + 1) & mask) {
+            slot& s = slots[i];
+            if (!s.value) {
+                if (count >= limit) return nullptr;
+                s.key = key;
+                s.value.emplace(std::move(value));
+                ++count;
+                return &*s.value;
+            }
+            if (s.key == key) {
+                *s.value = std::move(value);
+                return &*s.value;
+            }
+        }
+    }
+
+    bool erase(const flow_key& key) {
+        std::size_t i = key.hash() & mask;
+        for (;; i = (i + 1) & mask) {
+            if (!slots[i].value) return false;
+            if (slots[i].key == key) break;
+        }
+        slots[i].value.reset();
+        --count;
+
+        // Pull later members of the cluster back over the hole when their
+        // home slot doesn't lie between the hole and where they sit now.
+        for (std::size_t j = (i + 1) & mask; slots[j].value; j = (j + 1) & mask) {
+            const std::size_t home = slots[j].key.hash() & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                slots[i] = std::move(slots[j]);
+                slots[j].value.reset();
+                i = j;
+            }
+        }
+        return true;
+    }
+
+    template<typename F>
+    void for_each(F&& f) {
+        for (auto& s : slots) {
+            if (s.value) f(s.key, *s.value);
+        }
+    }
+
+    std::size_t size() const { return count; }
+    std::size_t max_size() const { return limit; }
+
+private:
+    struct slot {
+        flow_key key;
+        std::optional<Value> value;
+    };
+
+    std::vector<slot> slots;
+    std::size_t mask = 0;
+    std::size_t count = 0;
+    std::size_t limit;
+};
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "delay_line.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace mm::network {
+
+// Link degradation applied to forwarded packets. Everything defaults to off.
+struct impairment_settings {
+    enum jitter_distribution { UNIFORM, NORMAL };
+    enum loss_model { NO_LOSS, BERNOULLI, GILBERT_ELLIOTT };
+
+    double delay_ms = 0;
+    double jitter_ms = 0;            // UNIFORM: +/- jitter_ms, NORMAL: std deviation
+    jitter_distribution jitter = UNIFORM;
+
+    loss_model loss = NO_LOSS;
+    double loss_probability = 0;     // BERNOULLI
+    double ge_p = 0;                 // GILBERT_ELLIOTT: good -> bad transition
+    double ge_r = 1;                 //                  bad -> good transition
+    double ge_loss_good = 0;         //                  loss while good (1 - k)
+    double ge_loss_bad = 1;          //                  loss while bad  (1 - h)
+
+    double duplicate_probability = 0;
+    double reorder_probability = 0;  // held back by reorder_delay_ms so later packets overtake
+    double reorder_delay_ms = 10;
+
+    double tick_ms = 0.1;            // timer wheel resolution
+    std::size_t max_queued = 1 << 20;
+    uint64_t seed = 0;               // 0 = random
+
+    bool enabled() const {
+        return delay_ms > 0 || jitter_ms > 0 || loss != NO_LOSS ||
+               duplicate_probability > 0 || reorder_probability > 0;
+    }
+};
+
+// Delays, drops, duplicates and reorders packets on behalf of a proxy.
+// Held packets wait in a delay_line, so this must only be used from the
+// proxy's io_context.
+class impairment_engine {
+public:
+    using clock = delay_line::clock;
+    using send_fn = delay_line::send_fn;
+
+    struct counters {
+        uint64_t submitted = 0;
+        uint64_t dropped = 0;
+        uint64_t duplicated = 0;
+        uint64_t reordered = 0;
+        uint64_t delayed = 0;
+        uint64_t overflowed = 0;  // dropped because max_queued was reached
+    };
+
+    impairment_engine(boost::asio::io_context* ctx, const impairment_settings& cfg, send_fn send)
+        :cfg(cfg)
+        ,held(ctx, to_duration(cfg.tick_ms > 0 ? cfg.tick_ms : 0.1), std::move(send))
+        ,rng(cfg.seed ? cfg.seed : std::random_device{}()) {
+    }
+
+    void submit(const unsigned char* data, std::size_t size, const packet_route& route) {
+        ++stats.submitted;
+        if (lose()) {
+            ++stats.dropped;
+            return;
+        }
+        const int copies = (cfg.duplicate_probability > 0 && chance(cfg.duplicate_probability)) ? 2 : 1;
+        stats.duplicated += copies - 1;
+        for (int i = 0; i < copies; ++i) {
+            dispatch(data, size, route);
+        }
+    }
+
+    const counters& get_counters() const { return stats; }
+    std::size_t queued() const { return held.size(); }
+
+private:
+    static clock::duration to_duration(double ms) {
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(ms));
+    }
+
+    bool chance(double p) {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(rng) < p;
+    }
+
+    bool lose() {
+        switch (cfg.loss) {
+            case impairment_settings::BERNOULLI:
+                return chance(cfg.loss_probability);
+            case impairment_settings::GILBERT_ELLIOTT:
+                ge_bad = ge_bad ? !chance(cfg.ge_r) : chance(cfg.ge_p);
+                return chance(ge_bad ? cfg.ge_loss_bad : cfg.ge_loss_good);
+            default:
+                return false;
+        }
+    }
+
+    double sample_delay_ms() {
+        double ms = cfg.delay_ms;
+        if (cfg.jitter_ms > 0) {
+            if (cfg.jitter == impairment_settings::NORMAL) {
+                ms += std::normal_distribution<double>(0.0, cfg.jitter_ms)(rng);
+            }
+            else {
+                ms += std::uniform_real_distribution<double>(-cfg.jitter_ms, cfg.jitter_ms)(rng);
+            }
+        }
+        if (cfg.reorder_probability > 0 && chance(cfg.reorder_probability)) {
+            ++stats.reordered;
+            ms += cfg.reorder_delay_ms;
+        }
+        return std::max(ms, 0.0);
+    }
+
+    void dispatch(const unsigned char* data, std::size_t size, const packet_route& route) {
+        const double ms = sample_delay_ms() + std::chrono::duration<double, std::milli>(route.hold).count();
+        if (ms > 0 || !held.empty()) {
+            if (held.size() >= cfg.max_queued) {
+                ++stats.overflowed;
+                return;
+            }
+            ++stats.delayed;
+        }
+        held.submit(data, size, route, to_duration(ms));
+    }
+
+    impairment_settings cfg;
+    delay_line held;
+    std::mt19937_64 rng;
+    bool ge_bad = false;
+    counters stats;
+};
+
+}
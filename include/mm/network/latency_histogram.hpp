@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace mm::network {
+
+// Log-linear latency histogram in nanoseconds: each power of two is split
+// into 16 sub-buckets, so any recorded value lands within ~6% of its bucket's
+// upper bound. record() is meant for a single writer; readers on other threads
+// see counts that are at worst slightly stale.
+class latency_histogram {
+public:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint64_t ns) {
+        auto& c = counts[index(ns)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the given quantile (0..1), or 0
+    // when nothing has been recorded
+    uint64_t percentile(double q) const {
+        const uint64_t n = count();
+        if (n == 0) {
+            return 0;
+        }
+        uint64_t rank = uint64_t(q * double(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return upper_bound(i);
+            }
+        }
+        return upper_bound(BUCKETS - 1);
+    }
+
+private:
+    // Values below SUB_BUCKETS get exact buckets; above that the top
+    // SUB_BITS+1 significant bits pick the bucket.
+    static int index(uint64_t v) {
+        if (v < SUB_BUCKETS) {
+            return int(v);
+        }
+        const int msb = 63 - __builtin_clzll(v);
+        const int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + int((v >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t upper_bound(int i) {
+        if (i < SUB_BUCKETS) {
+            return uint64_t(i);
+        }
+        const int shift = i / SUB_BUCKETS - 1;
+        const uint64_t sub = uint64_t(i % SUB_BUCKETS) | SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+};
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "udp_transport.hpp"
+
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace mm::network {
+
+// Options for latency-critical runs. All off by default.
+struct low_latency_settings {
+    std::vector<int> cpus;       // network thread i is pinned to cpus[i % size]
+    bool spin = false;           // spin on io_context::poll() instead of sleeping in epoll
+    int fifo_priority = 0;       // > 0: SCHED_FIFO at this priority (needs CAP_SYS_NICE)
+    SocketOptions socket;        // SO_RCVBUF / SO_SNDBUF / SO_BUSY_POLL on every proxy socket
+    bool measure_latency = false;
+};
+
+inline bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        spdlog::warn("Failed to pin thread to CPU {}: {}", cpu, std::strerror(rc));
+        return false;
+    }
+    return true;
+#else
+    spdlog::warn("CPU pinning is not supported on this platform");
+    return false;
+#endif
+}
+
+inline bool set_current_thread_fifo(int priority) {
+#ifdef __linux__
+    sched_param param{};
+    param.sched_priority = priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc != 0) {
+        spdlog::warn("Failed to switch to SCHED_FIFO priority {}: {}", priority, std::strerror(rc));
+        return false;
+    }
+    return true;
+#else
+    spdlog::warn("SCHED_FIFO is not supported on this platform");
+    return false;
+#endif
+}
+
+// Applies the thread-level settings to the calling thread, then runs ctx
+// until it is stopped. Spinning keeps the core busy but skips the epoll
+// sleep/wakeup on every packet.
+inline void run_network_thread(boost::asio::io_context& ctx, const low_latency_settings& cfg, std::size_t thread_index) {
+    if (!cfg.cpus.empty()) {
+        pin_current_thread(cfg.cpus[thread_index % cfg.cpus.size()]);
+    }
+    if (cfg.fifo_priority > 0) {
+        set_current_thread_fifo(cfg.fifo_priority);
+    }
+
+    auto work_guard = boost::asio::make_work_guard(ctx);
+    if (cfg.spin) {
+        while (!ctx.stopped()) {
+            ctx.poll();
+        }
+    }
+    else {
+        ctx.run();
+    }
+}
+
+}
@@ -1,6 +1,12 @@
 #pragma once
 
 #include "udp_transport.hpp"
+#include "impairment.hpp"
+#include "shaper.hpp"
+#include "flow_table.hpp"
+#include "pipeline.hpp"
+#include "latency_histogram.hpp"
+#include <atomic>
 #include <iomanip>
 #include <functional>
 
@@ -30,12 +36,76 @@ public:
         bool multicast_enabled;
         std::string multicast_group;
         int multicast_ttl;
-        std::shared_ptr<mutators::packet_mutator> mutator;
+        std::shared_ptr<mutators::packet_mutator> mutator;  // applied in place, seen by every sink
         bool log_to_stdout = false;
+        impairment_settings impairment{};
+        shaper_settings shaping{};
+
+        // Give every client its own upstream port so replies from the
+        // remote host can be routed back to it
+        bool bidirectional = false;
+        double flow_idle_timeout_s = 60;
+        std::size_t max_flows = 65536;
+
+        // Extra destinations fed from the same receive. A sink's mutator
+        // only changes that sink's copy; leave it null to forward the packet
+        // as it stands after the common mutator.
+        struct sink {
+            std::string host;
+            unsigned short port;
+            std::shared_ptr<mutators::packet_mutator> mutator;
+        };
+        std::vector<sink> extra_sinks{};
+
+        // Mutate on this many worker threads instead of the receive
+        // thread; 0 keeps everything inline. Packets from one sender always
+        // go to the same worker. Mutators must then be safe to call from
+        // several threads at once (json_rule_based_mutator is).
+        std::size_t pipeline_workers = 0;
+        std::size_t pipeline_depth = 256;   // packets in flight before drops, 64 KiB each
+
+        // Send to each sink from its own socket connected to it, instead of
+        // from the listening socket. Forwarded packets then come from an
+        // OS-picked port. Ignored in bidirectional mode, where the per-flow
+        // sockets do the sending.
+        bool connected_egress = true;
+
+        SocketOptions socket_options{};  // applied to every socket the proxy opens
+        // Time from the receive completing to the send returning, minus
+        // any delay added by shaping or impairment
+        bool measure_latency = false;
+    };
+
+    // Written by the proxy's io_context thread, safe to read from anywhere
+    struct statistics {
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> received_bytes{0};
+        std::atomic<uint64_t> mutated{0};   // also written by pipeline workers: fetch_add only
+        std::atomic<uint64_t> forwarded{0};
+        std::atomic<uint64_t> forwarded_bytes{0};
+        std::atomic<uint64_t> send_errors{0};
+        // Rule actions (see packet_verdict)
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> duplicated{0};   // extra copies sent
+        std::atomic<uint64_t> redirected{0};
+        std::atomic<uint64_t> held{0};         // delayed by a rule
     };
 
     const Endpoint& getSource() { return src_ep; }
     const Endpoint& getSink() { return sink_ep; }
+    const statistics& getStatistics() const { return stats; }
+    const latency_histogram& getLatency() const { return latency; }
+    UDPTransport& getTransport() { return *socket; }
+    // Connected per-sink sockets, empty unless connected_egress is in use
+    std::vector<UDPTransport*> getEgressTransports() {
+        std::vector<UDPTransport*> out;
+        for (auto& sink : sinks) {
+            if (sink.egress) {
+                out.push_back(sink.egress.get());
+            }
+        }
+        return out;
+    }
 
 private:
     mm::network::UDPTransportPtr socket;
@@ -43,13 +113,75 @@ private:
     Endpoint src_ep;
     Endpoint sink_ep;
 
+    struct sink_state {
+        Endpoint ep;
+        std::shared_ptr<mutators::packet_mutator> mutator;
+        Buffer copy; // copy-on-write target, reused between packets
+        UDPTransportPtr egress;  // connected to ep, or null to send from the listening socket
+    };
+    std::vector<sink_state> sinks;  // sink_ep first
+    std::vector<uint64_t> inline_sink_indexes;  // the packet being handled inline
+
+    // Sends made while handling one received packet, or all the datagrams
+    // of one GRO read, are collected here and flushed together, one batch
+    // per socket
+    std::vector<OutgoingPacket> outbox;
+    std::vector<UDPTransport*> outbox_via;  // parallel to outbox
+    bool outbox_mixed = false;              // more than one socket in outbox
+    std::vector<OutgoingPacket> outbox_group;
+    int batching = 0;                       // begin_batch() depth
+    bool copies_in_outbox = false;          // some of outbox points into a sink's copy
+    std::vector<std::chrono::steady_clock::time_point> burst_received;  // recorded once the burst is sent
+
+    statistics stats;
+    latency_histogram latency;
+
+    std::unique_ptr<impairment_engine> impairment;
+    std::unique_ptr<traffic_shaper> shaper;
+    std::shared_ptr<mutation_pipeline> pipeline;
+
+    // bidirectional mode
+    struct flow {
+        uint64_t wheel_expiry = 0;
+        flow* wheel_next = nullptr;
+        Endpoint client;
+        UDPTransportPtr upstream;
+        std::chrono::steady_clock::time_point last_seen;
+    };
+    boost::asio::io_context* ioCtx;
+    flow_table<std::unique_ptr<flow>> flows;
+    timer_wheel<flow> flow_expiry;
+    boost::asio::steady_timer flow_timer;
+    bool flow_timer_armed = false;
+    std::chrono::steady_clock::duration flow_timeout;
+    uint64_t flows_rejected = 0;
+
 public:
     ~middleman_proxy() {
+        if (pipeline) {
+            pipeline->stop();
+        }
         socket->cancel();
+        flow_timer.cancel();
+        flows.for_each([](const flow_key&, std::unique_ptr<flow>& f) {
+            f->upstream->stopListening();
+        });
     }
+
+    const impairment_engine* getImpairment() const { return impairment.get(); }
+    const traffic_shaper* getShaper() const { return shaper.get(); }
+    const mutation_pipeline* getPipeline() const { return pipeline.get(); }
+    std::size_t getFlowCount() const { return flows.size(); }
+    uint64_t getRejectedFlowCount() const { return flows_rejected; }
+
     middleman_proxy(boost::asio::io_context* ctx, const settings& cfg)
         :socket(std::make_shared<UDPTransport>(ctx))
-        ,cfg(cfg){
+        ,cfg(cfg)
+        ,ioCtx(ctx)
+        ,flows(cfg.bidirectional ? cfg.max_flows : 0)
+        ,flow_expiry(flow_tick(cfg.flow_idle_timeout_s))
+        ,flow_timer(*ctx)
+        ,flow_timeout(std::chrono::duration_cast<std::chrono::steady_clock::duration>(Seconds(cfg.flow_idle_timeout_s))){
 
         spdlog::info("middleman_proxy starting with settings:  {}:{} -> {}:{}",
                 cfg.local_host,
@@ -60,9 +192,32 @@ public:
         socket->setReadCallback([this]<typename ...Ts>(Ts&& ...ts) {
                 recv_callback(std::forward<Ts>(ts)...);
             });
+        // A GRO read's datagrams are sent together, so a run of them to one
+        // sink can leave as a single GSO send
+        socket->setBurstCallback([this](bool end) {
+                if (end) {
+                    end_burst();
+                }
+                else {
+                    begin_batch();
+                }
+            });
 
         src_ep  = {boost::asio::ip::make_address(cfg.local_host), cfg.local_port};
         sink_ep = {boost::asio::ip::make_address(cfg.remote_host), cfg.remote_port};
+        sinks.push_back({sink_ep, nullptr, {}, nullptr});
+        for (const auto& extra : cfg.extra_sinks) {
+            spdlog::info("Also forwarding to {}:{}{}", extra.host, extra.port, extra.mutator ? " with its own rules" : "");
+            sinks.push_back({{boost::asio::ip::make_address(extra.host), extra.port}, extra.mutator, {}, nullptr});
+        }
+        if (cfg.mutator) {
+            cfg.mutator->attach(*ctx);
+        }
+        for (const auto& sink : sinks) {
+            if (sink.mutator) {
+                sink.mutator->attach(*ctx);
+            }
+        }
 
         bool reuse = true;
         auto rc = socket->startListening(src_ep, reuse);
@@ -70,6 +225,7 @@ public:
             spdlog::error("Failed to start middleman proxy socket: errcode {}", (int)rc);
             exit(-1);
         }
+        socket->applyOptions(cfg.socket_options);
 
         if (cfg.multicast_enabled) {
             bool loopback = false;
@@ -77,6 +233,32 @@ public:
             socket->joinGroup(cfg.multicast_group, cfg.local_host, loopback);
             socket->setTTL(cfg.multicast_ttl);
         }
+
+        if (cfg.connected_egress && !cfg.bidirectional) {
+            for (auto& sink : sinks) {
+                sink.egress = open_egress(sink.ep);
+            }
+        }
+
+        if (cfg.impairment.enabled()) {
+            impairment = std::make_unique<impairment_engine>(ctx, cfg.impairment,
+                [this](const unsigned char* data, std::size_t size, const packet_route& route) {
+                    forward(data, size, route);
+                });
+        }
+        if (cfg.shaping.enabled()) {
+            shaper = std::make_unique<traffic_shaper>(ctx, cfg.shaping,
+                [this](const unsigned char* data, std::size_t size, const packet_route& route) {
+                    impair(data, size, route);
+                });
+        }
+        if (cfg.pipeline_workers > 0) {
+            pipeline = std::make_shared<mutation_pipeline>(ctx, cfg.pipeline_workers, cfg.pipeline_depth,
+                [this](mutation_pipeline::job& j) { mutate_job(j); },
+                [this](mutation_pipeline::job* const* jobs, std::size_t n) { send_jobs(jobs, n); });
+            pipeline->start();
+            spdlog::info("Mutating on {} worker threads", pipeline->worker_count());
+        }
     }
 
     // For UI to be notified of packets
@@ -91,25 +273,468 @@ public:
                        mm::network::EndpointPtr sender,
                        const boost::system::error_code& ec,
                        std::size_t bytes) {
-        spdlog::info("Received {} bytes", bytes);
-        // if (sender->address() == src_ep.address() && sender->port() != cfg.local_port) { return; }
+        const auto received_at = cfg.measure_latency ? std::chrono::steady_clock::now()
+                                                     : std::chrono::steady_clock::time_point();
+        spdlog::debug("Received {} bytes", bytes);
+        count(stats.received, 1);
+        count(stats.received_bytes, bytes);
 
+        UDPTransportPtr via;
+        if (cfg.bidirectional) {
+            flow* f = flow_for(*sender);
+            if (!f) {
+                return;
+            }
+            via = f->upstream;
+        }
+
+        if (pipeline) {
+            if (auto* j = pipeline->acquire()) {
+                std::memcpy(j->data->data(), readBuf->data(), bytes);
+                *j->sender = *sender;
+                j->bytes = bytes;
+                j->via = std::move(via);
+                j->received_at = received_at;
+                number_packet(j->index, j->sink_indexes);
+                pipeline->submit(j);
+            }
+            if (on_recv) {
+                on_recv(socket,readBuf,sender,ec,bytes);
+            }
+            return;
+        }
+
+        uint64_t index;
+        number_packet(index, inline_sink_indexes);
+        const mutators::packet_verdict verdict = mutate(readBuf, sender, bytes, index);
+        if (verdict.drop) {
+            count(stats.dropped, 1);
+        }
+        else {
+            const std::size_t size = sent_size(bytes, verdict);
+            begin_batch();
+            if (verdict.redirect) {
+                redirect(readBuf->data(), size, *sender, via, verdict);
+            }
+            else {
+                for (std::size_t i = 0; i < sinks.size(); ++i) {
+                    auto& sink = sinks[i];
+                    mutators::packet_verdict own;
+                    if (sink.mutator) {
+                        if (copies_in_outbox) {
+                            flush_outbox(); // sink.copy is about to be overwritten
+                        }
+                        own = sink.mutator->process_copy(readBuf, sender, size, sink.copy, inline_sink_indexes[i]);
+                        copies_in_outbox = own.mutated;
+                    }
+                    send_to_sink(own.mutated ? sink.copy.data() : readBuf->data(), size, *sender, sink, via, verdict, own);
+                }
+            }
+            end_batch();
+        }
+        if (batching && cfg.measure_latency) {
+            burst_received.push_back(received_at);
+        }
+        else {
+            record_latency(received_at);
+        }
+
+        if (on_recv) {
+            on_recv(socket,readBuf,sender,ec,bytes);
+        }
+    }
+
+private:
+    // Only one thread writes, so a relaxed load/store beats a locked add.
+    // Not for stats.mutated, which pipeline workers also add to.
+    static void count(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // Numbers a received packet for every mutator that will see it, on the
+    // io_context in receive order, so a fuzzed packet gets the same number
+    // however many workers there are and whichever one mutates it
+    void number_packet(uint64_t& index, std::vector<uint64_t>& sink_indexes) {
+        index = cfg.mutator ? cfg.mutator->number_packet() : 0;
+        sink_indexes.resize(sinks.size());
+        for (std::size_t i = 0; i < sinks.size(); ++i) {
+            sink_indexes[i] = sinks[i].mutator ? sinks[i].mutator->number_packet() : 0;
+        }
+    }
+
+    mutators::packet_verdict mutate(const BufferPtr& readBuf, const EndpointPtr& sender, std::size_t bytes, uint64_t index) {
         if (cfg.log_to_stdout) {
             spdlog::info(buffer_to_hex((const char*)readBuf->data(), bytes));
         }
 
-        bool mutated = cfg.mutator->mutate_packet(readBuf,sender,bytes);
-        if (mutated && cfg.log_to_stdout) {
+        mutators::packet_verdict verdict;
+        if (cfg.mutator) {
+            verdict = cfg.mutator->process_packet(readBuf, sender, bytes, index);
+        }
+        if (verdict.mutated) {
+            stats.mutated.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (verdict.mutated && cfg.log_to_stdout) {
             spdlog::info(buffer_to_hex((const char*)readBuf->data(), bytes) + " (mutated)");
         }
+        return verdict;
+    }
 
+    // Worker thread: everything here must leave the proxy's own state alone
+    void mutate_job(mutation_pipeline::job& j) {
+        j.verdict = {};
+        if (cfg.mutator) {
+            j.verdict = cfg.mutator->process_packet(j.data, j.sender, j.bytes, j.index);
+        }
+        if (j.verdict.mutated) {
+            stats.mutated.fetch_add(1, std::memory_order_relaxed);  // several writers here
+        }
+        j.bytes = sent_size(j.bytes, j.verdict);
+        j.copies.resize(sinks.size());
+        j.verdicts.assign(sinks.size(), {});
+        if (j.verdict.drop || j.verdict.redirect) {
+            return;
+        }
+        for (std::size_t i = 0; i < sinks.size(); ++i) {
+            if (sinks[i].mutator) {
+                j.verdicts[i] = sinks[i].mutator->process_copy(j.data, j.sender, j.bytes, j.copies[i], j.sink_indexes[i]);
+            }
+        }
+    }
 
-        auto rc = socket->send_to(readBuf->data(), bytes, sink_ep);
+    // Back on the io_context, one call per drain
+    void send_jobs(mutation_pipeline::job* const* jobs, std::size_t n) {
+        begin_batch();
+        for (std::size_t k = 0; k < n; ++k) {
+            const auto& j = *jobs[k];
+            if (j.verdict.drop) {
+                count(stats.dropped, 1);
+                continue;
+            }
+            if (j.verdict.redirect) {
+                redirect(j.data->data(), j.bytes, *j.sender, j.via, j.verdict);
+                continue;
+            }
+            for (std::size_t i = 0; i < sinks.size(); ++i) {
+                const unsigned char* data = j.verdicts[i].mutated ? j.copies[i].data() : j.data->data();
+                send_to_sink(data, j.bytes, *j.sender, sinks[i], j.via, j.verdict, j.verdicts[i]);
+            }
+        }
+        end_batch();
+        for (std::size_t k = 0; k < n; ++k) {
+            record_latency(jobs[k]->received_at);
+        }
+    }
+
+    void record_latency(std::chrono::steady_clock::time_point received_at) {
+        if (cfg.measure_latency) {
+            latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - received_at).count());
+        }
+    }
+
+    // A truncating rule shortens what is sent
+    static std::size_t sent_size(std::size_t size, const mutators::packet_verdict& verdict) {
+        return verdict.length && verdict.length < size ? verdict.length : size;
+    }
+
+    // One sink's copy, after the common mutator's verdict and the sink's own
+    void send_to_sink(const unsigned char* data, std::size_t size, const Endpoint& sender, const sink_state& sink,
+                      const UDPTransportPtr& via, const mutators::packet_verdict& common, const mutators::packet_verdict& own) {
+        if (own.drop) {
+            count(stats.dropped, 1);
+            return;
+        }
+        packet_route route{sink.ep, via ? via : sink.egress};
+        if (own.redirect) {
+            // the sink's connected socket can't reach anywhere else
+            route = {*own.redirect, via};
+            count(stats.redirected, 1);
+        }
+        deliver(data, sent_size(size, own), sender, route, std::max(common.copies, own.copies), std::max(common.delay, own.delay));
+    }
+
+    // Sent from the listening socket (or the flow's, bidirectionally)
+    // instead of to the sinks
+    void redirect(const unsigned char* data, std::size_t size, const Endpoint& sender,
+                  const UDPTransportPtr& via, const mutators::packet_verdict& verdict) {
+        count(stats.redirected, 1);
+        deliver(data, size, sender, packet_route{*verdict.redirect, via}, verdict.copies, verdict.delay);
+    }
+
+    // Rule delays go through the impairment engine, which is created on
+    // first use when it isn't configured
+    void deliver(const unsigned char* data, std::size_t size, const Endpoint& sender, packet_route route,
+                 uint16_t copies, std::chrono::microseconds delay) {
+        if (delay.count() > 0) {
+            route.hold = delay;
+            count(stats.held, 1);
+            if (!impairment) {
+                impairment = std::make_unique<impairment_engine>(ioCtx, impairment_settings{},
+                    [this](const unsigned char* data, std::size_t size, const packet_route& route) {
+                        forward(data, size, route);
+                    });
+            }
+        }
+        if (copies > 1) {
+            count(stats.duplicated, copies - 1);
+        }
+        for (uint16_t i = 0; i < copies; ++i) {
+            dispatch(data, size, sender, route);
+        }
+    }
+
+    void dispatch(const unsigned char* data, std::size_t size, const Endpoint& sender, const packet_route& route) {
+        if (shaper) {
+            shaper->submit(data, size, sender, route);
+        }
+        else {
+            impair(data, size, route);
+        }
+    }
+
+    // shaper -> impairment -> socket
+    void impair(const unsigned char* data, std::size_t size, const packet_route& route) {
+        if (impairment) {
+            impairment->submit(data, size, route);
+        }
+        else {
+            forward(data, size, route);
+        }
+    }
+
+    void forward(const unsigned char* data, std::size_t size, const packet_route& route) {
+        UDPTransport* out = route.via ? route.via.get() : socket.get();
+        if (batching) {
+            outbox_mixed = outbox_mixed || (!outbox_via.empty() && outbox_via.front() != out);
+            outbox_via.push_back(out);
+            outbox.push_back({data, size, route.dest});
+            return;
+        }
+        count(stats.forwarded, 1);
+        count(stats.forwarded_bytes, size);
+        auto rc = out->isConnected() ? out->send(data, size) : out->send_to(data, size, route.dest);
+        if (rc != UDPTransport::SUCCESS) {
+            count(stats.send_errors, 1);
+            spdlog::warn("Failed to forward packet to {}:{}: errcode {}",
+                         route.dest.address().to_string(), route.dest.port(), (int)rc);
+        }
+    }
+
+    // Packets held by the shaper or impairment engine are released one at a
+    // time from their timers and don't go through the outbox.
+    void begin_batch() {
+        ++batching;
+    }
+
+    void end_batch() {
+        if (--batching == 0) {
+            flush_outbox();
+        }
+    }
+
+    void end_burst() {
+        end_batch();
+        for (const auto& received_at : burst_received) {
+            record_latency(received_at);
+        }
+        burst_received.clear();
+    }
+
+    void flush_outbox() {
+        if (outbox.empty()) {
+            return;
+        }
+        count(stats.forwarded, outbox.size());
+        for (const auto& pkt : outbox) {
+            count(stats.forwarded_bytes, pkt.size);
+        }
+        if (!outbox_mixed) {
+            send_batch(*outbox_via.front(), outbox);
+        }
+        else {
+            // Pull out each socket's packets in order, marking them sent
+            for (std::size_t start = 0; start < outbox.size(); ++start) {
+                UDPTransport* via = outbox_via[start];
+                if (!via) {
+                    continue;
+                }
+                outbox_group.clear();
+                for (std::size_t i = start; i < outbox.size(); ++i) {
+                    if (outbox_via[i] == via) {
+                        outbox_group.push_back(outbox[i]);
+                        outbox_via[i] = nullptr;
+                    }
+                }
+                send_batch(*via, outbox_group);
+            }
+        }
+        outbox.clear();
+        outbox_via.clear();
+        outbox_mixed = false;
+        copies_in_outbox = false;
+    }
+
+    void send_batch(UDPTransport& via, const std::vector<OutgoingPacket>& packets) {
+        auto rc = via.send_batch(packets.data(), packets.size());
+        if (rc != UDPTransport::SUCCESS) {
+            count(stats.send_errors, 1);
+            spdlog::warn("Failed to forward some of {} packets: errcode {}", packets.size(), (int)rc);
+        }
+    }
+
+    // Binds to the listening address when it is a unicast one, so packets
+    // leave through the same interface as before
+    UDPTransportPtr open_egress(const Endpoint& dest) {
+        boost::asio::ip::address local = src_ep.address();
+        if (local.is_multicast() || local.is_unspecified() || local.is_v4() != dest.address().is_v4()) {
+            local = dest.address().is_v4() ? boost::asio::ip::address(boost::asio::ip::address_v4::any())
+                                           : boost::asio::ip::address(boost::asio::ip::address_v6::any());
+        }
+        auto egress = std::make_shared<UDPTransport>(ioCtx);
+        auto rc = egress->connectTo(dest, local);
+        if (rc != UDPTransport::SUCCESS) {
+            spdlog::warn("Failed to connect a socket to {}:{} (errcode {}), sending from the listening socket",
+                         dest.address().to_string(), dest.port(), (int)rc);
+            return nullptr;
+        }
+        egress->applyOptions(cfg.socket_options);
+        if (cfg.multicast_enabled && dest.address().is_multicast()) {
+            egress->setTTL(cfg.multicast_ttl);
+        }
+        return egress;
+    }
+
+    static std::chrono::steady_clock::duration flow_tick(double timeout_s) {
+        // ~16 ticks per timeout keeps evictions within 6% of it
+        const double tick_s = std::clamp(timeout_s / 16, 0.001, 1.0);
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(Seconds(tick_s));
+    }
+
+    flow* flow_for(const Endpoint& client) {
+        const auto now = std::chrono::steady_clock::now();
+        const flow_key key(client);
+        if (auto* existing = flows.find(key)) {
+            (*existing)->last_seen = now;
+            return existing->get();
+        }
+        // Checked up front so a full table never opens an upstream socket
+        if (flows.size() >= flows.max_size()) {
+            if (flows_rejected++ % 1000 == 0) {
+                spdlog::warn("Flow table full ({} flows), dropping packets from new clients", flows.size());
+            }
+            return nullptr;
+        }
+
+        auto f = std::make_unique<flow>();
+        f->client = client;
+        f->last_seen = now;
+        f->upstream = std::make_shared<UDPTransport>(ioCtx);
+        f->upstream->setReadCallback([this, key]<typename ...Ts>(Ts&& ...ts) {
+                reply_callback(key, std::forward<Ts>(ts)...);
+            });
+
+        const auto any = sink_ep.address().is_v4() ? boost::asio::ip::address(boost::asio::ip::address_v4::any())
+                                                   : boost::asio::ip::address(boost::asio::ip::address_v6::any());
+        auto rc = f->upstream->startListeningAnyPort(any);
         if (rc != UDPTransport::SUCCESS) {
-            spdlog::warn("Failed to forward packet to remote host: errcode {}", (int)rc);
+            spdlog::error("Failed to open upstream socket for {}:{}: errcode {}",
+                          client.address().to_string(), client.port(), (int)rc);
+            return nullptr;
+        }
+        f->upstream->applyOptions(cfg.socket_options);
+
+        flow* raw = f.get();
+        auto upstream = f->upstream;
+        if (!flows.insert(key, std::move(f))) {
+            upstream->stopListening();
+            return nullptr;
         }
+        spdlog::debug("New flow {}:{} via local port {}", client.address().to_string(), client.port(), raw->upstream->localPort());
 
-        on_recv(socket,readBuf,sender,ec,bytes);
+        flow_expiry.schedule(raw, now + flow_timeout);
+        arm_flow_timer();
+        return raw;
+    }
+
+    void reply_callback(const flow_key& key,
+                        mm::network::UDPTransportPtr upstream,
+                        mm::network::BufferPtr readBuf,
+                        mm::network::EndpointPtr sender,
+                        const boost::system::error_code& ec,
+                        std::size_t bytes) {
+        auto* entry = flows.find(key);
+        if (!entry || (*entry)->upstream != upstream) {
+            return; // flow was evicted while this read was in flight
+        }
+        if (!is_sink(*sender)) {
+            return; // only the remote hosts may answer through a flow
+        }
+        flow& f = **entry;
+        f.last_seen = std::chrono::steady_clock::now();
+
+        const mutators::packet_verdict verdict = mutate(readBuf, sender, bytes, cfg.mutator ? cfg.mutator->number_packet() : 0);
+        if (verdict.drop) {
+            count(stats.dropped, 1);
+        }
+        else {
+            const std::size_t size = sent_size(bytes, verdict);
+            begin_batch();
+            if (verdict.redirect) {
+                redirect(readBuf->data(), size, *sender, nullptr, verdict);
+            }
+            else {
+                deliver(readBuf->data(), size, *sender, packet_route{f.client, nullptr}, verdict.copies, verdict.delay);
+            }
+            end_batch();
+        }
+
+        if (on_recv) {
+            on_recv(upstream,readBuf,sender,ec,bytes);
+        }
+    }
+
+    bool is_sink(const Endpoint& ep) const {
+        for (const auto& sink : sinks) {
+            if (ep == sink.ep || sink.ep.address().is_multicast()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void arm_flow_timer() {
+        if (flow_timer_armed) {
+            return;
+        }
+        flow_timer_armed = true;
+        flow_timer.expires_after(flow_expiry.resolution());
+        flow_timer.async_wait([this](const boost::system::error_code& ec) {
+            if (ec) {
+                return;
+            }
+            flow_timer_armed = false;
+            expire_flows();
+        });
+    }
+
+    // Packets only touch last_seen; a flow that turns out to have been
+    // active when its expiry comes up is rescheduled instead of evicted.
+    void expire_flows() {
+        const auto now = std::chrono::steady_clock::now();
+        flow_expiry.advance(now, [this, now](flow* f) {
+            if (now - f->last_seen < flow_timeout) {
+                flow_expiry.schedule(f, f->last_seen + flow_timeout);
+                return;
+            }
+            spdlog::debug("Flow {}:{} idle, closing local port {}",
+                          f->client.address().to_string(), f->client.port(), f->upstream->localPort());
+            f->upstream->stopListening();
+            flows.erase(flow_key(f->client));
+        });
+        if (!flow_expiry.empty()) {
+            arm_flow_timer();
+        }
     }
 
 };
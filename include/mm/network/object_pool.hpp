@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace mm::network {
+
+// Free-list pool handing out default-constructed T's allocated in chunks.
+// Objects are never destroyed while the pool lives, so members such as a
+// Buffer keep their capacity between uses and steady-state traffic doesn't
+// touch the allocator. Not thread-safe.
+template<typename T>
+class object_pool {
+public:
+    explicit object_pool(std::size_t chunk_size = 1024) : chunk_size(chunk_size ? chunk_size : 1) {}
+
+    object_pool(const object_pool&) = delete;
+    object_pool& operator=(const object_pool&) = delete;
+
+    T* acquire() {
+        if (free_list.empty()) {
+            grow();
+        }
+        T* obj = free_list.back();
+        free_list.pop_back();
+        ++outstanding;
+        return obj;
+    }
+
+    void release(T* obj) {
+        free_list.push_back(obj);
+        --outstanding;
+    }
+
+    std::size_t in_use() const { return outstanding; }
+    std::size_t capacity() const { return chunks.size() * chunk_size; }
+
+private:
+    void grow() {
+        chunks.push_back(std::make_unique<T[]>(chunk_size));
+        T* chunk = chunks.back().get();
+        free_list.reserve(capacity());
+        for (std::size_t i = chunk_size; i > 0; --i) {
+            free_list.push_back(&chunk[i - 1]);
+        }
+    }
+
+    std::size_t chunk_size;
+    std::size_t outstanding = 0;
+    std::vector<std::unique_ptr<T[]>> chunks;
+    std::vector<T*> free_list;
+};
+
+}
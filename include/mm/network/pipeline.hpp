@@ -0,0 +1,214 @@
+#pragma once
+
+#include "spsc_ring.hpp"
+#include "flow_table.hpp"
+
+#include <mm/mutators/packet_mutator.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace mm::network {
+
+// Moves per-packet work off the receive thread. The io_context thread
+// copies each packet into a job and hands it to the worker picked by a
+// hash of the sender, so one sender's packets stay in order. Workers run
+// work() and push the jobs back. A single drain handler posted to the
+// io_context then collects every finished job and passes them to done()
+// in one go, which is where sends get batched.
+//
+// Jobs are preallocated (depth of them, each with a receive-sized buffer)
+// and recycled by the io_context thread. When all of them are in flight,
+// acquire() returns nullptr and the caller drops the packet.
+class mutation_pipeline : public std::enable_shared_from_this<mutation_pipeline> {
+public:
+    struct job {
+        BufferPtr data = std::make_shared<Buffer>(0xffff);
+        EndpointPtr sender = std::make_shared<Endpoint>();
+        std::size_t bytes = 0;
+        UDPTransportPtr via;
+        std::chrono::steady_clock::time_point received_at;
+        // Packet numbers for the common mutator and each sink's, taken in
+        // receive order before submit() (see packet_mutator::number_packet)
+        uint64_t index = 0;
+        std::vector<uint64_t> sink_indexes;
+        // Filled in by work(): the common mutator's verdict and each sink's
+        // copy-on-write result (copies[i] is used when verdicts[i].mutated)
+        mutators::packet_verdict verdict;
+        std::vector<Buffer> copies;
+        std::vector<mutators::packet_verdict> verdicts;
+    };
+
+    using work_fn = std::function<void(job&)>;                       // worker thread
+    using done_fn = std::function<void(job* const* jobs, std::size_t n)>; // io_context thread
+
+    struct counters {
+        std::atomic<uint64_t> dispatched{0};
+        std::atomic<uint64_t> dropped{0};  // no free job
+    };
+
+    mutation_pipeline(boost::asio::io_context* ctx, std::size_t num_workers, std::size_t depth, work_fn work, done_fn done)
+        :ctx(ctx)
+        ,work(std::move(work))
+        ,done(std::move(done)) {
+        depth = std::max<std::size_t>(depth, 1);
+        jobs.resize(depth);
+        for (auto& j : jobs) {
+            free_jobs.push_back(&j);
+        }
+        finished.reserve(depth);
+        for (std::size_t i = 0; i < std::max<std::size_t>(num_workers, 1); ++i) {
+            workers.push_back(std::make_unique<worker>(depth));
+        }
+    }
+
+    ~mutation_pipeline() {
+        stop();
+    }
+
+    // Separate from the constructor so the pipeline is already owned by a
+    // shared_ptr when the first worker posts a drain
+    void start() {
+        for (auto& w : workers) {
+            w->thread = std::thread([this, w = w.get()] { run(*w); });
+        }
+    }
+
+    void stop() {
+        for (auto& w : workers) {
+            {
+                std::lock_guard<std::mutex> lk(w->mutex);
+                w->stopping = true;
+            }
+            w->wake.notify_one();
+        }
+        for (auto& w : workers) {
+            if (w->thread.joinable()) {
+                w->thread.join();
+            }
+        }
+    }
+
+    // io_context thread
+    job* acquire() {
+        if (free_jobs.empty()) {
+            stats.dropped.store(stats.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        job* j = free_jobs.back();
+        free_jobs.pop_back();
+        return j;
+    }
+
+    // io_context thread. Never fails: there are only depth jobs and every
+    // ring holds at least that many.
+    void submit(job* j) {
+        worker& w = *workers[flow_key(*j->sender).hash() % workers.size()];
+        w.in.try_push(j);
+        stats.dispatched.store(stats.dispatched.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (w.sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lk(w.mutex);
+            w.wake.notify_one();
+        }
+    }
+
+    std::size_t worker_count() const { return workers.size(); }
+    std::size_t in_flight() const { return jobs.size() - free_jobs.size(); }
+    const counters& get_counters() const { return stats; }
+
+private:
+    struct worker {
+        explicit worker(std::size_t depth) : in(depth), out(depth) {}
+
+        spsc_ring<job*> in;   // io_context -> worker
+        spsc_ring<job*> out;  // worker -> io_context
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::atomic<bool> sleeping{false};
+        bool stopping = false;
+    };
+
+    static constexpr int SPIN_LIMIT = 2000;
+
+    void run(worker& w) {
+        int idle = 0;
+        for (;;) {
+            job* j = nullptr;
+            if (w.in.try_pop(j)) {
+                idle = 0;
+                work(*j);
+                w.out.try_push(j);
+                schedule_drain();
+                continue;
+            }
+            if (++idle < SPIN_LIMIT) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Park until submit() sees 'sleeping' and notifies. The check
+            // under the lock closes the gap between the last pop and wait.
+            std::unique_lock<std::mutex> lk(w.mutex);
+            w.sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (w.in.empty() && !w.stopping) {
+                w.wake.wait(lk);
+            }
+            w.sleeping.store(false, std::memory_order_relaxed);
+            if (w.stopping && w.in.empty()) {
+                return;
+            }
+            idle = 0;
+        }
+    }
+
+    // One drain in flight at a time; a worker finishing while it runs
+    // posts another
+    void schedule_drain() {
+        if (drain_pending.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        std::weak_ptr<mutation_pipeline> weak = weak_from_this();
+        boost::asio::post(*ctx, [weak] {
+            if (auto self = weak.lock()) {
+                self->drain();
+            }
+        });
+    }
+
+    void drain() {
+        drain_pending.store(false, std::memory_order_release);
+        finished.clear();
+        for (auto& w : workers) {
+            job* j = nullptr;
+            while (w->out.try_pop(j)) {
+                finished.push_back(j);
+            }
+        }
+        if (finished.empty()) {
+            return;
+        }
+        done(finished.data(), finished.size());
+        for (job* j : finished) {
+            j->via.reset();
+            free_jobs.push_back(j);
+        }
+    }
+
+    boost::asio::io_context* ctx;
+    work_fn work;
+    done_fn done;
+    std::vector<job> jobs;
+    std::vector<job*> free_jobs;   // io_context thread only
+    std::vector<job*> finished;    // io_context thread only
+    std::vector<std::unique_ptr<worker>> workers;
+    std::atomic<bool> drain_pending{false};
+    counters stats;
+};
+
+}
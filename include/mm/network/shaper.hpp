@@ -0,0 +1,218 @@
+#pragma once
+
+#include "delay_line.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace mm::network {
+
+// A zero rate leaves that dimension unlimited.
+struct rate_limit {
+    double bytes_per_second = 0;
+    double burst_bytes = 0;          // defaults to 1/10 s worth of bytes_per_second
+    double packets_per_second = 0;
+    double burst_packets = 0;        // defaults to 1/10 s worth of packets_per_second
+
+    bool limited() const { return bytes_per_second > 0 || packets_per_second > 0; }
+};
+
+struct shaper_settings {
+    enum key_mode { GLOBAL = 0, BY_SENDER = 1, BY_OPCODE = 2, BY_SENDER_AND_OPCODE = BY_SENDER | BY_OPCODE };
+    enum overflow_policy { DROP, QUEUE };
+
+    key_mode key = GLOBAL;
+    overflow_policy policy = DROP;
+    double max_delay_ms = 50;        // QUEUE: packets that would wait longer are dropped
+
+    rate_limit limit;                               // default for every bucket
+    std::unordered_map<int, rate_limit> per_opcode; // overrides by PDU opcode
+
+    // Where the opcode sits in a packet, normally the packet_description's
+    // opcode_field. A negative offset disables opcode lookups.
+    int opcode_offset = -1;
+    int opcode_size = 1;             // bytes, big endian, at most 2
+
+    double tick_ms = 0.1;
+    std::size_t max_buckets = 65536; // idle (full) buckets are swept past this
+
+    bool enabled() const {
+        if (limit.limited()) return true;
+        for (const auto& [opcode, l] : per_opcode) {
+            if (l.limited()) return true;
+        }
+        return false;
+    }
+};
+
+// Token-bucket shaper. Each bucket holds byte and packet tokens that refill
+// continuously up to their burst size; a packet either spends its tokens
+// now, waits in a delay_line until the bucket has refilled enough (QUEUE),
+// or is dropped.
+//
+// There is no locking: one shaper is one shard, owned by the thread that
+// runs its io_context. A sender-keyed bucket only ever lives on the shard
+// its sender is routed to.
+class traffic_shaper {
+public:
+    using clock = delay_line::clock;
+    using send_fn = delay_line::send_fn;
+
+    struct counters {
+        uint64_t passed = 0;   // sent without waiting
+        uint64_t shaped = 0;   // held back until tokens were available
+        uint64_t dropped = 0;
+    };
+
+    traffic_shaper(boost::asio::io_context* ctx, const shaper_settings& cfg, send_fn send)
+        :cfg(cfg)
+        ,held(ctx, to_duration(cfg.tick_ms > 0 ? cfg.tick_ms : 0.1), std::move(send))
+        ,max_delay(to_duration(cfg.max_delay_ms)) {
+    }
+
+    void submit(const unsigned char* data, std::size_t size, const Endpoint& sender, const packet_route& route) {
+        const int opcode = read_opcode(data, size);
+        const rate_limit& limit = limit_for(opcode);
+        if (!limit.limited()) {
+            ++stats.passed;
+            held.send_now(data, size, route);
+            return;
+        }
+
+        const clock::time_point now = clock::now();
+        bucket& b = bucket_for(sender, opcode, limit, now);
+        refill(b, limit, now);
+
+        // Tokens may be negative while packets are queued against the bucket
+        double wait_s = 0;
+        if (limit.bytes_per_second > 0 && b.bytes < double(size)) {
+            wait_s = (double(size) - b.bytes) / limit.bytes_per_second;
+        }
+        if (limit.packets_per_second > 0 && b.packets < 1.0) {
+            wait_s = std::max(wait_s, (1.0 - b.packets) / limit.packets_per_second);
+        }
+
+        const clock::duration wait = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(wait_s));
+        if (wait_s > 0 && (cfg.policy == shaper_settings::DROP || wait > max_delay)) {
+            ++stats.dropped;
+            return;
+        }
+
+        b.bytes -= double(size);
+        b.packets -= 1.0;
+        if (wait_s > 0) {
+            ++stats.shaped;
+            held.submit_at(data, size, route, now + wait);
+        }
+        else {
+            ++stats.passed;
+            held.send_now(data, size, route);
+        }
+    }
+
+    const counters& get_counters() const { return stats; }
+    std::size_t queued() const { return held.size(); }
+    std::size_t bucket_count() const { return buckets.size(); }
+
+private:
+    struct bucket {
+        double bytes;
+        double packets;
+        clock::time_point updated;
+    };
+
+    static clock::duration to_duration(double ms) {
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(ms));
+    }
+
+    static double burst_bytes(const rate_limit& l) {
+        return l.burst_bytes > 0 ? l.burst_bytes : l.bytes_per_second / 10;
+    }
+
+    static double burst_packets(const rate_limit& l) {
+        return l.burst_packets > 0 ? l.burst_packets : std::max(l.packets_per_second / 10, 1.0);
+    }
+
+    int read_opcode(const unsigned char* data, std::size_t size) const {
+        if (cfg.opcode_offset < 0 || std::size_t(cfg.opcode_offset + cfg.opcode_size) > size) {
+            return -1;
+        }
+        int opcode = 0;
+        for (int i = 0; i < cfg.opcode_size; ++i) {
+            opcode = (opcode << 8) | data[cfg.opcode_offset + i];
+        }
+        return opcode;
+    }
+
+    const rate_limit& limit_for(int opcode) const {
+        if (opcode >= 0 && !cfg.per_opcode.empty()) {
+            auto it = cfg.per_opcode.find(opcode);
+            if (it != cfg.per_opcode.end()) {
+                return it->second;
+            }
+        }
+        return cfg.limit;
+    }
+
+    // 48 bits of sender, 16 bits of opcode. IPv4 senders are exact, IPv6
+    // ones are hashed down.
+    uint64_t key_for(const Endpoint& sender, int opcode) const {
+        uint64_t key = 0;
+        if (cfg.key & shaper_settings::BY_SENDER) {
+            const auto addr = sender.address();
+            uint64_t host = addr.is_v4()
+                ? addr.to_v4().to_uint()
+                : std::hash<std::string>{}(std::string(reinterpret_cast<const char*>(addr.to_v6().to_bytes().data()), 16)) & 0xffffffff;
+            key = (host << 16) | sender.port();
+        }
+        if (cfg.key & shaper_settings::BY_OPCODE) {
+            key = (key << 16) | (uint64_t(opcode) & 0xffff);
+        }
+        return key;
+    }
+
+    bucket& bucket_for(const Endpoint& sender, int opcode, const rate_limit& limit, clock::time_point now) {
+        const uint64_t key = key_for(sender, opcode);
+        auto it = buckets.find(key);
+        if (it != buckets.end()) {
+            return it->second;
+        }
+        if (buckets.size() >= cfg.max_buckets) {
+            sweep(now);
+        }
+        return buckets.emplace(key, bucket{burst_bytes(limit), burst_packets(limit), now}).first->second;
+    }
+
+    void refill(bucket& b, const rate_limit& limit, clock::time_point now) {
+        const double elapsed = std::chrono::duration<double>(now - b.updated).count();
+        b.updated = now;
+        if (limit.bytes_per_second > 0) {
+            b.bytes = std::min(b.bytes + elapsed * limit.bytes_per_second, burst_bytes(limit));
+        }
+        if (limit.packets_per_second > 0) {
+            b.packets = std::min(b.packets + elapsed * limit.packets_per_second, burst_packets(limit));
+        }
+    }
+
+    // Buckets idle for over a second with nothing queued against them have
+    // refilled (bursts are 1/10 s by default), so recreating one full later
+    // doesn't change what gets through.
+    void sweep(clock::time_point now) {
+        for (auto it = buckets.begin(); it != buckets.end();) {
+            if (now - it->second.updated > std::chrono::seconds(1) && it->second.bytes >= 0 && it->second.packets >= 0) {
+                it = buckets.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    shaper_settings cfg;
+    delay_line held;
+    clock::duration max_delay;
+    std::unordered_map<uint64_t, bucket> buckets;
+    counters stats;
+};
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace mm::network {
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two. The head and tail
+// indices sit on their own cache lines, and each side caches the other's
+// index so it only reads the shared one when its cached copy says the ring
+// looks full (or empty).
+template<typename T>
+class spsc_ring {
+public:
+    explicit spsc_ring(std::size_t min_capacity) {
+        std::size_t cap = 2;
+        while (cap < min_capacity) cap <<= 1;
+        mask = cap - 1;
+        slots = std::make_unique<T[]>(cap);
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    // producer
+    bool try_push(const T& value) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_cache > mask) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (t - head_cache > mask) {
+                return false;
+            }
+        }
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer
+    bool try_pop(T& value) {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h == tail_cache) {
+                return false;
+            }
+        }
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; only a hint while the other side is running
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    std::unique_ptr<T[]> slots;
+    std::size_t mask;
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> head{0};
+    std::size_t tail_cache = 0;  // consumer's view of tail
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail{0};
+    std::size_t head_cache = 0;  // producer's view of head
+};
+
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace mm::network {
+
+// Hierarchical timing wheel (4 levels x 256 slots) over intrusive nodes.
+//
+// Node must provide
+//     uint64_t wheel_expiry;
+//     Node*    wheel_next;
+//
+// Scheduling is O(1); advance() fires every node whose tick has passed, in
+// FIFO order within a tick, cascading far-future nodes down a level as the
+// lower wheels wrap. Level 0 covers 256 ticks, the top level 2^32 ticks;
+// anything later is clamped. Not thread-safe.
+template<typename Node>
+class timer_wheel {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 8;
+    static constexpr std::size_t SLOTS = std::size_t(1) << SLOT_BITS;
+
+    explicit timer_wheel(clock::duration tick, clock::time_point start = clock::now())
+        :tick(tick.count() > 0 ? tick : clock::duration(1))
+        ,origin(start) {
+    }
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    clock::duration resolution() const { return tick; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Nodes due now or in the past fire on the next advance().
+    void schedule(Node* node, clock::time_point when) {
+        uint64_t expiry = to_tick(when);
+        if (expiry <= current) {
+            expiry = current + 1;
+        }
+        const uint64_t max_delta = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+        if (expiry - current > max_delta) {
+            expiry = current + max_delta;
+        }
+        node->wheel_expiry = expiry;
+        insert(node);
+        ++count;
+    }
+
+    // Fires on_expire(Node*) for everything due by 'now'. The callback owns
+    // the node afterwards and may schedule it (or others) again.
+    template<typename F>
+    void advance(clock::time_point now, F&& on_expire) {
+        const uint64_t target = to_tick(now);
+        while (current < target) {
+            ++current;
+            if (count == 0) {
+                // Nothing pending, skip straight ahead
+                current = target;
+                break;
+            }
+
+            // Highest level whose lower wheels all wrapped on this tick
+            int top = 0;
+            while (top < LEVELS - 1 && (current & ((uint64_t(1) << (SLOT_BITS * (top + 1))) - 1)) == 0) {
+                ++top;
+            }
+            for (int level = top; level > 0; --level) {
+                cascade(level);
+            }
+
+            list& due = slots[0][current & (SLOTS - 1)];
+            Node* node = due.head;
+            due.head = due.tail = nullptr;
+            while (node) {
+                Node* next = node->wheel_next;
+                node->wheel_next = nullptr;
+                --count;
+                on_expire(node);
+                node = next;
+            }
+        }
+    }
+
+private:
+    struct list {
+        Node* head = nullptr;
+        Node* tail = nullptr;
+    };
+
+    uint64_t to_tick(clock::time_point t) const {
+        if (t <= origin) return 0;
+        // round up so nothing fires early
+        return uint64_t((t - origin + tick - clock::duration(1)) / tick);
+    }
+
+    void insert(Node* node) {
+        const uint64_t delta = node->wheel_expiry - current;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+            ++level;
+        }
+        list& slot = slots[level][(node->wheel_expiry >> (SLOT_BITS * level)) & (SLOTS - 1)];
+        node->wheel_next = nullptr;
+        if (slot.tail) {
+            slot.tail->wheel_next = node;
+        }
+        else {
+            slot.head = node;
+        }
+        slot.tail = node;
+    }
+
+    void cascade(int level) {
+        list& slot = slots[level][(current >> (SLOT_BITS * level)) & (SLOTS - 1)];
+        Node* node = slot.head;
+        slot.head = slot.tail = nullptr;
+        while (node) {
+            Node* next = node->wheel_next;
+            insert(node);
+            node = next;
+        }
+    }
+
+    clock::duration tick;
+    clock::time_point origin;
+    uint64_t current = 0;
+    std::size_t count = 0;
+    list slots[LEVELS][SLOTS];
+};
+
+}
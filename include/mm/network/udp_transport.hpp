@@ -8,6 +8,20 @@
 #include <boost/asio.hpp>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#endif
+
 namespace mm::network {
 
 using Endpoint = boost::asio::ip::udp::endpoint;
@@ -25,6 +39,25 @@ using Seconds = std::chrono::duration<double>;
 
 static const Seconds NO_TIMEOUT = std::chrono::seconds(0);
 
+struct OutgoingPacket {
+    const void* data;
+    std::size_t size;
+    Endpoint    dest;
+};
+
+// Zero leaves the OS default
+struct SocketOptions {
+    int receiveBuffer = 0;  // SO_RCVBUF bytes
+    int sendBuffer = 0;     // SO_SNDBUF bytes
+    int busyPollUs = 0;     // SO_BUSY_POLL, Linux only
+    // Linux UDP offloads. gro: the kernel may hand over several datagrams
+    // from one sender in one read; they are split again before the read
+    // callback. gso: send_batch() hands runs of same-size packets to the
+    // same destination to the kernel as one message.
+    bool gro = false;       // UDP_GRO
+    bool gso = false;       // UDP_SEGMENT
+};
+
 class UDPTransport;
 using UDPTransportPtr = std::shared_ptr<UDPTransport>;
 
@@ -45,6 +78,18 @@ public:
                                             const boost::system::error_code& ec,
                                             std::size_t bytes)>;
 
+    // Safe to read from any thread
+    struct Counters {
+        std::atomic<uint64_t> packetsReceived{0};
+        std::atomic<uint64_t> bytesReceived{0};
+        std::atomic<uint64_t> packetsSent{0};
+        std::atomic<uint64_t> sendErrors{0};
+        std::atomic<uint64_t> kernelDrops{0};
+        // Syscalls, to compare against the packet counts
+        std::atomic<uint64_t> recvCalls{0};
+        std::atomic<uint64_t> sendCalls{0};
+    };
+
     enum RetCode
     {
         SUCCESS = 0,
@@ -60,18 +105,53 @@ public:
     ~UDPTransport();
 
     RetCode startListening(const Endpoint& endpoint, bool reuse = false);
+    // Binds to a port picked by the OS on the given local address
+    RetCode startListeningAnyPort(const boost::asio::ip::address& local);
     RetCode stopListening();
 
+    unsigned short localPort() const { return listeningPort; }
+
+    const Counters& counters() const { return stats; }
+
+    // Datagrams the kernel discarded because the receive queue was full.
+    // SO_RXQ_OVFL keeps counters().kernelDrops current as packets arrive,
+    // but each datagram carries the count from when it was queued, so a
+    // burst of drops only shows up once a later datagram gets through.
+    // This also checks the socket's line in /proc/net/udp (read on every
+    // call), which covers that gap and kernels without SO_RXQ_OVFL.
+    uint64_t kernelDrops();
+
     RetCode send_to(const void* data, size_t size, const Endpoint& endpoint);
     RetCode send_to(const std::string& data, const Endpoint& endpoint);
     RetCode send_to(const std::vector<boost::asio::const_buffer>& bufs, const Endpoint& endpoint);
+    // One sendmmsg() per 64 packets where available. On a connected socket
+    // the destinations are ignored.
+    RetCode send_batch(const OutgoingPacket* packets, std::size_t count);
+
+    // Egress-only socket: binds to an OS-picked port on local and connects
+    // to remote, so send() skips the per-packet address handling. Nothing
+    // is read from it; replies still go to whatever socket is listening.
+    RetCode connectTo(const Endpoint& remote, const boost::asio::ip::address& local);
+    bool isConnected() const { return connected; }
+    // Needs connectTo()
+    RetCode send(const void* data, size_t size);
 
     void setReadCallback(ReadCallback cb);
 
+    // Called before (end = false) and after (end = true) the datagrams of
+    // one GRO read go through the read callback. In between, each of them
+    // has a buffer of its own that stays untouched until the end call, so a
+    // receiver can hold on to them and send the burst in one go.
+    using BurstCallback = std::function<void(bool end)>;
+    void setBurstCallback(BurstCallback cb);
+
     bool isListening() const;
 
     void setBroadcast(bool bcast);
 
+    // Needs an open socket, i.e. after startListening()
+    void applyOptions(const SocketOptions& options);
+
     void cancel() { socket->cancel(); }
 
     void setTTL(int hops);
@@ -81,15 +161,36 @@ public:
     void joinGroup(std::string groupIp, std::string localInterface, bool loopback);
 
 private:
+    RetCode bindAndRead(const Endpoint& endpoint, bool reuse);
+    RetCode openFor(const Endpoint& endpoint);
+    RetCode sendFailed(const boost::system::error_code& ec);
+    std::size_t gsoRun(const OutgoingPacket* packets, std::size_t count, std::size_t limit) const;
     void startRead();
+    void readAvailable();
+    void noteKernelDrops(uint64_t total);
 
     boost::asio::io_context* ioCtx = nullptr;
     SocketPtr   socket = nullptr;
     int         listeningPort = 0;
+    bool        connected = false;
     EndpointPtr senderEndpoint = nullptr;
     BufferPtr   readBuffer = nullptr;
     ReadCallback readCb = nullptr;
 
+    Counters stats;
+    bool     rxqOverflow = false;   // SO_RXQ_OVFL enabled
+    uint32_t lastOverflow = 0;      // last raw SO_RXQ_OVFL value, wraps
+    uint64_t rxqTotal = 0;
+    uint64_t socketInode = 0;       // for the /proc/net/udp fallback
+    // kernelDrops() may run on another thread than the receive path
+    std::atomic<uint64_t> warnedDrops{0};
+    std::atomic<int64_t>  lastDropWarningNs{0};
+
+    bool        groEnabled = false;
+    bool        gsoEnabled = false;
+    std::vector<BufferPtr> segmentBuffers;  // GRO segments for readCb: one, or one each with burstCb
+    BurstCallback burstCb = nullptr;
+
 };
 
 ///////////////////// IMPL ///////////////////////
@@ -117,6 +218,22 @@ inline UDPTransport::RetCode UDPTransport::startListening(const Endpoint& endpoi
         return INVALID_PORT;
     }
 
+    return bindAndRead(endpoint, reuse);
+}
+
+inline UDPTransport::RetCode UDPTransport::startListeningAnyPort(const boost::asio::ip::address& local)
+{
+    ASSERT_AND_LOG_FAILURE(readCb != nullptr);
+
+    if (listeningPort != 0) {
+        return ALREADY_STARTED;
+    }
+
+    return bindAndRead(Endpoint(local, 0), false);
+}
+
+inline UDPTransport::RetCode UDPTransport::bindAndRead(const Endpoint& endpoint, bool reuse)
+{
     stopListening();
 
     socket = std::make_shared<Socket>(*ioCtx);
@@ -140,6 +257,20 @@ inline UDPTransport::RetCode UDPTransport::startListening(const Endpoint& endpoi
 
     listeningPort = socket->local_endpoint().port();
 
+#ifdef __linux__
+    int on = 1;
+    rxqOverflow = ::setsockopt(socket->native_handle(), SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == 0;
+    lastOverflow = 0;
+    rxqTotal = 0;
+    stats.kernelDrops.store(0, std::memory_order_relaxed);
+    warnedDrops.store(0, std::memory_order_relaxed);
+    struct stat st;
+    socketInode = ::fstat(socket->native_handle(), &st) == 0 ? st.st_ino : 0;
+    if (!rxqOverflow) {
+        spdlog::debug("SO_RXQ_OVFL unavailable on port {}, reading drops from /proc/net/udp", listeningPort);
+    }
+#endif
+
     startRead();
 
     return SUCCESS;
@@ -154,39 +285,58 @@ inline UDPTransport::RetCode UDPTransport::stopListening()
         socket = nullptr;
     }
     listeningPort = 0;
+    connected = false;
+    groEnabled = false;
+    gsoEnabled = false;
     return SUCCESS;
 }
 
-inline UDPTransport::RetCode UDPTransport::send_to(const void* data, size_t size, const Endpoint& endpoint)
+// Lazily opens a socket for sending when nothing was bound yet
+inline UDPTransport::RetCode UDPTransport::openFor(const Endpoint& endpoint)
 {
-    if (!socket)
+    socket = std::make_shared<Socket>(*ioCtx);
+    readBuffer = std::make_shared<Buffer>(0xffff);
+    senderEndpoint = std::make_shared<Endpoint>();
+
+    boost::system::error_code ec;
+    socket->open(endpoint.protocol(), ec);
+    if (ec)
     {
-        socket = std::make_shared<Socket>(*ioCtx);
-        readBuffer = std::make_shared<Buffer>(0xffff);
-        senderEndpoint = std::make_shared<Endpoint>();
-
-        boost::system::error_code ec;
-        socket->open(endpoint.protocol(), ec);
-        if (ec)
-        {
-            socket = nullptr;
-            return INVALID_ADDRESS;
-        }
+        socket = nullptr;
+        return INVALID_ADDRESS;
     }
+    return SUCCESS;
+}
 
-    static const int MAX_SEND_SIZE = 67108864;
-    if (size > MAX_SEND_SIZE)
-    {
+// Slow path shared by every send: the kernel rejects oversized datagrams
+// with EMSGSIZE, so there is no size check up front
+inline UDPTransport::RetCode UDPTransport::sendFailed(const boost::system::error_code& ec)
+{
+    stats.sendErrors.fetch_add(1, std::memory_order_relaxed);
+    if (ec == boost::asio::error::message_size) {
         return MESSAGE_TOO_LARGE;
     }
+    return SEND_FAILURE;
+}
+
+inline UDPTransport::RetCode UDPTransport::send_to(const void* data, size_t size, const Endpoint& endpoint)
+{
+    if (!socket)
+    {
+        RetCode rc = openFor(endpoint);
+        if (rc != SUCCESS) {
+            return rc;
+        }
+    }
 
-    
     boost::system::error_code ec;
+    stats.sendCalls.fetch_add(1, std::memory_order_relaxed);
     socket->send_to(boost::asio::buffer(data, size), endpoint, 0, ec);
     if (ec) {
-        return SEND_FAILURE;
+        return sendFailed(ec);
     }
 
+    stats.packetsSent.fetch_add(1, std::memory_order_relaxed);
     return SUCCESS;
 }
 
@@ -196,19 +346,200 @@ inline UDPTransport::RetCode UDPTransport::send_to(const std::string& data, cons
 }
 
 inline UDPTransport::RetCode UDPTransport::send_to(const std::vector<boost::asio::const_buffer>& bufs, const Endpoint& endpoint) {
+    if (!socket)
+    {
+        RetCode rc = openFor(endpoint);
+        if (rc != SUCCESS) {
+            return rc;
+        }
+    }
+
     boost::system::error_code ec;
+    stats.sendCalls.fetch_add(1, std::memory_order_relaxed);
     socket->send_to(bufs, endpoint, 0, ec);
     if (ec) {
-        return SEND_FAILURE;
+        return sendFailed(ec);
     }
+    stats.packetsSent.fetch_add(1, std::memory_order_relaxed);
     return SUCCESS;
 }
 
+inline UDPTransport::RetCode UDPTransport::connectTo(const Endpoint& remote, const boost::asio::ip::address& local)
+{
+    stopListening();
+
+    RetCode rc = openFor(remote);
+    if (rc != SUCCESS) {
+        return rc;
+    }
+
+    boost::system::error_code ec;
+    socket->bind(Endpoint(local, 0), ec);
+    if (ec)
+    {
+        socket = nullptr;
+        return BIND_ERROR;
+    }
+    socket->connect(remote, ec);
+    if (ec)
+    {
+        socket = nullptr;
+        return INVALID_ADDRESS;
+    }
+    connected = true;
+    return SUCCESS;
+}
+
+inline UDPTransport::RetCode UDPTransport::send(const void* data, size_t size)
+{
+    boost::system::error_code ec;
+    stats.sendCalls.fetch_add(1, std::memory_order_relaxed);
+    socket->send(boost::asio::buffer(data, size), 0, ec);
+    if (!ec) {
+        stats.packetsSent.fetch_add(1, std::memory_order_relaxed);
+        return SUCCESS;
+    }
+    // A connected socket reports an ICMP port unreachable from an earlier
+    // datagram on the next send, which then isn't sent. Try it once more.
+    if (ec == boost::asio::error::connection_refused) {
+        stats.sendErrors.fetch_add(1, std::memory_order_relaxed);
+        stats.sendCalls.fetch_add(1, std::memory_order_relaxed);
+        socket->send(boost::asio::buffer(data, size), 0, ec);
+        if (!ec) {
+            stats.packetsSent.fetch_add(1, std::memory_order_relaxed);
+            return SUCCESS;
+        }
+    }
+    return sendFailed(ec);
+}
+
+inline UDPTransport::RetCode UDPTransport::send_batch(const OutgoingPacket* packets, std::size_t count)
+{
+    if (count == 0) {
+        return SUCCESS;
+    }
+    if (!socket) {
+        // send_to opens the socket on first use
+        RetCode first = send_to(packets[0].data, packets[0].size, packets[0].dest);
+        if (first != SUCCESS || count == 1) {
+            return first;
+        }
+        return send_batch(packets + 1, count - 1);
+    }
+
+    RetCode rc = SUCCESS;
+#ifdef __linux__
+    static const std::size_t MAX_BATCH = 64;   // messages per sendmmsg()
+    static const std::size_t MAX_IOV = 256;    // packets per sendmmsg()
+    mmsghdr msgs[MAX_BATCH];
+    iovec iov[MAX_IOV];
+    std::size_t packetsIn[MAX_BATCH];
+    alignas(cmsghdr) char control[MAX_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+
+    std::size_t done = 0;
+    while (done < count) {
+        // Each message is one packet, or with GSO a run of equal-size
+        // packets the kernel splits back into datagrams
+        std::size_t n = 0, niov = 0, next = done;
+        while (n < MAX_BATCH && next < count && niov < MAX_IOV) {
+            const std::size_t run = gsoEnabled ? gsoRun(packets + next, count - next, MAX_IOV - niov) : 1;
+            const OutgoingPacket& p = packets[next];
+            for (std::size_t k = 0; k < run; ++k) {
+                iov[niov + k].iov_base = const_cast<void*>(packets[next + k].data);
+                iov[niov + k].iov_len = packets[next + k].size;
+            }
+            msgs[n] = {};
+            if (!connected) {
+                msgs[n].msg_hdr.msg_name = const_cast<void*>(static_cast<const void*>(p.dest.data()));
+                msgs[n].msg_hdr.msg_namelen = p.dest.size();
+            }
+            msgs[n].msg_hdr.msg_iov = &iov[niov];
+            msgs[n].msg_hdr.msg_iovlen = run;
+            if (run > 1) {
+                msgs[n].msg_hdr.msg_control = control[n];
+                msgs[n].msg_hdr.msg_controllen = sizeof(control[n]);
+                cmsghdr* c = CMSG_FIRSTHDR(&msgs[n].msg_hdr);
+                c->cmsg_level = IPPROTO_UDP;
+                c->cmsg_type = UDP_SEGMENT;
+                c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                const uint16_t segment = uint16_t(p.size);
+                std::memcpy(CMSG_DATA(c), &segment, sizeof(segment));
+            }
+            packetsIn[n] = run;
+            niov += run;
+            next += run;
+            ++n;
+        }
+
+        stats.sendCalls.fetch_add(1, std::memory_order_relaxed);
+        int sent = ::sendmmsg(socket->native_handle(), msgs, n, 0);
+        if (sent > 0) {
+            std::size_t packetsDone = 0;
+            for (int i = 0; i < sent; ++i) {
+                packetsDone += packetsIn[i];
+            }
+            stats.packetsSent.fetch_add(packetsDone, std::memory_order_relaxed);
+            done += packetsDone;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && packetsIn[0] > 1 && (errno == EINVAL || errno == EIO || errno == EMSGSIZE)) {
+            // Segment bigger than the path MTU, or a device without
+            // checksum offload. Not worth retrying per packet.
+            spdlog::warn("UDP GSO rejected on port {}: {}, sending packets individually",
+                         socket->local_endpoint().port(), std::strerror(errno));
+            gsoEnabled = false;
+            continue;
+        }
+        // EAGAIN (asio leaves the fd non-blocking) or an error on the
+        // first packet: let asio send that one, then carry on batching
+        const OutgoingPacket& p = packets[done];
+        if ((connected ? send(p.data, p.size) : send_to(p.data, p.size, p.dest)) != SUCCESS) {
+            rc = SEND_FAILURE;
+        }
+        ++done;
+    }
+#else
+    for (std::size_t i = 0; i < count; ++i) {
+        const OutgoingPacket& p = packets[i];
+        if ((connected ? send(p.data, p.size) : send_to(p.data, p.size, p.dest)) != SUCCESS) {
+            rc = SEND_FAILURE;
+        }
+    }
+#endif
+    return rc;
+}
+
+// How many packets from the front can go out as one GSO message: same
+// size, same destination, within the kernel's segment and length limits
+inline std::size_t UDPTransport::gsoRun(const OutgoingPacket* packets, std::size_t count, std::size_t limit) const
+{
+    static const std::size_t MAX_SEGMENTS = 64;      // UDP_MAX_SEGMENTS on older kernels
+    static const std::size_t MAX_GSO_BYTES = 65000;  // below the IPv4/IPv6 datagram limits
+    const OutgoingPacket& first = packets[0];
+    if (first.size == 0 || first.size > MAX_GSO_BYTES / 2) {
+        return 1;
+    }
+    limit = std::min({count, limit, MAX_SEGMENTS, MAX_GSO_BYTES / first.size});
+    std::size_t run = 1;
+    while (run < limit && packets[run].size == first.size && (connected || packets[run].dest == first.dest)) {
+        ++run;
+    }
+    return run;
+}
+
 inline void UDPTransport::setReadCallback(ReadCallback cb)
 {
     readCb = cb;
 }
 
+inline void UDPTransport::setBurstCallback(BurstCallback cb)
+{
+    burstCb = cb;
+}
+
 inline bool UDPTransport::isListening() const
 {
     return listeningPort != 0;
@@ -220,6 +551,22 @@ inline void UDPTransport::startRead()
     ASSERT_AND_LOG_FAILURE(readCb != nullptr);
 
     auto self = shared_from_this();
+#ifdef __linux__
+    // Wait for readability and recvmsg() ourselves so the SO_RXQ_OVFL
+    // control message isn't lost
+    socket->async_wait(Socket::wait_read,
+            [self](const boost::system::error_code& ec){
+                if (ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (!ec) {
+                    self->readAvailable();
+                }
+                if (self->socket && self->socket->is_open()) {
+                    self->startRead();
+                }
+            });
+#else
     socket->async_receive_from(
             boost::asio::buffer(*readBuffer),
             *senderEndpoint,
@@ -228,10 +575,146 @@ inline void UDPTransport::startRead()
                     return;
                 }
                 if (!ec) {
+                    self->stats.recvCalls.fetch_add(1, std::memory_order_relaxed);
+                    self->stats.packetsReceived.fetch_add(1, std::memory_order_relaxed);
+                    self->stats.bytesReceived.fetch_add(bytes_transferred, std::memory_order_relaxed);
                     self->readCb(self, self->readBuffer, self->senderEndpoint, ec, bytes_transferred);
                 }
-                self->startRead();
+                if (self->socket && self->socket->is_open()) {
+                    self->startRead();
+                }
             });
+#endif
+}
+
+inline void UDPTransport::readAvailable()
+{
+#ifdef __linux__
+    // Bounded so one busy socket can't starve the rest of the io_context
+    static const int MAX_READS_PER_WAKEUP = 64;
+    auto self = shared_from_this();
+    const boost::system::error_code no_error;
+
+    for (int i = 0; i < MAX_READS_PER_WAKEUP && socket; ++i) {
+        sockaddr_storage from;
+        iovec iov{readBuffer->data(), readBuffer->size()};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int))];
+        msghdr msg{};
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        stats.recvCalls.fetch_add(1, std::memory_order_relaxed);
+        ssize_t bytes = ::recvmsg(socket->native_handle(), &msg, MSG_DONTWAIT);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // EAGAIN: drained
+        }
+
+        int segment = 0;
+        for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == IPPROTO_UDP && c->cmsg_type == UDP_GRO) {
+                std::memcpy(&segment, CMSG_DATA(c), sizeof(segment));
+            }
+            else if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t overflow;
+                std::memcpy(&overflow, CMSG_DATA(c), sizeof(overflow));
+                if (overflow != lastOverflow) {
+                    // The raw value is the socket's lifetime total (mod 2^32)
+                    const uint64_t total = rxqTotal + uint32_t(overflow - lastOverflow);
+                    rxqTotal = total;
+                    lastOverflow = overflow;
+                    uint64_t known = stats.kernelDrops.load(std::memory_order_relaxed);
+                    while (total > known && !stats.kernelDrops.compare_exchange_weak(known, total, std::memory_order_relaxed)) {}
+                    noteKernelDrops(total);
+                }
+            }
+        }
+
+        std::memcpy(senderEndpoint->data(), &from, msg.msg_namelen);
+        senderEndpoint->resize(msg.msg_namelen);
+        stats.bytesReceived.fetch_add(bytes, std::memory_order_relaxed);
+        if (segment > 0 && bytes > segment) {
+            // Coalesced by GRO. Each datagram is copied to a buffer that
+            // starts at offset 0, since readCb may mutate it in place.
+            const std::size_t segments = std::size_t((bytes + segment - 1) / segment);
+            const std::size_t buffers = burstCb ? segments : 1;
+            while (segmentBuffers.size() < buffers) {
+                segmentBuffers.push_back(std::make_shared<Buffer>(0xffff));
+            }
+            if (burstCb) {
+                burstCb(false);
+            }
+            for (std::size_t k = 0; k < segments && socket; ++k) {
+                const ssize_t offset = ssize_t(k) * segment;
+                const std::size_t len = std::size_t(std::min<ssize_t>(segment, bytes - offset));
+                const BufferPtr& buffer = segmentBuffers[burstCb ? k : 0];
+                std::memcpy(buffer->data(), readBuffer->data() + offset, len);
+                stats.packetsReceived.fetch_add(1, std::memory_order_relaxed);
+                readCb(self, buffer, senderEndpoint, no_error, len);
+            }
+            if (burstCb) {
+                burstCb(true);
+            }
+            continue;
+        }
+        stats.packetsReceived.fetch_add(1, std::memory_order_relaxed);
+        readCb(self, readBuffer, senderEndpoint, no_error, std::size_t(bytes));
+    }
+#endif
+}
+
+inline uint64_t UDPTransport::kernelDrops()
+{
+    if (socketInode == 0) {
+        return stats.kernelDrops.load(std::memory_order_relaxed);
+    }
+
+    // sl local rem st tx:rx tr:when retrnsmt uid timeout inode ref pointer drops
+    for (const char* path : {"/proc/net/udp", "/proc/net/udp6"}) {
+        std::ifstream proc(path);
+        std::string line;
+        std::getline(proc, line); // header
+        while (std::getline(proc, line)) {
+            std::istringstream fields(line);
+            std::string skip;
+            uint64_t inode = 0, drops = 0;
+            for (int i = 0; i < 9; ++i) fields >> skip;
+            fields >> inode >> skip >> skip >> drops;
+            if (fields && inode == socketInode) {
+                // Only ever raise it; the receive path may be ahead of /proc
+                uint64_t known = stats.kernelDrops.load(std::memory_order_relaxed);
+                while (drops > known && !stats.kernelDrops.compare_exchange_weak(known, drops, std::memory_order_relaxed)) {}
+                noteKernelDrops(std::max(known, drops));
+                return std::max(known, drops);
+            }
+        }
+    }
+    return stats.kernelDrops.load(std::memory_order_relaxed);
+}
+
+// At most one warning per second, covering everything dropped since the last
+inline void UDPTransport::noteKernelDrops(uint64_t total)
+{
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t last = lastDropWarningNs.load(std::memory_order_relaxed);
+    if (total <= warnedDrops.load(std::memory_order_relaxed) || now - last < 1000000000) {
+        return;
+    }
+    if (!lastDropWarningNs.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        return; // the other thread is warning
+    }
+    const uint64_t previous = warnedDrops.exchange(total, std::memory_order_relaxed);
+    if (total > previous) {
+        spdlog::warn("Kernel dropped {} datagrams on port {} ({} total): receive buffer full, the proxy is falling behind",
+                     total - previous, listeningPort, total);
+    }
 }
 
 inline void UDPTransport::setBroadcast(bool bcast)
@@ -239,6 +722,58 @@ inline void UDPTransport::setBroadcast(bool bcast)
     socket->set_option(boost::asio::socket_base::broadcast(bcast));
 }
 
+inline void UDPTransport::applyOptions(const SocketOptions& options)
+{
+    if (!socket) {
+        return;
+    }
+    boost::system::error_code ec;
+    if (options.receiveBuffer > 0) {
+        socket->set_option(boost::asio::socket_base::receive_buffer_size(options.receiveBuffer), ec);
+        if (ec) {
+            spdlog::warn("Failed to set SO_RCVBUF to {}: {}", options.receiveBuffer, ec.message());
+        }
+    }
+    if (options.sendBuffer > 0) {
+        socket->set_option(boost::asio::socket_base::send_buffer_size(options.sendBuffer), ec);
+        if (ec) {
+            spdlog::warn("Failed to set SO_SNDBUF to {}: {}", options.sendBuffer, ec.message());
+        }
+    }
+    if (options.busyPollUs > 0) {
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+        int usec = options.busyPollUs;
+        if (::setsockopt(socket->native_handle(), SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) != 0) {
+            spdlog::warn("Failed to set SO_BUSY_POLL to {}us: {}", usec, std::strerror(errno));
+        }
+#else
+        spdlog::warn("SO_BUSY_POLL is not supported on this platform");
+#endif
+    }
+#if defined(__linux__) && defined(UDP_GRO) && defined(UDP_SEGMENT)
+    if (options.gro) {
+        int on = 1;
+        groEnabled = ::setsockopt(socket->native_handle(), IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+        if (!groEnabled) {
+            spdlog::warn("Failed to enable UDP_GRO: {}", std::strerror(errno));
+        }
+    }
+    if (options.gso) {
+        // A zero socket-wide segment size changes nothing, it only tells
+        // whether the kernel knows UDP_SEGMENT
+        int none = 0;
+        gsoEnabled = ::setsockopt(socket->native_handle(), IPPROTO_UDP, UDP_SEGMENT, &none, sizeof(none)) == 0;
+        if (!gsoEnabled) {
+            spdlog::warn("Failed to enable UDP_SEGMENT: {}", std::strerror(errno));
+        }
+    }
+#else
+    if (options.gro || options.gso) {
+        spdlog::warn("UDP GRO/GSO are not supported on this platform");
+    }
+#endif
+}
+
 inline void UDPTransport::setTTL(int hops) {
     socket->set_option(boost::asio::ip::multicast::hops(hops));
 }
@@ -0,0 +1,113 @@
+// mmbench_latency: ping-pongs datagrams over loopback through a
+// middleman_proxy running on its own network thread, once per set of
+// low_latency settings, and prints p50/p99/p999 of the proxy's own
+// receive-to-send time and of the client's round trip.
+// Spinning wants a core of its own: with the client on the same core the
+// spin loop competes with it and the round trip gets worse, not better.
+// Usage: mmbench_latency [packets] [size] [proxy cpu] [client cpu]
+
+#include <mm/network/middleman_proxy.hpp>
+#include <mm/network/low_latency.hpp>
+
+#include <cstdlib>
+#include <thread>
+
+using namespace mm::network;
+
+struct result {
+    latency_histogram round_trip;
+    uint64_t proxy_p50 = 0, proxy_p99 = 0, proxy_p999 = 0;
+    uint64_t lost = 0;
+};
+
+static void run(result& r, const low_latency_settings& tuning, unsigned short port,
+                std::size_t packets, std::size_t size, int client_cpu) {
+    boost::asio::io_context client_ctx;
+    const auto loopback = boost::asio::ip::make_address("127.0.0.1");
+    boost::asio::ip::udp::socket client(client_ctx, Endpoint(loopback, 0));
+    boost::asio::ip::udp::socket sink(client_ctx, Endpoint(loopback, 0));
+    const timeval timeout{0, 100000};
+    setsockopt(sink.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    boost::asio::io_context ctx(1);
+    middleman_proxy proxy(&ctx, {
+        .local_host = "127.0.0.1",
+        .local_port = port,
+        .remote_host = "127.0.0.1",
+        .remote_port = sink.local_endpoint().port(),
+        .multicast_enabled = false,
+        .multicast_group = "",
+        .multicast_ttl = 1,
+        .mutator = nullptr,
+        .socket_options = tuning.socket,
+        .measure_latency = true
+    });
+    std::thread network([&ctx, &tuning]() {
+        run_network_thread(ctx, tuning, 0);
+    });
+    if (client_cpu >= 0) {
+        pin_current_thread(client_cpu);
+    }
+
+    Buffer payload(size, 0x5a), reply(0xffff);
+    const Endpoint proxy_ep(loopback, port);
+    const std::size_t warmup = std::min<std::size_t>(1000, packets);
+    for (std::size_t i = 0; i < warmup + packets; ++i) {
+        const auto sent_at = std::chrono::steady_clock::now();
+        client.send_to(boost::asio::buffer(payload.data(), payload.size()), proxy_ep);
+        boost::system::error_code ec;
+        sink.receive(boost::asio::buffer(reply), 0, ec);
+        if (ec) {
+            ++r.lost;
+            continue;
+        }
+        if (i >= warmup) {
+            r.round_trip.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - sent_at).count());
+        }
+    }
+
+    ctx.stop();
+    network.join();
+    // The warmup packets are in the proxy's histogram too; they are few
+    // enough not to move its tail
+    const auto& latency = proxy.getLatency();
+    r.proxy_p50  = latency.percentile(0.5);
+    r.proxy_p99  = latency.percentile(0.99);
+    r.proxy_p999 = latency.percentile(0.999);
+}
+
+int main(int argc, char** argv) {
+    spdlog::set_level(spdlog::level::warn);
+    const std::size_t packets = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50000;
+    const std::size_t size    = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 144;   // an entity state PDU
+    const unsigned cpus       = std::max(1u, std::thread::hardware_concurrency());
+    const int proxy_cpu       = argc > 3 ? std::atoi(argv[3]) : int(cpus - 1);
+    const int client_cpu      = argc > 4 ? std::atoi(argv[4]) : (cpus > 1 ? 0 : -1);
+
+    low_latency_settings spin;
+    spin.spin = true;
+    low_latency_settings pinned = spin;
+    pinned.cpus = {proxy_cpu};
+    pinned.socket.busyPollUs = 50;
+
+    std::printf("%zu round trips of %zu bytes, %u cpus, proxy on cpu %d, client on cpu %d\n",
+                packets, size, cpus, proxy_cpu, client_cpu);
+    std::printf("%-10s %9s %9s %9s   %9s %9s %9s %6s\n",
+                "mode", "proxy p50", "p99", "p999", "rtt p50", "p99", "p999", "lost");
+    struct mode { const char* name; const low_latency_settings* tuning; };
+    unsigned short port = 47000;
+    const low_latency_settings defaults;
+    for (const mode& m : {mode{"default", &defaults}, mode{"spin", &spin}, mode{"spin+pin", &pinned}}) {
+        result r;
+        run(r, *m.tuning, port++, packets, size, client_cpu);
+        std::printf("%-10s %7.1fus %7.1fus %7.1fus   %7.1fus %7.1fus %7.1fus %6lu\n",
+                    m.name,
+                    r.proxy_p50 / 1e3, r.proxy_p99 / 1e3, r.proxy_p999 / 1e3,
+                    r.round_trip.percentile(0.5) / 1e3,
+                    r.round_trip.percentile(0.99) / 1e3,
+                    r.round_trip.percentile(0.999) / 1e3,
+                    (unsigned long)r.lost);
+    }
+    return 0;
+}
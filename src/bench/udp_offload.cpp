@@ -0,0 +1,89 @@
+// mmbench_udp: pushes bursts of equal-size datagrams over loopback through
+// UDPTransport::send_batch() and counts the syscalls on both ends, with and
+// without UDP_SEGMENT (send) and UDP_GRO (receive).
+// Usage: mmbench_udp [packets] [size] [burst]
+
+#include <mm/network/udp_transport.hpp>
+
+#include <cstdlib>
+
+using namespace mm::network;
+
+struct result {
+    uint64_t sent = 0, send_calls = 0;
+    uint64_t received = 0, recv_calls = 0;
+    double seconds = 0;
+};
+
+static result run(std::size_t packets, std::size_t size, std::size_t burst, bool gso, bool gro) {
+    boost::asio::io_context ctx;
+    const auto loopback = boost::asio::ip::make_address("127.0.0.1");
+
+    result r;
+    auto rx = std::make_shared<UDPTransport>(&ctx);
+    rx->setReadCallback([&](UDPTransportPtr, BufferPtr, EndpointPtr, const boost::system::error_code&, std::size_t) {
+        ++r.received;
+    });
+    if (rx->startListeningAnyPort(loopback) != UDPTransport::SUCCESS) {
+        spdlog::error("Failed to bind the receiver");
+        std::exit(1);
+    }
+    SocketOptions rx_options;
+    rx_options.receiveBuffer = 8 << 20;
+    rx_options.gro = gro;
+    rx->applyOptions(rx_options);
+
+    auto tx = std::make_shared<UDPTransport>(&ctx);
+    const Endpoint dest(loopback, rx->localPort());
+    tx->connectTo(dest, loopback);
+    SocketOptions tx_options;
+    tx_options.gso = gso;
+    tx->applyOptions(tx_options);
+
+    Buffer payload(size, 0x5a);
+    std::vector<OutgoingPacket> batch(burst, OutgoingPacket{payload.data(), payload.size(), dest});
+
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t queued = 0;
+    while (queued < packets) {
+        const std::size_t n = std::min(burst, packets - queued);
+        tx->send_batch(batch.data(), n);
+        queued += n;
+        // Keep the receive queue short enough that nothing is dropped
+        ctx.restart();
+        ctx.poll();
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (r.received < tx->counters().packetsSent.load() && std::chrono::steady_clock::now() < deadline) {
+        ctx.restart();
+        ctx.poll();
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    r.sent = tx->counters().packetsSent.load();
+    r.send_calls = tx->counters().sendCalls.load();
+    r.recv_calls = rx->counters().recvCalls.load();
+    rx->stopListening();
+    tx->stopListening();
+    return r;
+}
+
+int main(int argc, char** argv) {
+    spdlog::set_level(spdlog::level::warn);
+    const std::size_t packets = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    const std::size_t size    = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 144;   // an entity state PDU
+    const std::size_t burst   = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 64;
+
+    std::printf("%zu packets of %zu bytes in bursts of %zu\n", packets, size, burst);
+    std::printf("%-14s %10s %10s %10s %10s %12s\n", "mode", "sent", "sends", "received", "reads", "packets/s");
+    struct mode { const char* name; bool gso, gro; };
+    for (const mode& m : {mode{"sendmmsg", false, false}, mode{"gso", true, false}, mode{"gso+gro", true, true}}) {
+        const result r = run(packets, size, burst, m.gso, m.gro);
+        std::printf("%-14s %10lu %10lu %10lu %10lu %12.0f\n",
+                    m.name,
+                    (unsigned long)r.sent, (unsigned long)r.send_calls,
+                    (unsigned long)r.received, (unsigned long)r.recv_calls,
+                    double(r.received) / r.seconds);
+    }
+    return 0;
+}
@@ -1,42 +1,355 @@
 #include <mm/network/udp_transport.hpp>
 #include <mm/network/middleman_proxy.hpp>
+#include <mm/network/low_latency.hpp>
 #include <mm/mutators/packet_mutator.hpp>
 #include <mm/mutators/test_mutator.hpp>
 #include <mm/mutators/json_rule_based_mutator.hpp>
 #include <mm/config_reader.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <optional>
+#include <thread>
+
+// Optional "impairment" block, e.g.
+//   "impairment": { "delay_ms": 50, "jitter_ms": 5, "jitter": "normal",
+//                   "loss": "gilbert_elliott", "ge_p": 0.01, "ge_r": 0.3,
+//                   "duplicate_probability": 0.001, "reorder_probability": 0.01 }
+static mm::network::impairment_settings read_impairment(const json& j) {
+    mm::network::impairment_settings s;
+    if (!j.is_object()) {
+        return s;
+    }
+    s.delay_ms              = j.value("delay_ms", s.delay_ms);
+    s.jitter_ms             = j.value("jitter_ms", s.jitter_ms);
+    s.jitter                = j.value("jitter", std::string("uniform")) == "normal"
+                                ? mm::network::impairment_settings::NORMAL
+                                : mm::network::impairment_settings::UNIFORM;
+
+    std::string loss = j.value("loss", std::string(j.contains("loss_probability") ? "bernoulli" : "none"));
+    if (loss == "bernoulli") {
+        s.loss = mm::network::impairment_settings::BERNOULLI;
+    }
+    else if (loss == "gilbert_elliott") {
+        s.loss = mm::network::impairment_settings::GILBERT_ELLIOTT;
+    }
+    else if (loss != "none") {
+        spdlog::error("Unknown impairment loss model '{}', loss disabled", loss);
+    }
+    s.loss_probability      = j.value("loss_probability", s.loss_probability);
+    s.ge_p                  = j.value("ge_p", s.ge_p);
+    s.ge_r                  = j.value("ge_r", s.ge_r);
+    s.ge_loss_good          = j.value("ge_loss_good", s.ge_loss_good);
+    s.ge_loss_bad           = j.value("ge_loss_bad", s.ge_loss_bad);
+
+    s.duplicate_probability = j.value("duplicate_probability", s.duplicate_probability);
+    s.reorder_probability   = j.value("reorder_probability", s.reorder_probability);
+    s.reorder_delay_ms      = j.value("reorder_delay_ms", s.reorder_delay_ms);
+    s.tick_ms               = j.value("tick_ms", s.tick_ms);
+    s.max_queued            = j.value("max_queued", s.max_queued);
+    s.seed                  = j.value("seed", s.seed);
+    return s;
+}
+
+static mm::network::rate_limit read_rate_limit(const json& j) {
+    mm::network::rate_limit l;
+    l.bytes_per_second   = j.value("bytes_per_second", l.bytes_per_second);
+    l.burst_bytes        = j.value("burst_bytes", l.burst_bytes);
+    l.packets_per_second = j.value("packets_per_second", l.packets_per_second);
+    l.burst_packets      = j.value("burst_packets", l.burst_packets);
+    return l;
+}
+
+// Optional "shaping" block, e.g.
+//   "shaping": { "key": "sender_and_opcode", "policy": "queue", "max_delay_ms": 20,
+//                "bytes_per_second": 125000,
+//                "per_opcode": { "1": { "packets_per_second": 50 } } }
+// Opcodes are read from the types file's opcode_field.
+static mm::network::shaper_settings read_shaping(const json& j, const packet_types& types) {
+    using mm::network::shaper_settings;
+    shaper_settings s;
+    if (!j.is_object()) {
+        return s;
+    }
+
+    const std::string key = j.value("key", std::string("global"));
+    if (key == "sender")                 s.key = shaper_settings::BY_SENDER;
+    else if (key == "opcode")            s.key = shaper_settings::BY_OPCODE;
+    else if (key == "sender_and_opcode") s.key = shaper_settings::BY_SENDER_AND_OPCODE;
+    else if (key != "global") {
+        spdlog::error("Unknown shaping key '{}', using a single global bucket", key);
+    }
+    s.policy       = j.value("policy", std::string("drop")) == "queue" ? shaper_settings::QUEUE : shaper_settings::DROP;
+    s.max_delay_ms = j.value("max_delay_ms", s.max_delay_ms);
+    s.tick_ms      = j.value("tick_ms", s.tick_ms);
+    s.max_buckets  = j.value("max_buckets", s.max_buckets);
+    s.limit        = read_rate_limit(j);
+    if (j.contains("per_opcode")) {
+        for (const auto& [opcode, limit] : j["per_opcode"].items()) {
+            s.per_opcode[std::stoi(opcode)] = read_rate_limit(limit);
+        }
+    }
+
+    for (const auto& packet : types) {
+        for (const auto& field : packet.fields) {
+            if (field.name != packet.opcode_field) {
+                continue;
+            }
+            if (s.opcode_offset < 0) {
+                s.opcode_offset = field.offset;
+                s.opcode_size = std::min(field.size, 2);
+            }
+            else if (s.opcode_offset != field.offset) {
+                spdlog::warn("{} keeps its opcode at offset {}, shaping reads offset {}",
+                             packet.name, field.offset, s.opcode_offset);
+            }
+        }
+    }
+    if (s.opcode_offset < 0 && (s.key & shaper_settings::BY_OPCODE || !s.per_opcode.empty())) {
+        spdlog::error("No opcode_field found in the types file, opcode shaping disabled");
+    }
+    return s;
+}
+
+// Optional "low_latency" block, e.g.
+//   "low_latency": { "cpus": [2, 3], "spin": true, "sched_fifo_priority": 50,
+//                    "rcvbuf": 8388608, "sndbuf": 8388608, "busy_poll_us": 50,
+//                    "measure_latency": true }
+static mm::network::low_latency_settings read_low_latency(const json& j) {
+    mm::network::low_latency_settings s;
+    if (!j.is_object()) {
+        return s;
+    }
+    s.cpus                  = j.value("cpus", s.cpus);
+    s.spin                  = j.value("spin", s.spin);
+    s.fifo_priority         = j.value("sched_fifo_priority", s.fifo_priority);
+    s.socket.receiveBuffer  = j.value("rcvbuf", s.socket.receiveBuffer);
+    s.socket.sendBuffer     = j.value("sndbuf", s.socket.sendBuffer);
+    s.socket.busyPollUs     = j.value("busy_poll_us", s.socket.busyPollUs);
+    s.measure_latency       = j.value("measure_latency", s.measure_latency);
+    return s;
+}
+
+// Parsed schemas and rule sets, shared read-only by every proxy (and every
+// io_context thread) that names the same files
+class rules_store {
+public:
+    rules_store(bool to_big_endian, std::optional<uint64_t> fuzz_seed)
+        :to_big_endian(to_big_endian)
+        ,fuzz_seed(fuzz_seed) {}
+
+    std::shared_ptr<mm::mutators::packet_mutator> mutator(const std::string& types_file, const std::string& rules_file) {
+        auto& m = mutators[{types_file, rules_file}];
+        if (!m) {
+            spdlog::info("Loading rules {} against {}", rules_file, types_file);
+            auto rules = std::make_shared<mm::mutators::json_rule_based_mutator>(types_file, rules_file, to_big_endian);
+            if (fuzz_seed) {
+                rules->set_fuzz_seed(*fuzz_seed);
+            }
+            m = rules;
+        }
+        return m;
+    }
+
+    const packet_types& types(const std::string& types_file) {
+        auto it = schemas.find(types_file);
+        if (it == schemas.end()) {
+            it = schemas.emplace(types_file, packet_description_from_json(read_configuration(types_file))).first;
+        }
+        return it->second;
+    }
+
+private:
+    bool to_big_endian;
+    std::optional<uint64_t> fuzz_seed;
+    std::map<std::pair<std::string, std::string>, std::shared_ptr<mm::mutators::packet_mutator>> mutators;
+    std::map<std::string, packet_types> schemas;
+};
+
+// One entry of "proxies", or the whole config file when it has none
+static mm::network::middleman_proxy::settings read_proxy(const json& config, rules_store& store,
+                                                         const mm::network::low_latency_settings& tuning) {
+    const std::string types_file = config.value("types", std::string("dis_types.json"));
+    const std::string rules_file = config.value("rules", std::string("test_rules2.json"));
+
+    mm::network::middleman_proxy::settings settings = {
+        .local_host  = config["local_host"].get<std::string>(),
+        .local_port  = config["local_port"].get<unsigned short>(),
+        .remote_host = config["remote_host"].get<std::string>(),
+        .remote_port = config["remote_port"].get<unsigned short>(),
+        .multicast_enabled = config.value("multicast_enabled", false),
+        .multicast_group = config.value("multicast_group", std::string()),
+        .multicast_ttl = config.value("multicast_ttl", 1),
+        .mutator = store.mutator(types_file, rules_file),
+        .log_to_stdout = config.value("log_to_stdout", true),
+        .impairment = read_impairment(config.value("impairment", json::object())),
+        .shaping = config.contains("shaping")
+            ? read_shaping(config["shaping"], store.types(types_file))
+            : mm::network::shaper_settings{},
+        .bidirectional = config.value("bidirectional", false),
+        .flow_idle_timeout_s = config.value("flow_idle_timeout_s", 60.0),
+        .max_flows = config.value("max_flows", std::size_t(65536)),
+        .pipeline_workers = config.value("pipeline_workers", std::size_t(0)),
+        .pipeline_depth = config.value("pipeline_depth", std::size_t(256)),
+        .connected_egress = config.value("connected_egress", true),
+        .socket_options = tuning.socket,
+        .measure_latency = tuning.measure_latency
+    };
+    // Linux UDP offloads for bulk traffic, per proxy:
+    //   "udp_gro": true, "udp_gso": true
+    settings.socket_options.gro = config.value("udp_gro", false);
+    settings.socket_options.gso = config.value("udp_gso", false);
+
+    // Optional extra destinations, each with its own rules file if given:
+    //   "sinks": [ { "host": "10.0.0.5", "port": 3000, "rules": "recorder_rules.json" } ]
+    for (const auto& sink : config.value("sinks", json::array())) {
+        settings.extra_sinks.push_back({
+            .host = sink["host"].get<std::string>(),
+            .port = sink["port"].get<unsigned short>(),
+            .mutator = sink.contains("rules")
+                ? store.mutator(types_file, sink["rules"].get<std::string>())
+                : nullptr
+        });
+    }
+    return settings;
+}
+
+static void log_statistics(const std::string& name, mm::network::middleman_proxy& proxy) {
+    const auto& s = proxy.getStatistics();
+    spdlog::info("[{}] received {} ({} B), mutated {}, forwarded {} ({} B), send errors {}",
+                 name,
+                 s.received.load(std::memory_order_relaxed),
+                 s.received_bytes.load(std::memory_order_relaxed),
+                 s.mutated.load(std::memory_order_relaxed),
+                 s.forwarded.load(std::memory_order_relaxed),
+                 s.forwarded_bytes.load(std::memory_order_relaxed),
+                 s.send_errors.load(std::memory_order_relaxed));
+    if (s.dropped.load(std::memory_order_relaxed) || s.duplicated.load(std::memory_order_relaxed) ||
+        s.redirected.load(std::memory_order_relaxed) || s.held.load(std::memory_order_relaxed)) {
+        spdlog::info("[{}] rule actions: dropped {}, extra copies {}, redirected {}, delayed {}",
+                     name,
+                     s.dropped.load(std::memory_order_relaxed),
+                     s.duplicated.load(std::memory_order_relaxed),
+                     s.redirected.load(std::memory_order_relaxed),
+                     s.held.load(std::memory_order_relaxed));
+    }
+    auto& transport = proxy.getTransport();
+    spdlog::info("[{}] socket: received {} in {} reads, sent {} in {} sends, send errors {}, kernel drops {}",
+                 name,
+                 transport.counters().packetsReceived.load(std::memory_order_relaxed),
+                 transport.counters().recvCalls.load(std::memory_order_relaxed),
+                 transport.counters().packetsSent.load(std::memory_order_relaxed),
+                 transport.counters().sendCalls.load(std::memory_order_relaxed),
+                 transport.counters().sendErrors.load(std::memory_order_relaxed),
+                 transport.kernelDrops());
+    for (auto* egress : proxy.getEgressTransports()) {
+        spdlog::info("[{}] egress socket: sent {} in {} sends, send errors {}",
+                     name,
+                     egress->counters().packetsSent.load(std::memory_order_relaxed),
+                     egress->counters().sendCalls.load(std::memory_order_relaxed),
+                     egress->counters().sendErrors.load(std::memory_order_relaxed));
+    }
+    const auto& latency = proxy.getLatency();
+    if (latency.count() > 0) {
+        spdlog::info("[{}] forwarding latency p50 {:.1f}us, p99 {:.1f}us, p999 {:.1f}us over {} packets",
+                     name,
+                     latency.percentile(0.5) / 1e3,
+                     latency.percentile(0.99) / 1e3,
+                     latency.percentile(0.999) / 1e3,
+                     latency.count());
+    }
+    if (const auto* pipeline = proxy.getPipeline()) {
+        spdlog::info("[{}] pipeline: dispatched {}, dropped {} (all jobs in flight)",
+                     name,
+                     pipeline->get_counters().dispatched.load(std::memory_order_relaxed),
+                     pipeline->get_counters().dropped.load(std::memory_order_relaxed));
+    }
+}
+
+// mm_config.json either describes a single proxy at the top level, or holds
+//   "threads": 4, "stats_interval_s": 10,
+//   "proxies": [ { "name": "dis", "local_host": ..., "local_port": ..., "remote_host": ..., "remote_port": ...,
+//                  "rules": "dis_rules.json", ... }, ... ]
+// Every proxy lives on one io_context; io_contexts each get a thread and
+// proxies are spread over them round-robin.
 int main() {
     std::string config_file = "mm_config.json";
     spdlog::info("Reading configuration file: " + config_file + "...");
     json config = read_configuration(config_file);
     spdlog::info("Config: " + config.dump(2));
 
-    spdlog::info("Opening Socket");
-    boost::asio::io_context ctx;
+    json proxy_configs = config.contains("proxies") ? config["proxies"] : json::array({config});
+    if (proxy_configs.empty()) {
+        spdlog::error("No proxies configured in {}", config_file);
+        return 1;
+    }
 
-    std::string    local_host = config["local_host"].get<std::string>();
-    unsigned short local_port = config["local_port"].get<unsigned short>();
+    const unsigned hw_threads = std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t num_threads = std::clamp<std::size_t>(config.value("threads", std::size_t(hw_threads)), 1, proxy_configs.size());
 
-    std::string    remote_host = config["remote_host"].get<std::string>();
-    unsigned short remote_port = config["remote_port"].get<unsigned short>();
-
-    
-    std::thread thrd = std::thread([&ctx](){
-            boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard(boost::asio::make_work_guard(ctx));;
-            ctx.run();
-        });
+    std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+    for (std::size_t i = 0; i < num_threads; ++i) {
+        contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+    }
 
     bool to_big_endian = true;
-    mm::network::middleman_proxy::settings settings = {
-        .local_host  = local_host,
-        .local_port  = local_port,
-        .remote_host = remote_host,
-        .remote_port = remote_port,
-        .mutator = std::make_shared<mm::mutators::json_rule_based_mutator>("dis_types.json", "test_rules2.json", to_big_endian),
-        .log_to_stdout = true
-    };
+    // "fuzz_seed": 1234 repeats a fuzzing run; without it each run logs its own
+    std::optional<uint64_t> fuzz_seed;
+    if (config.contains("fuzz_seed")) {
+        fuzz_seed = config["fuzz_seed"].get<uint64_t>();
+    }
+    rules_store store(to_big_endian, fuzz_seed);
+    const auto tuning = read_low_latency(config.value("low_latency", json::object()));
+
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<mm::network::middleman_proxy>> proxies;
+    for (std::size_t i = 0; i < proxy_configs.size(); ++i) {
+        const json& pc = proxy_configs[i];
+        auto settings = read_proxy(pc, store, tuning);
+        names.push_back(pc.value("name", settings.local_host + ":" + std::to_string(settings.local_port)));
+        proxies.push_back(std::make_unique<mm::network::middleman_proxy>(contexts[i % num_threads].get(), settings));
+    }
+    spdlog::info("Running {} prox{} on {} thread{}",
+                 proxies.size(), proxies.size() == 1 ? "y" : "ies",
+                 num_threads, num_threads == 1 ? "" : "s");
+
+    std::atomic<bool> stopping = false;
+    boost::asio::signal_set signals(*contexts[0], SIGINT, SIGTERM);
+    signals.async_wait([&](const boost::system::error_code& ec, int) {
+        if (!ec) {
+            stopping = true;
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < contexts.size(); ++i) {
+        threads.emplace_back([&ctx = *contexts[i], &tuning, i](){
+            mm::network::run_network_thread(ctx, tuning, i);
+        });
+    }
 
-    mm::network::middleman_proxy proxy_server(&ctx, settings);
+    const auto stats_interval = std::chrono::duration<double>(config.value("stats_interval_s", 10.0));
+    auto next_stats = std::chrono::steady_clock::now() + stats_interval;
+    while (!stopping) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (stats_interval.count() > 0 && std::chrono::steady_clock::now() >= next_stats) {
+            next_stats += std::chrono::duration_cast<std::chrono::steady_clock::duration>(stats_interval);
+            for (std::size_t i = 0; i < proxies.size(); ++i) {
+                log_statistics(names[i], *proxies[i]);
+            }
+        }
+    }
 
-    sleep(5000);
+    spdlog::info("Shutting down");
+    for (auto& ctx : contexts) {
+        ctx->stop();
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (std::size_t i = 0; i < proxies.size(); ++i) {
+        log_statistics(names[i], *proxies[i]);
+    }
+    proxies.clear();
 }
@@ -0,0 +1,148 @@
+// mmcodegen: emits a C++ header of fixed-offset packet accessors from a
+// types file. Usage: mmcodegen <types.json> <out.hpp> [namespace]
+
+#include <mm/mutators/json_rule_based_mutator.hpp>
+#include <mm/config_reader.hpp>
+
+#include <cctype>
+#include <set>
+
+static std::string identifier(const std::string& name) {
+    std::string id;
+    for (char c : name) {
+        id += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    }
+    if (id.empty() || std::isdigit(static_cast<unsigned char>(id[0]))) {
+        id = "_" + id;
+    }
+    return id;
+}
+
+static std::string stem(const std::string& path) {
+    std::string base = path.substr(path.find_last_of("/\\") + 1);
+    return base.substr(0, base.find('.'));
+}
+
+static const char* cpp_type(data_type type) {
+    switch (type) {
+        case CHAR_TYPE:   return "int8_t";
+        case SHORT_TYPE:  return "int16_t";
+        case INT_TYPE:    return "int32_t";
+        case LONG_TYPE:   return "int64_t";
+        case UCHAR_TYPE:  return "uint8_t";
+        case USHORT_TYPE: return "uint16_t";
+        case UINT_TYPE:   return "uint32_t";
+        case ULONG_TYPE:  return "uint64_t";
+        case FLOAT_TYPE:  return "float";
+        case DOUBLE_TYPE: return "double";
+        default:          return nullptr;
+    }
+}
+
+static const char* data_type_name(data_type type) {
+    switch (type) {
+        case CHAR_TYPE:   return "CHAR_TYPE";
+        case SHORT_TYPE:  return "SHORT_TYPE";
+        case INT_TYPE:    return "INT_TYPE";
+        case LONG_TYPE:   return "LONG_TYPE";
+        case UCHAR_TYPE:  return "UCHAR_TYPE";
+        case USHORT_TYPE: return "USHORT_TYPE";
+        case UINT_TYPE:   return "UINT_TYPE";
+        case ULONG_TYPE:  return "ULONG_TYPE";
+        case FLOAT_TYPE:  return "FLOAT_TYPE";
+        case DOUBLE_TYPE: return "DOUBLE_TYPE";
+        default:          return "INVALID_DATA_TYPE";
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        spdlog::error("usage: mmcodegen <types.json> <out.hpp> [namespace]");
+        return 1;
+    }
+    const std::string types_file = argv[1];
+    const std::string out_file = argv[2];
+    const std::string ns = identifier(argc > 3 ? argv[3] : stem(types_file));
+
+    packet_types types;
+    try {
+        types = packet_description_from_json(read_configuration(types_file));
+    }
+    catch (const std::exception& e) {
+        spdlog::error("Failed to parse {}: {}", types_file, e.what());
+        return 1;
+    }
+
+    std::stringstream ss;
+    std::stringstream table;
+    ss << "// Generated by mmcodegen from " << stem(types_file) << ". Do not edit.\n"
+       << "#pragma once\n\n"
+       << "#include <mm/mutators/generated_accessors.hpp>\n\n"
+       << "namespace mm::generated::" << ns << " {\n";
+
+    std::set<std::string> packet_ids;
+    int num_accessors = 0;
+    for (const auto& packet : types) {
+        std::string pid = identifier(packet.name);
+        while (!packet_ids.insert(pid).second) pid += "_";
+
+        // Only the fixed part: fields behind an array or blob have no
+        // compile-time offset and are left to the interpreted path
+        int size = 0;
+        for (const auto& f : packet.fields) {
+            if (f.anchor < 0) {
+                size = std::max(size, f.offset + f.size);
+            }
+        }
+
+        std::stringstream layout;
+        std::set<std::string> member_ids;
+        ss << "\nstruct " << pid << " {\n"
+           << "    static constexpr const char* name = \"" << packet.name << "\";\n"
+           << "    static constexpr int opcode = " << packet.opcode << ";\n"
+           << "    static constexpr int size = " << size << ";\n\n";
+
+        for (const auto& f : packet.fields) {
+            // bitfield members overlap their word, which is emitted itself
+            if (f.anchor >= 0 || f.bit_width) {
+                continue;
+            }
+            std::string fid = identifier(f.name);
+            for (int n = 2; !member_ids.insert(fid).second; ++n) {
+                fid = identifier(f.name) + "_" + std::to_string(n);
+            }
+
+            const char* type = cpp_type(f.type);
+            if (type) {
+                ss << "    using " << fid << " = field_desc<" << type << ", " << f.offset << ">;\n";
+                layout << "        " << type << " " << fid << ";\n";
+                ++num_accessors;
+                table << "    make_accessor<" << pid << "::" << fid << ">(\""
+                      << packet.name << "." << f.name << "\", " << data_type_name(f.type) << "),\n";
+            }
+            else {
+                layout << "        unsigned char " << fid << "[" << f.size << "];\n";
+            }
+        }
+
+        ss << "\n#pragma pack(push, 1)\n"
+           << "    struct layout {\n" << layout.str() << "    };\n"
+           << "#pragma pack(pop)\n"
+           << "};\n"
+           << "static_assert(sizeof(" << pid << "::layout) == " << pid << "::size, \""
+           << packet.name << " layout does not match its field offsets\");\n";
+    }
+
+    // a zero-length array isn't valid C++, keep one empty slot instead
+    ss << "\ninline constexpr std::size_t accessor_count = " << num_accessors << ";\n"
+       << "inline constexpr accessor accessors[" << std::max(num_accessors, 1) << "] = {\n" << table.str() << "};\n\n"
+       << "}\n";
+
+    std::ofstream out(out_file, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        spdlog::error("Failed to write {}", out_file);
+        return 1;
+    }
+    out << ss.str();
+    return 0;
+}
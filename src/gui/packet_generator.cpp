@@ -0,0 +1,197 @@
+#include "packet_generator.hpp"
+
+#include <boost/asio.hpp>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// Periods shorter than this are paced by spinning; the kernel can't reliably
+// wake us up that precisely.
+static const std::chrono::nanoseconds SPIN_THRESHOLD = std::chrono::microseconds(50);
+
+// Upper bound on a single blocking wait so stop() is honoured promptly.
+static const std::chrono::nanoseconds MAX_WAIT = std::chrono::milliseconds(100);
+
+static quint64 readBigEndian(const char* p, int size) {
+    quint64 v = 0;
+    for (int i = 0; i < size; ++i) {
+        v = (v << 8) | static_cast<unsigned char>(p[i]);
+    }
+    return v;
+}
+
+static void writeBigEndian(char* p, int size, quint64 v) {
+    for (int i = size - 1; i >= 0; --i) {
+        p[i] = char(v & 0xFF);
+        v >>= 8;
+    }
+}
+
+namespace {
+
+// Sleeps until an absolute steady_clock deadline.
+class DeadlineTimer {
+public:
+    DeadlineTimer() {
+#ifdef __linux__
+        fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fd < 0) {
+            spdlog::warn("timerfd_create failed, falling back to sleep_until");
+        }
+#endif
+    }
+
+    ~DeadlineTimer() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    void waitUntil(Clock::time_point deadline) {
+        const auto remaining = deadline - Clock::now();
+        if (remaining <= std::chrono::nanoseconds::zero()) return;
+        if (remaining < SPIN_THRESHOLD) {
+            while (Clock::now() < deadline) {}
+            return;
+        }
+#ifdef __linux__
+        if (fd >= 0) {
+            // steady_clock is CLOCK_MONOTONIC on Linux, so its epoch matches.
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+            itimerspec its{};
+            its.it_value.tv_sec  = ns / 1000000000;
+            its.it_value.tv_nsec = ns % 1000000000;
+            if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, nullptr) == 0) {
+                uint64_t expirations = 0;
+                ssize_t rc = read(fd, &expirations, sizeof(expirations));
+                (void)rc;
+                return;
+            }
+        }
+#endif
+        std::this_thread::sleep_until(deadline);
+    }
+
+private:
+    int fd = -1;
+};
+
+}
+
+PacketGenerator::~PacketGenerator() {
+    stop();
+}
+
+bool PacketGenerator::start(const Settings& settings, const QByteArray& packetTemplate) {
+    stop();
+    if (settings.rate <= 0 || settings.burst <= 0 || packetTemplate.isEmpty()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pendingDirty = false;
+        pendingTemplate.clear();
+        pendingIncrements.clear();
+    }
+    sent = 0;
+    failed = 0;
+    running = true;
+    thread = std::thread(&PacketGenerator::run, this, settings, packetTemplate);
+    return true;
+}
+
+void PacketGenerator::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void PacketGenerator::updateTemplate(const QByteArray& packetTemplate,
+                                     const std::vector<FieldIncrement>& increments) {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pendingTemplate = packetTemplate;
+    pendingIncrements = increments;
+    pendingDirty.store(true, std::memory_order_release);
+}
+
+void PacketGenerator::run(Settings settings, QByteArray packet) {
+    namespace ip = boost::asio::ip;
+
+    boost::asio::io_context ctx;
+    ip::udp::socket socket(ctx);
+    boost::system::error_code ec;
+    const ip::udp::endpoint dest(ip::make_address(settings.host.toStdString(), ec), settings.port);
+    if (!ec) socket.open(dest.protocol(), ec);
+    if (!ec) socket.connect(dest, ec);
+    if (ec) {
+        spdlog::error("Packet generator failed to open socket to {}:{}: {}",
+                      settings.host.toStdString(), settings.port, ec.message());
+        running = false;
+        return;
+    }
+
+    std::vector<quint64> bases;
+    auto loadBases = [&]{
+        bases.clear();
+        for (auto& inc : settings.increments) {
+            if (inc.offset < 0 || inc.size <= 0 || inc.size > 8 || inc.offset + inc.size > packet.size()) {
+                inc.size = 0; // out of range, ignored
+            }
+            bases.push_back(inc.size > 0 ? readBigEndian(packet.constData() + inc.offset, inc.size) : 0);
+        }
+    };
+    loadBases();
+
+    const auto period = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(settings.burst / settings.rate));
+    const auto start = Clock::now();
+    auto deadline = start;
+    quint64 index = 0;
+    DeadlineTimer timer;
+
+    while (running.load(std::memory_order_relaxed)) {
+        if (pendingDirty.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            packet = pendingTemplate;
+            settings.increments = pendingIncrements;
+            pendingDirty = false;
+            loadBases();
+        }
+
+        char* data = packet.data();
+        const auto now = Clock::now();
+        const quint64 micros = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+        for (int b = 0; b < settings.burst; ++b, ++index) {
+            for (size_t i = 0; i < settings.increments.size(); ++i) {
+                const auto& inc = settings.increments[i];
+                if (inc.size == 0) continue;
+                const quint64 value = (inc.kind == FieldIncrement::Timestamp)
+                                    ? micros
+                                    : bases[i] + quint64(inc.step) * index;
+                writeBigEndian(data + inc.offset, inc.size, value);
+            }
+            socket.send(boost::asio::buffer(data, packet.size()), 0, ec);
+            if (ec) { ++failed; }
+            else    { sent.fetch_add(1, std::memory_order_relaxed); }
+        }
+
+        deadline += period;
+        // If we fell far behind (debugger, suspended VM) resync instead of
+        // bursting to catch up.
+        if (Clock::now() - deadline > std::chrono::milliseconds(100)) {
+            deadline = Clock::now();
+        }
+        while (running.load(std::memory_order_relaxed) && Clock::now() < deadline) {
+            timer.waitUntil(std::min(deadline, Clock::now() + MAX_WAIT));
+        }
+    }
+}
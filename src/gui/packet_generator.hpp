@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Per-packet field rewrite applied by the generator thread on top of the
+// compiled packet template. Values are written in network byte order to
+// match SchemaEditor::serializeCurrentPacket().
+struct FieldIncrement {
+    enum Kind { Counter, Timestamp };
+
+    int  offset = 0;
+    int  size   = 0;   // 1, 2, 4 or 8 bytes
+    Kind kind   = Counter;
+    qint64 step = 1;   // Counter only
+};
+
+// Background UDP sender for SchemaEditor's auto-send.
+//
+// The packet is compiled once into a byte template by the editor and handed
+// over here; the sender thread then paces sends against absolute deadlines
+// (timerfd on Linux, sleep_until elsewhere) from a single persistent socket.
+class PacketGenerator {
+public:
+    struct Settings {
+        QString host;
+        quint16 port   = 0;
+        double  rate   = 1.0; // packets per second
+        int     burst  = 1;   // packets sent back-to-back per deadline
+        std::vector<FieldIncrement> increments;
+    };
+
+    PacketGenerator() = default;
+    ~PacketGenerator();
+
+    PacketGenerator(const PacketGenerator&) = delete;
+    PacketGenerator& operator=(const PacketGenerator&) = delete;
+
+    bool start(const Settings& settings, const QByteArray& packetTemplate);
+    void stop();
+    bool isRunning() const { return running.load(std::memory_order_relaxed); }
+
+    // Thread-safe; picked up by the sender before its next burst.
+    void updateTemplate(const QByteArray& packetTemplate,
+                        const std::vector<FieldIncrement>& increments);
+
+    quint64 sentCount() const   { return sent.load(std::memory_order_relaxed); }
+    quint64 failedCount() const { return failed.load(std::memory_order_relaxed); }
+
+private:
+    void run(Settings settings, QByteArray packet);
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<quint64> sent{0};
+    std::atomic<quint64> failed{0};
+
+    std::mutex pendingMutex;
+    std::atomic<bool> pendingDirty{false};
+    QByteArray pendingTemplate;
+    std::vector<FieldIncrement> pendingIncrements;
+};
@@ -71,6 +71,10 @@ SchemaEditor::SchemaEditor(const QString& schemaFile, QWidget* parent)
     loadSchemaFromFile(schemaFile);
 }
 
+SchemaEditor::~SchemaEditor() {
+    stopAutoSend();
+}
+
 void SchemaEditor::buildUi() {
     auto* central = new QWidget; setCentralWidget(central);
     auto* vbox = new QVBoxLayout(central);
@@ -85,7 +89,8 @@ void SchemaEditor::buildUi() {
     hostEdit->setPlaceholderText("Host/IP");
     portSpin = new QSpinBox; portSpin->setRange(1, 65535); portSpin->setValue(3000); portSpin->setMaximumWidth(100);
     leCheck = new QCheckBox("LE"); leCheck->setToolTip("Little Endian");
-    intervalSpin = new QSpinBox; intervalSpin->setRange(10, 60*60*1000); intervalSpin->setValue(1000); intervalSpin->setSuffix(" ms"); intervalSpin->setMaximumWidth(120);
+    rateSpin = new QSpinBox; rateSpin->setRange(1, 100000); rateSpin->setValue(1); rateSpin->setSuffix(" pps"); rateSpin->setMaximumWidth(120);
+    burstSpin = new QSpinBox; burstSpin->setRange(1, 10000); burstSpin->setValue(1); burstSpin->setToolTip("Packets sent back-to-back per tick"); burstSpin->setMaximumWidth(80);
     sendBtn = new QToolButton; sendBtn->setText("Send"); sendBtn->setToolTip("Send UDP now"); sendBtn->setAutoRaise(true);
     autoBtn = new QToolButton; autoBtn->setText("Auto OFF"); autoBtn->setCheckable(true); autoBtn->setToolTip("Toggle periodic send"); autoBtn->setAutoRaise(true);
 
@@ -93,7 +98,8 @@ void SchemaEditor::buildUi() {
     topBar->addSeparator();
     topBar->addWidget(new QLabel("Port:")); topBar->addWidget(portSpin);
     topBar->addSeparator();
-    topBar->addWidget(new QLabel("Interval:")); topBar->addWidget(intervalSpin);
+    topBar->addWidget(new QLabel("Rate:")); topBar->addWidget(rateSpin);
+    topBar->addWidget(new QLabel("Burst:")); topBar->addWidget(burstSpin);
     topBar->addSeparator();
     topBar->addWidget(leCheck);
     topBar->addSeparator();
@@ -120,12 +126,13 @@ void SchemaEditor::buildUi() {
     tree->setItemDelegateForColumn(2, new NoEditDelegate(tree));
     tree->setItemDelegateForColumn(3, new ValueDelegate(tree));
     tree->setEditTriggers(QAbstractItemView::DoubleClicked | QAbstractItemView::EditKeyPressed);
+    tree->setContextMenuPolicy(Qt::CustomContextMenu);
 
     // Status bar
     status = new QStatusBar; setStatusBar(status);
 
-    // Timer for auto-send
-    autoTimer = new QTimer(this); autoTimer->setTimerType(Qt::CoarseTimer);
+    // Auto-send progress in the status bar
+    statsTimer = new QTimer(this); statsTimer->setTimerType(Qt::CoarseTimer); statsTimer->setInterval(500);
 
     // Menus
     auto* fileMenu = menuBar()->addMenu("&File");
@@ -170,6 +177,7 @@ void SchemaEditor::connectSignals() {
         saveCurrentPacketValues();
         currentPacket = packetCombo->currentData().toJsonObject();
         rebuildTree();
+        refreshGeneratorTemplate();
     });
     // Store edits live
     connect(tree, &QTreeWidget::itemChanged, this, [this](QTreeWidgetItem* item, int column){
@@ -177,8 +185,12 @@ void SchemaEditor::connectSignals() {
         if (item->text(1) != "field") return;
         const auto pathList = item->data(0, Roles::PathList).toStringList();
         if (pathList.isEmpty()) return;
-        storedValues[packetKey(currentPacket)][pathList.join("/")] = item->text(3);
+        const QString pathKey = pathList.join("/");
+        storedValues[packetKey(currentPacket)][pathKey] = item->text(3);
+        updatePacketImage(pathKey, item->text(3));
+        refreshGeneratorTemplate();
     });
+    connect(tree, &QTreeWidget::customContextMenuRequested, this, &SchemaEditor::showFieldContextMenu);
 
     // Menu actions
     connect(actSendUdp, &QAction::triggered, this, &SchemaEditor::onSendUdp);
@@ -204,17 +216,122 @@ void SchemaEditor::connectSignals() {
     });
     connect(autoBtn, &QToolButton::toggled, this, [this](bool on){
         autoBtn->setText(on ? "Auto ON" : "Auto OFF");
-        autoTimer->stop();
-        if (on) {
-            autoTimer->start(intervalSpin->value());
-        }
+        if (on) startAutoSend();
+        else    stopAutoSend();
     });
-    connect(autoTimer, &QTimer::timeout, this, [this]{
-        const QByteArray d = serializeCurrentPacket();
-        QUdpSocket sock; sock.writeDatagram(d, QHostAddress(hostEdit->text()), quint16(portSpin->value()));
+    connect(statsTimer, &QTimer::timeout, this, [this]{
+        if (!generator) return;
+        if (!generator->isRunning()) {
+            autoBtn->setChecked(false); // socket setup failed on the sender thread
+            status->showMessage("Auto-send stopped: could not open socket", 3000);
+            return;
+        }
+        status->showMessage(QString("Auto-send: %1 sent, %2 failed")
+                            .arg(generator->sentCount()).arg(generator->failedCount()));
     });
 }
 
+// ---------------- Auto-send -------------------
+void SchemaEditor::startAutoSend() {
+    stopAutoSend();
+    if (tree->topLevelItemCount() == 0) {
+        autoBtn->setChecked(false);
+        return;
+    }
+
+    PacketGenerator::Settings settings;
+    settings.host       = hostEdit->text().trimmed();
+    settings.port       = quint16(portSpin->value());
+    settings.rate       = rateSpin->value();
+    settings.burst      = burstSpin->value();
+    settings.increments = currentPacketIncrements();
+
+    generator = std::make_unique<PacketGenerator>();
+    if (!generator->start(settings, serializeCurrentPacket())) {
+        generator.reset();
+        autoBtn->setChecked(false);
+        status->showMessage("Auto-send: nothing to send", 2000);
+        return;
+    }
+    rateSpin->setEnabled(false);
+    burstSpin->setEnabled(false);
+    statsTimer->start();
+}
+
+void SchemaEditor::stopAutoSend() {
+    statsTimer->stop();
+    if (generator) {
+        generator->stop();
+        generator.reset();
+    }
+    rateSpin->setEnabled(true);
+    burstSpin->setEnabled(true);
+}
+
+// Recompile the template after an edit; the sender never walks the tree itself.
+void SchemaEditor::refreshGeneratorTemplate() {
+    if (!generator || !generator->isRunning()) return;
+    generator->updateTemplate(serializeCurrentPacket(), currentPacketIncrements());
+}
+
+void SchemaEditor::showFieldContextMenu(const QPoint& pos) {
+    auto* item = tree->itemAt(pos);
+    if (!item || item->text(1) != "field") return;
+    const int size = fieldByteSize(item->data(0, Roles::TypeName).toString(), item->data(0, Roles::SizeBits).toInt());
+    if (size <= 0 || size > 8) return;
+
+    QMenu menu(this);
+    auto* actCounter   = menu.addAction("Increment per packet");
+    auto* actTimestamp = menu.addAction("Timestamp per packet");
+    auto* actNone      = menu.addAction("Fixed value");
+    const QString current = item->data(0, Roles::Increment).toString();
+    for (auto* a : {actCounter, actTimestamp, actNone}) a->setCheckable(true);
+    actCounter->setChecked(current == "counter");
+    actTimestamp->setChecked(current == "timestamp");
+    actNone->setChecked(current.isEmpty());
+
+    auto* chosen = menu.exec(tree->viewport()->mapToGlobal(pos));
+    if (!chosen) return;
+    const QString kind = chosen == actCounter ? "counter" : chosen == actTimestamp ? "timestamp" : "";
+    item->setData(0, Roles::Increment, kind);
+    item->setToolTip(0, kind.isEmpty() ? QString() : QString("Auto-send: %1").arg(kind));
+    QFont f = item->font(0); f.setItalic(!kind.isEmpty()); item->setFont(0, f);
+    refreshGeneratorTemplate();
+}
+
+int SchemaEditor::fieldByteSize(const QString& typeName, int sizeBits) {
+    if (typeName == "int8"  || typeName == "uint8")  return 1;
+    if (typeName == "int16" || typeName == "uint16") return 2;
+    if (typeName == "int32" || typeName == "uint32" || typeName == "float") return 4;
+    if (typeName == "int64" || typeName == "uint64" || typeName == "double") return 8;
+    if (typeName.isEmpty() && sizeBits > 0) return (sizeBits + 7)/8;
+    return 0;
+}
+
+// Byte offsets of the fields marked for per-packet rewrite.
+std::vector<FieldIncrement> SchemaEditor::currentPacketIncrements() const {
+    std::vector<FieldIncrement> out;
+    if (tree->topLevelItemCount() == 0) return out;
+    std::function<void(QTreeWidgetItem*)> walk = [&](QTreeWidgetItem* item){
+        for (int i = 0; i < item->childCount(); ++i) {
+            auto* c = item->child(i);
+            const QString kind = c->text(1);
+            if (kind == "struct") { walk(c); continue; }
+            const QString inc = c->data(0, Roles::Increment).toString();
+            if (kind != "field" || inc.isEmpty()) continue;
+            const auto slot = fieldLayout.constFind(c->data(0, Roles::PathList).toStringList().join("/"));
+            if (slot == fieldLayout.cend()) continue;
+            FieldIncrement fi;
+            fi.offset = slot->offset;
+            fi.size   = slot->size;
+            fi.kind   = inc == "timestamp" ? FieldIncrement::Timestamp : FieldIncrement::Counter;
+            out.push_back(fi);
+        }
+    };
+    walk(tree->topLevelItem(0));
+    return out;
+}
+
 void SchemaEditor::loadSchemaFromFile(const QString& filePath) {
     QFile f(filePath);
     if (!f.open(QIODevice::ReadOnly)) { QMessageBox::warning(this, "Load Schema", f.errorString()); return; }
@@ -261,14 +378,16 @@ void SchemaEditor::saveCurrentPacketValues() {
 }
 
 void SchemaEditor::rebuildTree() {
+    const QSignalBlocker blocker(tree); // values are encoded in bulk below
     tree->clear();
-    if (currentPacket.isEmpty()) return;
+    if (currentPacket.isEmpty()) { rebuildPacketImage(); return; }
     auto* root = new QTreeWidgetItem(tree, QStringList{currentPacket.value("name").toString(), "packet", "", ""});
     root->setData(0, Roles::NodeType, "packet");
     root->setData(0, Roles::PathList, QStringList{currentPacket.value("name").toString()});
     const auto data = currentPacket.value("data").toArray();
     for (const auto& n : data) addNodeRecursive(root, n, QStringList{currentPacket.value("name").toString()});
     tree->expandToDepth(1);
+    rebuildPacketImage();
 }
 
 void SchemaEditor::addNodeRecursive(QTreeWidgetItem* parent, const QJsonValue& nodeVal, QStringList path) {
@@ -330,38 +449,69 @@ void SchemaEditor::onSendUdp() {
 }
 
 QByteArray SchemaEditor::serializeCurrentPacket() const {
-    QByteArray buf;
-    QDataStream ds(&buf, QIODevice::WriteOnly);
-    ds.setByteOrder(QDataStream::BigEndian); // network order
-    if (tree->topLevelItemCount() == 0) return buf;
-    auto* root = tree->topLevelItem(0);
-    std::function<void(QTreeWidgetItem*)> walk = [&](QTreeWidgetItem* item){
-        for (int i = 0; i < item->childCount(); ++i) {
-            auto* c = item->child(i);
-            const QString kind = c->text(1);
-            if (kind == "struct") {
-                walk(c);
-            } else if (kind == "field") {
-                const QString typeName = c->data(0, Roles::TypeName).toString();
-                const int sizeBits = c->data(0, Roles::SizeBits).toInt();
-                const QString valueText = c->text(3).trimmed();
-                if (!typeName.isEmpty())      writeField(ds, typeName, valueText);
-                else if (sizeBits > 0)        writeBits(ds, sizeBits, valueText);
-            }
+    return packetImage; // implicitly shared; callers that write get their own copy
+}
+
+// Lay out the current packet from the schema and encode every stored value
+// once. After this, edits only touch their own slot in packetImage.
+void SchemaEditor::rebuildPacketImage() {
+    fieldLayout.clear();
+    packetImage.clear();
+    if (currentPacket.isEmpty()) return;
+
+    int offset = 0;
+    QStringList path{currentPacket.value("name").toString()};
+    std::function<void(const QJsonValue&)> walk = [&](const QJsonValue& node){
+        if (!node.isObject()) return;
+        const auto o = node.toObject();
+        if (o.contains("struct")) {
+            path.push_back(o.value("struct").toString());
+            const auto arr = o.value("data").toArray();
+            for (const auto& ch : arr) walk(ch);
+            path.removeLast();
+            return;
         }
+        FieldSlot slot;
+        slot.offset   = offset;
+        slot.typeName = o.value("type").toString();
+        slot.sizeBits = o.value("size").toInt();
+        slot.size     = fieldByteSize(slot.typeName, slot.sizeBits);
+        path.push_back(o.value("value").toString("<value>"));
+        fieldLayout.insert(path.join("/"), slot);
+        path.removeLast();
+        offset += slot.size;
     };
-    walk(root);
-    return buf;
+    const auto data = currentPacket.value("data").toArray();
+    for (const auto& n : data) walk(n);
+
+    packetImage = QByteArray(offset, '\0');
+    const auto values = storedValues.value(packetKey(currentPacket));
+    for (auto it = fieldLayout.cbegin(); it != fieldLayout.cend(); ++it) {
+        writeSlot(it.value(), values.value(it.key(), QStringLiteral("0")));
+    }
 }
 
-void SchemaEditor::writeField(QDataStream& ds, const QString& typeName, const QString& valueText) {
+void SchemaEditor::updatePacketImage(const QString& pathKey, const QString& valueText) {
+    const auto it = fieldLayout.constFind(pathKey);
+    if (it == fieldLayout.cend()) return;
+    writeSlot(it.value(), valueText);
+}
+
+void SchemaEditor::writeSlot(const FieldSlot& slot, const QString& valueText) {
+    if (slot.size <= 0 || slot.offset + slot.size > packetImage.size()) return;
+    char* dst = packetImage.data() + slot.offset;
+    if (!slot.typeName.isEmpty()) writeField(dst, slot.typeName, valueText);
+    else if (slot.sizeBits > 0)   writeBits(dst, slot.sizeBits, valueText);
+}
+
+void SchemaEditor::writeField(char* dst, const QString& typeName, const QString& valueText) {
     QString val = valueText.trimmed();
 
     // Default empty values to 0
     if (val.isEmpty()) val = "0";
 
-    // Treat "\\0" as a literal null byte
-    if (val == "\\0") { ds.writeRawData("\0", 1); return; }
+    // Treat "\\0" as a null field
+    if (val == "\\0") { memset(dst, 0, fieldByteSize(typeName, 0)); return; }
 
     auto parseUnsigned = [](const QString& s, qulonglong& out)->bool {
         bool ok = false;
@@ -389,48 +539,43 @@ void SchemaEditor::writeField(QDataStream& ds, const QString& typeName, const QS
     if (typeName == "int8" || typeName == "int16" || typeName == "int32" || typeName == "int64") {
         qlonglong v = 0;
         parseSigned(val, v);
-        if (typeName == "int8")   { v = std::clamp<qlonglong>(v, -(1ll<<7),  (1ll<<7)-1);  ds << qint8(v);  return; }
-        if (typeName == "int16")  { v = std::clamp<qlonglong>(v, -(1ll<<15), (1ll<<15)-1); ds << qint16(v); return; }
-        if (typeName == "int32")  { v = std::clamp<qlonglong>(v, INT_MIN, INT_MAX);         ds << qint32(v); return; }
-        /* int64 */                 { ds << qint64(v); return; }
+        if (typeName == "int8")   { v = std::clamp<qlonglong>(v, -(1ll<<7),  (1ll<<7)-1);  *dst = char(qint8(v));        return; }
+        if (typeName == "int16")  { v = std::clamp<qlonglong>(v, -(1ll<<15), (1ll<<15)-1); qToBigEndian(qint16(v), dst); return; }
+        if (typeName == "int32")  { v = std::clamp<qlonglong>(v, INT_MIN, INT_MAX);         qToBigEndian(qint32(v), dst); return; }
+        /* int64 */                 { qToBigEndian(qint64(v), dst); return; }
     }
 
     // ---- Unsigned integer types ----
     if (typeName == "uint8" || typeName == "uint16" || typeName == "uint32" || typeName == "uint64") {
         qulonglong u = 0;
         parseUnsigned(val, u);
-        if (typeName == "uint8")  { u = std::min<qulonglong>(u, (1ull<<8)-1);   ds << quint8(u);  return; }
-        if (typeName == "uint16") { u = std::min<qulonglong>(u, (1ull<<16)-1);  ds << quint16(u); return; }
-        if (typeName == "uint32") { u = std::min<qulonglong>(u, 0xFFFFFFFFull); ds << quint32(u); return; }
-        if (typeName == "uint64") { ds << quint64(u); return; }
+        if (typeName == "uint8")  { u = std::min<qulonglong>(u, (1ull<<8)-1);   *dst = char(quint8(u));        return; }
+        if (typeName == "uint16") { u = std::min<qulonglong>(u, (1ull<<16)-1);  qToBigEndian(quint16(u), dst); return; }
+        if (typeName == "uint32") { u = std::min<qulonglong>(u, 0xFFFFFFFFull); qToBigEndian(quint32(u), dst); return; }
+        if (typeName == "uint64") { qToBigEndian(quint64(u), dst); return; }
     }
 
     // ---- Floating point ----
     if (typeName == "float") {
         bool ok=false; double d = QLocale::c().toDouble(valueText.trimmed(), &ok);
         float f = ok ? float(d) : 0.0f;
-
-        const auto old = ds.floatingPointPrecision();
-        ds.setFloatingPointPrecision(QDataStream::SinglePrecision); // 4 bytes
-        ds << f;
-        ds.setFloatingPointPrecision(old);
+        quint32 bits; memcpy(&bits, &f, sizeof(bits));
+        qToBigEndian(bits, dst);
         return;
     }
 
     if (typeName == "double") {
         bool ok=false; double d = QLocale::c().toDouble(valueText.trimmed(), &ok);
-
-        const auto old = ds.floatingPointPrecision();
-        ds.setFloatingPointPrecision(QDataStream::DoublePrecision); // 8 bytes
-        ds << (ok ? d : 0.0);
-        ds.setFloatingPointPrecision(old);
+        if (!ok) d = 0.0;
+        quint64 bits; memcpy(&bits, &d, sizeof(bits));
+        qToBigEndian(bits, dst);
         return;
     }
 }
 
-void SchemaEditor::writeBits(QDataStream& ds, int sizeBits, const QString& valueText) {
+void SchemaEditor::writeBits(char* dst, int sizeBits, const QString& valueText) {
     const int bytes = (sizeBits + 7)/8;
-    QByteArray raw(bytes, '\0');
+    memset(dst, 0, bytes);
     QString s = valueText.trimmed();
     if (!s.isEmpty()) {
         if (s.startsWith("0x", Qt::CaseInsensitive)) {
@@ -438,14 +583,13 @@ void SchemaEditor::writeBits(QDataStream& ds, int sizeBits, const QString& value
             QByteArray parsed = QByteArray::fromHex(hex);
             if (!parsed.isEmpty()) {
                 int copy = qMin(parsed.size(), bytes);
-                memcpy(raw.data() + (bytes - copy), parsed.constData() + (parsed.size() - copy), copy);
+                memcpy(dst + (bytes - copy), parsed.constData() + (parsed.size() - copy), copy);
             }
         } else {
             quint64 acc = 0; for (QChar ch : s) { if (ch == '0' || ch == '1') { acc = (acc<<1) | (ch == '1'); } }
-            for (int i = 0; i < bytes; ++i) { raw[bytes-1-i] = char(acc & 0xFF); acc >>= 8; }
+            for (int i = 0; i < bytes; ++i) { dst[bytes-1-i] = char(acc & 0xFF); acc >>= 8; }
         }
     }
-    ds.writeRawData(raw.constData(), raw.size());
 }
 
 bool SchemaEditor::loadValuesForKeyFromFile(const QString& key) {
@@ -3,12 +3,17 @@
 #include <QtGui>
 #include <QtNetwork/QUdpSocket>
 
+#include <memory>
+
+#include "packet_generator.hpp"
+
 namespace Roles {
 enum : int {
            NodeType = Qt::UserRole + 1,
            TypeName,
            SizeBits,
-           PathList
+           PathList,
+           Increment // "", "counter" or "timestamp"
        };
 }
 
@@ -41,6 +46,7 @@ class ValueDelegate : public QStyledItemDelegate {
 class SchemaEditor : public QMainWindow {
     public:
         SchemaEditor(const QString& schemaFile, QWidget* parent=nullptr);
+        ~SchemaEditor() override;
 
     private:
         QJsonObject schemaRoot;
@@ -67,11 +73,13 @@ class SchemaEditor : public QMainWindow {
         QSpinBox* portSpin{};
         QToolButton* sendBtn{};
         QToolButton* autoBtn{}; // start/stop auto-send
-        QSpinBox* intervalSpin{}; // ms interval
+        QSpinBox* rateSpin{}; // packets per second
+        QSpinBox* burstSpin{}; // packets per deadline
         QCheckBox* leCheck{}; // little-endian quick toggle
 
-        // Auto-send timer
-        QTimer* autoTimer{};
+        // Auto-send runs on its own thread; the timer only refreshes the status bar
+        std::unique_ptr<PacketGenerator> generator;
+        QTimer* statsTimer{};
 
         bool littleEndian = false;
 
@@ -99,10 +107,29 @@ class SchemaEditor : public QMainWindow {
         QJsonObject findPacketByKey(const QString& key) const;
         QStringList orderedFieldPaths(const QJsonObject& packet) const;
 
-        // UDP serialization helpers
+        // UDP serialization helpers. The packet is kept pre-encoded in
+        // packetImage; fieldLayout maps "Packet/struct/field" to its bytes.
+        struct FieldSlot {
+            int offset = 0;
+            int size = 0;
+            QString typeName; // empty for raw "size" fields
+            int sizeBits = 0;
+        };
+        QHash<QString, FieldSlot> fieldLayout;
+        QByteArray packetImage;
+
+        void rebuildPacketImage();
+        void updatePacketImage(const QString& pathKey, const QString& valueText);
+        void writeSlot(const FieldSlot& slot, const QString& valueText);
         QByteArray serializeCurrentPacket() const;
-        static void writeField(QDataStream& ds, const QString& typeName, const QString& valueText);
-        static void writeBits(QDataStream& ds, int sizeBits, const QString& valueText);
+        std::vector<FieldIncrement> currentPacketIncrements() const;
+        static int fieldByteSize(const QString& typeName, int sizeBits);
+        void startAutoSend();
+        void stopAutoSend();
+        void refreshGeneratorTemplate();
+        void showFieldContextMenu(const QPoint& pos);
+        static void writeField(char* dst, const QString& typeName, const QString& valueText);
+        static void writeBits(char* dst, int sizeBits, const QString& valueText);
 
         private slots:
             void onSendUdp();
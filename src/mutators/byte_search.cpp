@@ -0,0 +1,96 @@
+#include <mm/mutators/byte_search.hpp>
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MM_HAVE_SIMD_SEARCH 1
+#endif
+
+namespace mm::mutators {
+
+namespace {
+
+const unsigned char* find_bytes_scalar(const unsigned char* h, std::size_t n, const unsigned char* needle, std::size_t m) {
+    if (n < m) {
+        return nullptr;
+    }
+    const unsigned char* end = h + n - m + 1;
+    while (h < end) {
+        h = static_cast<const unsigned char*>(std::memchr(h, needle[0], end - h));
+        if (!h) {
+            return nullptr;
+        }
+        if (std::memcmp(h + 1, needle + 1, m - 1) == 0) {
+            return h;
+        }
+        ++h;
+    }
+    return nullptr;
+}
+
+#ifdef MM_HAVE_SIMD_SEARCH
+// Bit i of the mask is set where both h[i] == first and h[i + m - 1] == last
+const unsigned char* find_bytes_sse2(const unsigned char* h, std::size_t n, const unsigned char* needle, std::size_t m) {
+    const __m128i first = _mm_set1_epi8(char(needle[0]));
+    const __m128i last = _mm_set1_epi8(char(needle[m - 1]));
+    std::size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i + m - 1));
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        while (mask) {
+            const int bit = __builtin_ctz(mask);
+            if (std::memcmp(h + i + bit + 1, needle + 1, m - 2) == 0) {
+                return h + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_bytes_scalar(h + i, n - i, needle, m);
+}
+
+__attribute__((target("avx2")))
+const unsigned char* find_bytes_avx2(const unsigned char* h, std::size_t n, const unsigned char* needle, std::size_t m) {
+    const __m256i first = _mm256_set1_epi8(char(needle[0]));
+    const __m256i last = _mm256_set1_epi8(char(needle[m - 1]));
+    std::size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + m - 1));
+        unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+        while (mask) {
+            const int bit = __builtin_ctz(mask);
+            if (std::memcmp(h + i + bit + 1, needle + 1, m - 2) == 0) {
+                return h + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_bytes_sse2(h + i, n - i, needle, m);
+}
+#endif
+
+}
+
+const unsigned char* find_bytes(const unsigned char* haystack, std::size_t haystack_size,
+                                const unsigned char* needle, std::size_t needle_size) {
+    if (needle_size == 0) {
+        return haystack;
+    }
+    if (needle_size > haystack_size) {
+        return nullptr;
+    }
+    if (needle_size == 1) {
+        return static_cast<const unsigned char*>(std::memchr(haystack, needle[0], haystack_size));
+    }
+#ifdef MM_HAVE_SIMD_SEARCH
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2 ? find_bytes_avx2(haystack, haystack_size, needle, needle_size)
+                : find_bytes_sse2(haystack, haystack_size, needle, needle_size);
+#else
+    return find_bytes_scalar(haystack, haystack_size, needle, needle_size);
+#endif
+}
+
+}
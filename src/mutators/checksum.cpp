@@ -0,0 +1,135 @@
+#include <mm/mutators/checksum.hpp>
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define MM_HAVE_SSE42_CRC 1
+#endif
+
+namespace mm::mutators::checksum {
+
+namespace {
+
+using slice_tables = std::array<std::array<uint32_t, 256>, 8>;
+
+// Tables for a reflected CRC-32 with the given polynomial. Table k maps a
+// byte to its contribution k bytes further on, so the main loop folds in
+// eight bytes per step.
+slice_tables make_slice_tables(uint32_t poly) {
+    slice_tables t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+        }
+        t[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int k = 1; k < 8; ++k) {
+            t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+        }
+    }
+    return t;
+}
+
+uint32_t crc32_sliced(const slice_tables& t, const unsigned char* p, std::size_t n) {
+    uint32_t crc = 0xffffffffu;
+    while (n >= 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    }
+    return ~crc;
+}
+
+#ifdef MM_HAVE_SSE42_CRC
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(const unsigned char* p, std::size_t n) {
+    uint64_t crc = 0xffffffffu;
+    while (n >= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        crc = _mm_crc32_u64(crc, v);
+        p += 8;
+        n -= 8;
+    }
+    uint32_t c = uint32_t(crc);
+    while (n--) {
+        c = _mm_crc32_u8(c, *p++);
+    }
+    return ~c;
+}
+#endif
+
+}
+
+uint16_t crc16(const unsigned char* data, std::size_t size) {
+    static const std::array<uint16_t, 256> table = [] {
+        std::array<uint16_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint16_t c = uint16_t(i << 8);
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 0x8000) ? uint16_t((c << 1) ^ 0x1021) : uint16_t(c << 1);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint16_t crc = 0xffff;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = uint16_t((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+    }
+    return crc;
+}
+
+uint32_t crc32(const unsigned char* data, std::size_t size) {
+    static const slice_tables tables = make_slice_tables(0xedb88320u);
+    return crc32_sliced(tables, data, size);
+}
+
+uint32_t crc32c(const unsigned char* data, std::size_t size) {
+#ifdef MM_HAVE_SSE42_CRC
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) {
+        return crc32c_sse42(data, size);
+    }
+#endif
+    static const slice_tables tables = make_slice_tables(0x82f63b78u);
+    return crc32_sliced(tables, data, size);
+}
+
+uint16_t internet(const unsigned char* data, std::size_t size) {
+    // Sum 32-bit big endian words into 64 bits and fold at the end;
+    // ones-complement addition doesn't care about the grouping
+    uint64_t sum = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        sum += (uint32_t(data[i]) << 24) | (uint32_t(data[i + 1]) << 16) | (uint32_t(data[i + 2]) << 8) | data[i + 3];
+    }
+    for (; i + 2 <= size; i += 2) {
+        sum += (uint32_t(data[i]) << 8) | data[i + 1];
+    }
+    if (i < size) {
+        sum += uint32_t(data[i]) << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return uint16_t(~sum);
+}
+
+}
@@ -0,0 +1,510 @@
+#include <mm/mutators/expression.hpp>
+#include <mm/mutators/field_index.hpp>
+#include <mm/mutators/generated_accessors.hpp>
+
+#include <cctype>
+#include <cmath>
+#include <limits>
+
+namespace mm::mutators {
+
+namespace {
+
+using insn = expression_insn;
+
+bool is_floating(int type) {
+    return type == FLOAT_TYPE || type == DOUBLE_TYPE;
+}
+
+// Same semantics at compile time (folding) and run time
+expression_value apply_op(uint8_t op, expression_value a, expression_value b, bool floating) {
+    expression_value r{};
+    if (floating) {
+        switch (op) {
+            case insn::ADD: r.d = a.d + b.d; break;
+            case insn::SUB: r.d = a.d - b.d; break;
+            case insn::MUL: r.d = a.d * b.d; break;
+            case insn::DIV: r.d = a.d / b.d; break;
+            case insn::MOD: r.d = std::fmod(a.d, b.d); break;
+            case insn::NEG: r.d = -a.d; break;
+        }
+        return r;
+    }
+    // Two's complement wrap-around, like the fields themselves. Division
+    // by zero gives 0 rather than a SIGFPE on the receive thread.
+    const uint64_t ua = uint64_t(a.i), ub = uint64_t(b.i);
+    switch (op) {
+        case insn::ADD: r.i = int64_t(ua + ub); break;
+        case insn::SUB: r.i = int64_t(ua - ub); break;
+        case insn::MUL: r.i = int64_t(ua * ub); break;
+        case insn::DIV: r.i = b.i == 0 ? 0 : b.i == -1 ? int64_t(0 - ua) : a.i / b.i; break;
+        case insn::MOD: r.i = (b.i == 0 || b.i == -1) ? 0 : a.i % b.i; break;
+        case insn::NEG: r.i = int64_t(0 - ua); break;
+    }
+    return r;
+}
+
+template<typename T>
+T load(const unsigned char* p, bool swap) {
+    T v;
+    std::memcpy(&v, p, sizeof(T));
+    return swap ? mm::generated::byteswap(v) : v;
+}
+
+template<typename T>
+void store(unsigned char* p, T v, bool swap) {
+    if (swap) {
+        v = mm::generated::byteswap(v);
+    }
+    std::memcpy(p, &v, sizeof(T));
+}
+
+template<typename T>
+expression_value load_as(const unsigned char* p, bool swap, bool floating) {
+    const T v = load<T>(p, swap);
+    expression_value r{};
+    if (floating) {
+        r.d = double(v);
+    }
+    else {
+        r.i = int64_t(v);
+    }
+    return r;
+}
+
+template<typename T>
+T saturate(double v) {
+    if constexpr (std::is_floating_point<T>::value) {
+        return T(v);
+    }
+    else {
+        if (std::isnan(v)) {
+            return 0;
+        }
+        if (v <= double(std::numeric_limits<T>::min())) {
+            return std::numeric_limits<T>::min();
+        }
+        if (v >= double(std::numeric_limits<T>::max())) {
+            return std::numeric_limits<T>::max();
+        }
+        return T(v);
+    }
+}
+
+template<typename T>
+void store_from(unsigned char* p, expression_value v, bool swap, bool floating) {
+    store<T>(p, floating ? saturate<T>(v.d) : T(v.i), swap);
+}
+
+expression_value load_field(const unsigned char* p, int type, bool swap, bool floating) {
+    switch (type) {
+        case CHAR_TYPE:   return load_as<int8_t>(p, swap, floating);
+        case SHORT_TYPE:  return load_as<int16_t>(p, swap, floating);
+        case INT_TYPE:    return load_as<int32_t>(p, swap, floating);
+        case LONG_TYPE:   return load_as<int64_t>(p, swap, floating);
+        case UCHAR_TYPE:  return load_as<uint8_t>(p, swap, floating);
+        case USHORT_TYPE: return load_as<uint16_t>(p, swap, floating);
+        case UINT_TYPE:   return load_as<uint32_t>(p, swap, floating);
+        case ULONG_TYPE:  return load_as<uint64_t>(p, swap, floating);
+        case FLOAT_TYPE:  return load_as<float>(p, swap, floating);
+        case DOUBLE_TYPE: return load_as<double>(p, swap, floating);
+        default:          return expression_value{};
+    }
+}
+
+void store_field(unsigned char* p, int type, expression_value v, bool swap, bool floating) {
+    switch (type) {
+        case CHAR_TYPE:   store_from<int8_t>(p, v, swap, floating); break;
+        case SHORT_TYPE:  store_from<int16_t>(p, v, swap, floating); break;
+        case INT_TYPE:    store_from<int32_t>(p, v, swap, floating); break;
+        case LONG_TYPE:   store_from<int64_t>(p, v, swap, floating); break;
+        case UCHAR_TYPE:  store_from<uint8_t>(p, v, swap, floating); break;
+        case USHORT_TYPE: store_from<uint16_t>(p, v, swap, floating); break;
+        case UINT_TYPE:   store_from<uint32_t>(p, v, swap, floating); break;
+        case ULONG_TYPE:  store_from<uint64_t>(p, v, swap, floating); break;
+        case FLOAT_TYPE:  store_from<float>(p, v, swap, floating); break;
+        case DOUBLE_TYPE: store_from<double>(p, v, swap, floating); break;
+        default: break;
+    }
+}
+
+struct token {
+    enum kind_t { END, NUMBER, NAME, SYMBOL } kind;
+    std::string text;
+};
+
+bool tokenize(const std::string& text, std::vector<token>& out) {
+    std::size_t i = 0;
+    while (i < text.size()) {
+        const char c = text[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        }
+        else if (std::isdigit(static_cast<unsigned char>(c)) || (c == '.' && i + 1 < text.size() && std::isdigit(static_cast<unsigned char>(text[i + 1])))) {
+            std::size_t j = i;
+            while (j < text.size() && (std::isalnum(static_cast<unsigned char>(text[j])) || text[j] == '.' ||
+                   ((text[j] == '+' || text[j] == '-') && (text[j - 1] == 'e' || text[j - 1] == 'E') &&
+                    text.compare(i, 2, "0x") != 0 && text.compare(i, 2, "0X") != 0))) {
+                ++j;
+            }
+            out.push_back({token::NUMBER, text.substr(i, j - i)});
+            i = j;
+        }
+        else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            std::size_t j = i;
+            while (j < text.size() && (std::isalnum(static_cast<unsigned char>(text[j])) || text[j] == '_' || text[j] == '.')) {
+                ++j;
+            }
+            out.push_back({token::NAME, text.substr(i, j - i)});
+            i = j;
+        }
+        else if (std::string("+-*/%()").find(c) != std::string::npos) {
+            out.push_back({token::SYMBOL, std::string(1, c)});
+            ++i;
+        }
+        else {
+            spdlog::error("Unexpected '{}' in expression \"{}\"", c, text);
+            return false;
+        }
+    }
+    out.push_back({token::END, ""});
+    return true;
+}
+
+bool is_float_literal(const std::string& s) {
+    if (s.size() > 1 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        return false;
+    }
+    return s.find_first_of(".eE") != std::string::npos;
+}
+
+int64_t elapsed_unit(const std::string& name) {
+    if (name == "elapsed_s")  return 1000000000;
+    if (name == "elapsed_ms") return 1000000;
+    if (name == "elapsed_us") return 1000;
+    return 0;
+}
+
+// Recursive descent straight to register code. Operands stay immediates
+// as long as possible so constant subexpressions fold; an operand parsed
+// with register r lands in r when it needs one.
+class compiler {
+public:
+    compiler(const std::string& text, const field_index& fields, Mutation& m, int32_t& next_counter_slot)
+        :text(text), fields(fields), m(m), next_counter_slot(next_counter_slot) {}
+
+    bool run() {
+        if (!tokenize(text, tokens)) {
+            return false;
+        }
+        prog.floating = is_floating(m.type);
+        for (const auto& t : tokens) {
+            if (t.kind == token::NUMBER && is_float_literal(t.text)) {
+                prog.floating = true;
+            }
+            if (t.kind == token::NAME && t.text == "elapsed_s") {
+                prog.floating = true;
+            }
+            if (t.kind == token::NAME && t.text != "value" && t.text != "counter" && !elapsed_unit(t.text)) {
+                const packet_description::field* f = fields.find(t.text);
+                if (!f) {
+                    return false;
+                }
+                prog.floating = prog.floating || is_floating(f->type);
+            }
+        }
+
+        operand result = sum(0);
+        if (!ok) {
+            return false;
+        }
+        if (tokens[pos].kind != token::END) {
+            return fail("unexpected '" + tokens[pos].text + "'");
+        }
+
+        if (!result.in_register) {
+            // Folded: an ordinary constant mutation
+            const expression_value v = result.value;
+            m.new_value_d = prog.floating ? v.d : double(v.i);
+            m.new_value_i = prog.floating ? saturate<int64_t>(v.d) : v.i;
+            m.new_value_u = prog.floating ? saturate<uint64_t>(v.d) : uint64_t(v.i);
+            m.program = expression{};
+            return true;
+        }
+        m.program = std::move(prog);
+        return true;
+    }
+
+private:
+    struct operand {
+        bool in_register;
+        expression_value value;  // when !in_register
+    };
+
+    operand sum(int reg) {
+        operand lhs = product(reg);
+        while (ok && is_symbol("+-")) {
+            const uint8_t op = tokens[pos++].text == "+" ? insn::ADD : insn::SUB;
+            lhs = binary(op, lhs, product(reg + 1), reg);
+        }
+        return lhs;
+    }
+
+    operand product(int reg) {
+        operand lhs = unary(reg);
+        while (ok && is_symbol("*/%")) {
+            const char c = tokens[pos++].text[0];
+            const uint8_t op = c == '*' ? insn::MUL : c == '/' ? insn::DIV : insn::MOD;
+            lhs = binary(op, lhs, unary(reg + 1), reg);
+        }
+        return lhs;
+    }
+
+    operand unary(int reg) {
+        if (is_symbol("-")) {
+            ++pos;
+            operand v = unary(reg);
+            if (!v.in_register) {
+                return {false, apply_op(insn::NEG, v.value, {}, prog.floating)};
+            }
+            emit({insn::NEG, uint8_t(reg), uint8_t(reg), 0, 0, 0, 0, {}});
+            return v;
+        }
+        if (is_symbol("+")) {
+            ++pos;
+            return unary(reg);
+        }
+        return primary(reg);
+    }
+
+    operand primary(int reg) {
+        if (reg >= expression::REGISTERS) {
+            fail("too deeply nested");
+            return {};
+        }
+        const token& t = tokens[pos];
+        if (t.kind == token::SYMBOL && t.text == "(") {
+            ++pos;
+            operand v = sum(reg);
+            if (ok && !is_symbol(")")) {
+                fail("missing ')'");
+            }
+            ++pos;
+            return v;
+        }
+        if (t.kind == token::NUMBER) {
+            ++pos;
+            return {false, number(t.text)};
+        }
+        if (t.kind != token::NAME) {
+            fail(t.kind == token::END ? "unexpected end" : "unexpected '" + t.text + "'");
+            return {};
+        }
+        ++pos;
+
+        insn in{};
+        in.dst = uint8_t(reg);
+        if (t.text == "value") {
+            in.op = insn::LOAD_FIELD;
+            in.flags = insn::TARGET;
+            in.offset = m.data_offset;
+            in.type = m.type;
+            if (m.mask) {
+                in.flags |= insn::BITS;
+                in.a = m.shift;
+                in.imm.i = int64_t(m.mask);
+            }
+        }
+        else if (t.text == "counter") {
+            in.op = insn::LOAD_COUNTER;
+            if (prog.counter_slot < 0) {
+                prog.counter_slot = next_counter_slot++;
+            }
+        }
+        else if (int64_t unit = elapsed_unit(t.text)) {
+            in.op = insn::LOAD_ELAPSED;
+            in.imm.i = unit;
+            prog.uses_clock = true;
+        }
+        else {
+            const packet_description::field* f = fields.find(t.text);
+            if (!f) {
+                fail("unknown field " + t.text);
+                return {};
+            }
+            if (f->type == ARRAY_TYPE || f->type == INVALID_DATA_TYPE) {
+                fail(t.text + " is not a number");
+                return {};
+            }
+            if (f->anchor >= 0) {
+                fail(t.text + " has no fixed offset");
+                return {};
+            }
+            in.op = insn::LOAD_FIELD;
+            in.offset = f->offset;
+            in.type = f->type;
+            if (f->bit_width) {
+                in.flags = insn::BITS;
+                in.a = f->bit_offset;
+                in.imm.i = int64_t((f->bit_width == 64 ? ~0ull : (1ull << f->bit_width) - 1) << f->bit_offset);
+            }
+        }
+        emit(in);
+        return {true, {}};
+    }
+
+    operand binary(uint8_t op, operand lhs, operand rhs, int reg) {
+        if (!ok) {
+            return {};
+        }
+        if (!lhs.in_register && !rhs.in_register) {
+            return {false, apply_op(op, lhs.value, rhs.value, prog.floating)};
+        }
+        if (!lhs.in_register) {
+            // rhs sits in reg + 1; the constant has to be loaded on the left
+            insn load{};
+            load.op = insn::LOAD_IMM;
+            load.dst = uint8_t(reg);
+            load.imm = lhs.value;
+            emit(load);
+        }
+        insn in{};
+        in.op = op;
+        in.dst = uint8_t(reg);
+        in.a = uint8_t(reg);
+        if (rhs.in_register) {
+            in.b = uint8_t(reg + 1);
+        }
+        else {
+            in.flags = insn::IMM_B;
+            in.imm = rhs.value;
+        }
+        emit(in);
+        return {true, {}};
+    }
+
+    expression_value number(const std::string& s) {
+        expression_value v{};
+        try {
+            // The whole token must parse; a leading 0 is decimal, not octal
+            std::size_t used = 0;
+            if (is_float_literal(s)) {
+                v.d = std::stod(s, &used);
+                if (used != s.size()) {
+                    fail("bad number " + s);
+                }
+                return v;
+            }
+            const bool hex = s.size() > 1 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+            const uint64_t u = std::stoull(hex ? s.substr(2) : s, &used, hex ? 16 : 10);
+            if (used != s.size() - (hex ? 2 : 0) || !std::isxdigit(static_cast<unsigned char>(s[hex ? 2 : 0]))) {
+                fail("bad number " + s);
+            }
+            if (prog.floating) {
+                v.d = double(u);
+            }
+            else {
+                v.i = int64_t(u);
+            }
+        }
+        catch (...) {
+            fail("bad number " + s);
+        }
+        return v;
+    }
+
+    bool is_symbol(const char* set) const {
+        return tokens[pos].kind == token::SYMBOL && std::string(set).find(tokens[pos].text[0]) != std::string::npos;
+    }
+
+    void emit(const insn& in) {
+        prog.code.push_back(in);
+    }
+
+    bool fail(const std::string& why) {
+        if (ok) {
+            spdlog::error("Failed to compile expression \"{}\": {}", text, why);
+        }
+        ok = false;
+        return false;
+    }
+
+    const std::string& text;
+    const field_index& fields;
+    Mutation& m;
+    int32_t& next_counter_slot;
+
+    std::vector<token> tokens;
+    std::size_t pos = 0;
+    expression prog;
+    bool ok = true;
+};
+
+}
+
+bool compile_expression(const std::string& text, const field_index& fields, Mutation& m, int32_t& next_counter_slot) {
+    return compiler(text, fields, m, next_counter_slot).run();
+}
+
+void run_expression(const Mutation& m, unsigned char* packet, unsigned char* target, bool to_network_byte_order, const expression_context& ctx) {
+    const expression& prog = m.program;
+    const bool fp = prog.floating;
+    expression_value r[expression::REGISTERS];
+    for (const insn& in : prog.code) {
+        switch (in.op) {
+            case insn::LOAD_IMM:
+                r[in.dst] = in.imm;
+                break;
+            case insn::LOAD_FIELD:
+                r[in.dst] = load_field(((in.flags & insn::TARGET) ? target : packet) + in.offset, in.type, to_network_byte_order, fp && !(in.flags & insn::BITS));
+                if (in.flags & insn::BITS) {
+                    const uint64_t bits = (uint64_t(r[in.dst].i) & uint64_t(in.imm.i)) >> in.a;
+                    if (fp) r[in.dst].d = double(bits);
+                    else    r[in.dst].i = int64_t(bits);
+                }
+                break;
+            case insn::LOAD_COUNTER:
+                if (fp) r[in.dst].d = double(ctx.counter);
+                else    r[in.dst].i = int64_t(ctx.counter);
+                break;
+            case insn::LOAD_ELAPSED:
+                if (fp) r[in.dst].d = double(ctx.elapsed_ns) / double(in.imm.i);
+                else    r[in.dst].i = ctx.elapsed_ns / in.imm.i;
+                break;
+            default:
+                r[in.dst] = apply_op(in.op, r[in.a], (in.flags & insn::IMM_B) ? in.imm : r[in.b], fp);
+                break;
+        }
+    }
+    if (m.mask) {
+        // Bitfield target: merge the result into its word
+        const uint64_t value = fp ? uint64_t(saturate<int64_t>(r[0].d)) : uint64_t(r[0].i);
+        expression_value word = load_field(target + m.data_offset, m.type, to_network_byte_order, false);
+        word.i = int64_t((uint64_t(word.i) & ~m.mask) | ((value << m.shift) & m.mask));
+        store_field(target + m.data_offset, m.type, word, to_network_byte_order, false);
+        return;
+    }
+    store_field(target + m.data_offset, m.type, r[0], to_network_byte_order, fp);
+}
+
+uint64_t flow_counters::next(const mm::network::Endpoint* sender, int32_t slot) {
+    const mm::network::flow_key key = sender ? mm::network::flow_key(*sender) : mm::network::flow_key();
+    shard& s = shards[key.hash() % SHARDS];
+    std::lock_guard<std::mutex> lk(s.mutex);
+    auto it = s.flows.find(key);
+    if (it == s.flows.end()) {
+        if (s.flows.size() >= MAX_FLOWS_PER_SHARD) {
+            // Senders come and go; starting their counts over beats growing forever
+            spdlog::debug("Expression counters full, resetting {} flows", s.flows.size());
+            s.flows.clear();
+        }
+        it = s.flows.emplace(key, std::vector<uint64_t>()).first;
+    }
+    auto& counts = it->second;
+    if (std::size_t(slot) >= counts.size()) {
+        counts.resize(slot + 1);
+    }
+    return counts[slot]++;
+}
+
+}
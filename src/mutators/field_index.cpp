@@ -0,0 +1,78 @@
+#include <mm/mutators/field_index.hpp>
+
+#include <algorithm>
+
+namespace mm::mutators {
+
+static bool entry_less(const field_index::entry& a, const field_index::entry& b) {
+    return a.key < b.key;
+}
+
+void field_index::build(const packet_types& types) {
+    qualified.clear();
+    aliases.clear();
+
+    for (const auto& packet : types) {
+        for (const auto& f : packet.fields) {
+            qualified.push_back({packet.name + "." + f.name, &packet, &f});
+            aliases.push_back({f.name, &packet, &f});
+        }
+    }
+
+    // stable so the first PDU (and first duplicate within a PDU) wins ties
+    std::stable_sort(qualified.begin(), qualified.end(), entry_less);
+    qualified.erase(std::unique(qualified.begin(), qualified.end(),
+                                [](const entry& a, const entry& b) { return a.key == b.key; }),
+                    qualified.end());
+
+    std::stable_sort(aliases.begin(), aliases.end(), entry_less);
+    std::vector<entry> merged;
+    merged.reserve(aliases.size());
+    for (const auto& e : aliases) {
+        if (!merged.empty() && merged.back().key == e.key) {
+            auto& prev = merged.back();
+            // an anchored offset only means something within its own packet
+            if (prev.field && (prev.field->offset != e.field->offset || prev.field->type != e.field->type ||
+                               prev.field->bit_offset != e.field->bit_offset || prev.field->bit_width != e.field->bit_width ||
+                               prev.field->anchor >= 0 || e.field->anchor >= 0)) {
+                prev.field = nullptr;
+            }
+            continue;
+        }
+        merged.push_back(e);
+    }
+    aliases = std::move(merged);
+
+    spdlog::debug("field index: {} qualified names, {} aliases", qualified.size(), aliases.size());
+}
+
+const field_index::entry* field_index::lookup(const std::vector<entry>& table, const std::string& key) {
+    auto it = std::lower_bound(table.begin(), table.end(), key,
+                               [](const entry& e, const std::string& k) { return e.key < k; });
+    if (it != table.end() && it->key == key) {
+        return &*it;
+    }
+    return nullptr;
+}
+
+const field_index::entry* field_index::find_entry(const std::string& name) const {
+    if (const entry* e = lookup(qualified, name)) {
+        return e;
+    }
+    if (const entry* e = lookup(aliases, name)) {
+        if (!e->field) {
+            spdlog::error("field {} is ambiguous across packet types, qualify it as <packet>.{}", name, name);
+            return nullptr;
+        }
+        return e;
+    }
+    spdlog::error("could not find field " + name);
+    return nullptr;
+}
+
+const packet_description::field* field_index::find(const std::string& name) const {
+    const entry* e = find_entry(name);
+    return e ? e->field : nullptr;
+}
+
+}
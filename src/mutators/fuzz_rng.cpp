@@ -0,0 +1,120 @@
+#include <mm/mutators/fuzz_rng.hpp>
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MM_HAVE_AVX2_FILL 1
+#endif
+
+namespace mm::mutators {
+
+namespace {
+
+uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// lanes[word][lane]: word k of each generator's state, so lane i's state
+// is lanes[0][i]..lanes[3][i]. Writes 32 bytes per step, lane 0 first.
+void fill_lanes_scalar(uint64_t (&lanes)[4][4], unsigned char* out, std::size_t steps) {
+    for (std::size_t n = 0; n < steps; ++n, out += 32) {
+        uint64_t words[4];
+        for (int i = 0; i < 4; ++i) {
+            uint64_t* s0 = &lanes[0][i];
+            uint64_t* s1 = &lanes[1][i];
+            uint64_t* s2 = &lanes[2][i];
+            uint64_t* s3 = &lanes[3][i];
+            words[i] = rotl(*s1 * 5, 7) * 9;
+            const uint64_t t = *s1 << 17;
+            *s2 ^= *s0;
+            *s3 ^= *s1;
+            *s1 ^= *s2;
+            *s0 ^= *s3;
+            *s2 ^= t;
+            *s3 = rotl(*s3, 45);
+        }
+        std::memcpy(out, words, 32);
+    }
+}
+
+#ifdef MM_HAVE_AVX2_FILL
+// The multiplies by 5 and 9 are shift-and-adds, which AVX2 has for 64-bit lanes
+__attribute__((target("avx2")))
+void fill_lanes_avx2(uint64_t (&lanes)[4][4], unsigned char* out, std::size_t steps) {
+    __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes[0]));
+    __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes[1]));
+    __m256i s2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes[2]));
+    __m256i s3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes[3]));
+    for (std::size_t n = 0; n < steps; ++n, out += 32) {
+        __m256i x = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+        x = _mm256_or_si256(_mm256_slli_epi64(x, 7), _mm256_srli_epi64(x, 57));
+        x = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), x);
+
+        const __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[0]), s0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[1]), s1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[2]), s2);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[3]), s3);
+}
+#endif
+
+}
+
+fuzz_rng::fuzz_rng(uint64_t seed, uint64_t index) {
+    uint64_t x = seed ^ splitmix64(index);
+    for (auto& word : s) {
+        word = splitmix64(x);
+    }
+}
+
+void fuzz_rng::fill(unsigned char* out, std::size_t size) {
+    if (size >= 64) {
+        uint64_t lanes[4][4];
+        for (auto& word : lanes) {
+            for (auto& lane : word) {
+                lane = next();
+            }
+        }
+        const std::size_t steps = size / 32;
+#ifdef MM_HAVE_AVX2_FILL
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        if (avx2) {
+            fill_lanes_avx2(lanes, out, steps);
+        }
+        else
+#endif
+        {
+            fill_lanes_scalar(lanes, out, steps);
+        }
+        out += steps * 32;
+        size -= steps * 32;
+    }
+    while (size >= 8) {
+        const uint64_t v = next();
+        std::memcpy(out, &v, 8);
+        out += 8;
+        size -= 8;
+    }
+    if (size) {
+        const uint64_t v = next();
+        std::memcpy(out, &v, size);
+    }
+}
+
+}
@@ -1,6 +1,22 @@
 #include <mm/mutators/json_rule_based_mutator.hpp>
+#include <mm/mutators/rules_cache.hpp>
+#include <mm/mutators/field_index.hpp>
+#include <mm/mutators/checksum.hpp>
+#include <mm/mutators/byte_search.hpp>
+#include <mm/generated/dis_types.hpp>
 #include <mm/config_reader.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <limits>
+#include <optional>
+#include <random>
+#include <unordered_map>
+
 static void swap_bytes(void *object, size_t size)
 {
 	// Swap the byte order of a given data unit and size to transmit / receive across a network.
@@ -15,62 +31,876 @@ static void swap_bytes(void *object, size_t size)
 	}
 }
 
-static int parse_packets_data_field(const json& data, int offset, std::string field_name_prefix, std::vector<packet_description::field>& fields);
-static packet_types packet_description_from_json(json j);
 
 
 namespace mm::mutators {
 
 
-json_rule_based_mutator::json_rule_based_mutator(const std::string& typesfile, const std::string& rulefile, bool to_big_endian) {
+json_rule_based_mutator::json_rule_based_mutator(const std::string& typesfile, const std::string& rulefile, bool to_big_endian)
+    :json_rule_based_mutator(to_big_endian) {
+
+    std::string rules_text = rulefile.empty() ? std::string() : read_file(rulefile);
+    load(typesfile, read_file(typesfile), rules_text, (rulefile.empty() ? typesfile : rulefile) + ".mmcache");
+}
+
+json_rule_based_mutator::json_rule_based_mutator(bool to_big_endian)
+    :next_mutation(nullptr)
+    ,to_network_byte_order(to_big_endian)
+    ,fuzz_seed((uint64_t(std::random_device{}()) << 32) | std::random_device{}()) {
+}
+
+void json_rule_based_mutator::load(const std::string& typesfile,
+                                   const std::string& types_text,
+                                   const std::string& rules_text,
+                                   const std::string& cache_file) {
+    const uint64_t hash = rules_cache::source_hash(types_text, rules_text);
+    if (rules_cache::load(cache_file, hash, packet_types_list, rules)) {
+        spdlog::info("Loaded compiled types and rules from {}", cache_file);
+        bind_generated_accessors();
+        bind_derived_fields();
+        bind_dynamic_sections();
+        bind_payload_patterns();
+        bind_sender_scopes();
+        bind_schedule();
+        bind_fuzz();
+        return;
+    }
 
     spdlog::info("Parsing types file: " + typesfile);
-    packet_types_list = packet_description_from_json(read_configuration(typesfile));
+    packet_types_list = packet_description_from_json(json::parse(types_text));
     for (auto& ptl : packet_types_list) {
-        spdlog::info(ptl.dump());
+        spdlog::debug(ptl.dump());
     }
 
-    if (!rulefile.empty()) {
-        spdlog::info("Parsing rules file: " + rulefile);
-        rules = parse_rules(packet_types_list, read_configuration(rulefile));
+    if (!rules_text.empty()) {
+        spdlog::info("Parsing rules");
+        rules = parse_rules(packet_types_list, field_index(packet_types_list), json::parse(rules_text));
     }
-    next_mutation = nullptr;
 
-    to_network_byte_order = to_big_endian;
+    if (!rules_cache::store(cache_file, hash, packet_types_list, rules)) {
+        spdlog::debug("Could not write rules cache {}", cache_file);
+    }
+    bind_generated_accessors();
+    bind_derived_fields();
+    bind_dynamic_sections();
+    bind_payload_patterns();
+    bind_sender_scopes();
+    bind_schedule();
+    bind_fuzz();
 }
 
-static const packet_description::field* get_field_ptr(const std::string& field_name, const packet_types& types_list) {
-    for (const auto& packet_type : types_list) {
-        // for (const auto& f : packet_type.fields) {
-        //     if (f.name == field_name) {
-        //         return &f;
-        //     }
-        // }
-        auto iter = packet_type.fields_map.find(field_name);
-        if (iter != packet_type.fields_map.end()) {
-            return iter->second;
+// Accessors generated from dis_types.json are only a function of offset and
+// type, so any condition or mutation with a matching pair can use them,
+// whichever types file it was parsed against. They read big endian data.
+static const mm::generated::accessor* find_generated_accessor(int offset, data_type type) {
+    namespace gen = mm::generated::dis_types;
+    for (std::size_t i = 0; i < gen::accessor_count; ++i) {
+        if (gen::accessors[i].offset == offset && gen::accessors[i].type == type) {
+            return &gen::accessors[i];
         }
     }
-    spdlog::error("could not find field " + field_name);
     return nullptr;
 }
 
-std::vector<Rule> json_rule_based_mutator::parse_rules(const packet_types& packet_types, json data) {
-    spdlog::info(data.dump(2));
+void json_rule_based_mutator::bind_generated_accessors() {
+    if (!to_network_byte_order) {
+        return;
+    }
+    int bound = 0;
+    for (auto& rule : rules) {
+        for (auto& condition : rule.conditions) {
+            if (condition.anchor.packet >= 0 || condition.mask) {
+                continue;
+            }
+            if (const auto* a = find_generated_accessor(condition.data_offset, condition.type)) {
+                condition.evaluate = a->condition_for(condition.operation);
+                bound += condition.evaluate != nullptr;
+            }
+        }
+        for (auto& mutation : rule.mutations) {
+            if (!mutation.program.empty() || mutation.fuzz.kind || mutation.anchor.packet >= 0 || mutation.mask) {
+                continue;
+            }
+            if (const auto* a = find_generated_accessor(mutation.data_offset, mutation.type)) {
+                mutation.apply = a->store;
+                ++bound;
+            }
+        }
+    }
+    spdlog::debug("Bound {} conditions/mutations to generated accessors", bound);
+}
+
+static bool overlaps(int begin, int end, int other_begin, int other_end) {
+    return begin < other_end && other_begin < end;
+}
+
+static int range_end(const derived_field& d) {
+    return d.range_end < 0 ? std::numeric_limits<int>::max() : d.range_end;
+}
+
+// The opcode field that tells a packet's type apart, if it has one
+static void find_opcode_field(const packet_description& pd, int& offset, data_type& type) {
+    offset = -1;
+    type = INVALID_DATA_TYPE;
+    for (const auto& f : pd.fields) {
+        if (f.name == pd.opcode_field && f.type != ARRAY_TYPE && f.anchor < 0) {
+            offset = f.offset;
+            type = f.type;
+        }
+    }
+}
+
+void json_rule_based_mutator::bind_derived_fields() {
+    derived_sets.clear();
+    int bit = 0;
+    for (const auto& pd : packet_types_list) {
+        if (pd.derived.empty()) {
+            continue;
+        }
+        derived_set set{-1, INVALID_DATA_TYPE, pd.opcode, {}, {}, {}, 0};
+        find_opcode_field(pd, set.opcode_offset, set.opcode_type);
+        // A field whose range covers another derived field goes after it.
+        // With a cycle (two checksums covering each other) the declaration
+        // order decides.
+        std::vector<derived_field> pending = pd.derived, ordered;
+        while (!pending.empty()) {
+            auto next = std::find_if(pending.begin(), pending.end(), [&](const derived_field& d) {
+                return d.kind == derived_field::LENGTH ||
+                       std::none_of(pending.begin(), pending.end(), [&](const derived_field& other) {
+                           return &other != &d && overlaps(other.offset, other.offset + other.size, d.range_begin, range_end(d));
+                       });
+            });
+            if (next == pending.end()) {
+                next = pending.begin();
+            }
+            ordered.push_back(*next);
+            pending.erase(next);
+        }
+        for (const auto& d : ordered) {
+            if (bit == 64) {
+                spdlog::error("More than 64 derived fields, ignoring the rest from {} on", pd.name);
+                break;
+            }
+            set.fields.push_back(d);
+            set.bits.push_back(1ull << bit++);
+            set.mask |= set.bits.back();
+        }
+        // Recomputing one field can stale a later one whose range covers it
+        set.dependents.assign(set.fields.size(), 0);
+        for (std::size_t i = 0; i < set.fields.size(); ++i) {
+            const derived_field& d = set.fields[i];
+            for (std::size_t j = i + 1; j < set.fields.size(); ++j) {
+                const derived_field& later = set.fields[j];
+                if (later.kind != derived_field::LENGTH &&
+                    overlaps(d.offset, d.offset + d.size, later.range_begin, range_end(later))) {
+                    set.dependents[i] |= set.bits[j];
+                }
+            }
+        }
+        derived_sets.push_back(std::move(set));
+    }
+
+    for (auto& rule : rules) {
+        rule.touches_derived = 0;
+        rule.sets_derived = 0;
+        for (const auto& m : rule.mutations) {
+            if (m.anchor.packet >= 0) {
+                // Could be anywhere; lengths and checksums up to the end
+                // of the packet cover it, but any of them might
+                for (const auto& set : derived_sets) {
+                    rule.touches_derived |= set.mask;
+                }
+                continue;
+            }
+            if (m.fuzz.kind && m.data_size == 0) {
+                // Whole-datagram fuzzing or truncation: leave the damage be
+                for (const auto& set : derived_sets) {
+                    rule.sets_derived |= set.mask;
+                }
+                continue;
+            }
+            const int begin = m.data_offset, end = m.data_offset + m.data_size;
+            for (const auto& set : derived_sets) {
+                for (std::size_t i = 0; i < set.fields.size(); ++i) {
+                    const derived_field& d = set.fields[i];
+                    if (overlaps(begin, end, d.offset, d.offset + d.size)) {
+                        rule.sets_derived |= set.bits[i];
+                    }
+                    else if (d.kind == derived_field::LENGTH || overlaps(begin, end, d.range_begin, range_end(d))) {
+                        rule.touches_derived |= set.bits[i];
+                    }
+                }
+            }
+        }
+    }
+    if (!derived_sets.empty()) {
+        spdlog::debug("{} derived fields over {} packet types", bit, derived_sets.size());
+    }
+}
+
+static uint64_t read_unsigned(const unsigned char* p, int size, bool byteswap) {
+    unsigned char bytes[8];
+    std::memcpy(bytes, p, size);
+    if (byteswap) {
+        swap_bytes(bytes, size);
+    }
+    switch (size) {
+        case 1: return bytes[0];
+        case 2: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case 4: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case 8: { uint64_t v; std::memcpy(&v, bytes, 8); return v; }
+        default: return 0;
+    }
+}
+
+static void write_unsigned(unsigned char* p, int size, uint64_t value, bool byteswap) {
+    switch (size) {
+        case 1: { uint8_t v = uint8_t(value); std::memcpy(p, &v, 1); break; }
+        case 2: { uint16_t v = uint16_t(value); std::memcpy(p, &v, 2); break; }
+        case 4: { uint32_t v = uint32_t(value); std::memcpy(p, &v, 4); break; }
+        case 8: { std::memcpy(p, &value, 8); break; }
+        default: return;
+    }
+    if (byteswap) {
+        swap_bytes(p, size);
+    }
+}
+
+void json_rule_based_mutator::bind_payload_patterns() {
+    payload.clear();
+    std::size_t slot = 0, num_patterns = 0;
+    for (auto& rule : rules) {
+        for (auto& condition : rule.conditions) {
+            if (condition.operation != OP_PAYLOAD) {
+                continue;
+            }
+            // past MAX_SLOTS the slot is out of range and never matches
+            condition.value_u = slot++;
+            for (const auto& p : condition.patterns) {
+                payload.add(p, condition.value_u);
+            }
+            num_patterns += condition.patterns.size();
+        }
+    }
+    if (slot > payload_matcher::MAX_SLOTS) {
+        spdlog::error("{} payload conditions, only the first {} can match", slot, payload_matcher::MAX_SLOTS);
+    }
+    payload.build();
+    if (slot) {
+        spdlog::debug("{} payload conditions with {} patterns", slot, num_patterns);
+    }
+}
+
+void json_rule_based_mutator::bind_sender_scopes() {
+    senders.clear();
+    for (std::size_t i = 0; i < rules.size(); ++i) {
+        if (rules[i].from.empty()) {
+            senders.add_any(i);
+        }
+        for (const auto& scope : rules[i].from) {
+            senders.add(scope, i);
+        }
+    }
+    senders.build(rules.size());
+}
+
+void json_rule_based_mutator::bind_schedule() {
+    std::vector<rule_activation> activations;
+    std::vector<std::string> names;
+    for (const auto& rule : rules) {
+        activations.push_back(rule.active);
+        names.push_back(rule.name);
+    }
+    schedule.build(activations, names, loaded_at);
+}
+
+void json_rule_based_mutator::attach(boost::asio::io_context& ctx) {
+    schedule.start(ctx);
+}
+
+void json_rule_based_mutator::bind_fuzz() {
+    fuzzing = std::any_of(rules.begin(), rules.end(), [](const Rule& rule) {
+        return rule.probability < 1 || std::any_of(rule.mutations.begin(), rule.mutations.end(),
+                                                   [](const Mutation& m) { return m.fuzz.kind != fuzz_spec::NONE; });
+    });
+    if (fuzzing) {
+        spdlog::info("Fuzzing with seed {}; packets are numbered from 0 in receive order, "
+                     "fuzzed ones log their number at debug level", fuzz_seed);
+    }
+}
+
+void json_rule_based_mutator::set_fuzz_seed(uint64_t seed) {
+    fuzz_seed = seed;
+    fuzz_packets = 0;
+    if (fuzzing) {
+        spdlog::info("Fuzzing with seed {}", fuzz_seed);
+    }
+}
+
+// Where one packet's dynamic sections are. Lives for one run_rules call
+// and is filled in on the first anchored condition or mutation, so a
+// packet is walked at most once however many rules look into it (again
+// only after a rule rewrote a count).
+class json_rule_based_mutator::layout_cache {
+public:
+    static constexpr int MAX_SECTIONS = 16;
+
+    explicit layout_cache(const json_rule_based_mutator& mutator) : mutator(mutator) {}
+
+    void invalidate() {
+        slot = -1;
+        mismatched = 0;
+    }
+
+    // Offset in the packet that an anchored data_offset counts from, or -1
+    // when the packet isn't of the anchor's type or is too short for the
+    // element and the extent bytes past it. span, if given, is set to the
+    // bytes from there to the end of a blob, or of the packet.
+    long resolve(const unsigned char* packet, std::size_t bytes, const field_anchor& a, int extent, std::size_t* span = nullptr) {
+        if (std::size_t(a.packet) >= mutator.dynamic_slot.size()) {
+            return -1;
+        }
+        const int s = mutator.dynamic_slot[a.packet];
+        if (s < 0) {
+            return -1;
+        }
+        if (s != slot) {
+            const uint64_t bit = s < 64 ? 1ull << s : 0;
+            if (mismatched & bit) {
+                return -1;
+            }
+            if (!compute(packet, bytes, s)) {
+                mismatched |= bit;
+                return -1;
+            }
+        }
+        if (a.section < 0 || a.section >= valid) {
+            return -1;
+        }
+        const dynamic_section& sec = mutator.dynamic_types[s].sections[a.section];
+        long base = end[a.section];
+        if (a.element >= 0) {
+            if (std::size_t(a.element) >= count[a.section]) {
+                return -1;
+            }
+            base = start[a.section] + long(a.element) * sec.element_size;
+        }
+        if (std::size_t(base + extent) > bytes) {
+            return -1;
+        }
+        if (span) {
+            *span = (a.element >= 0 && sec.kind == dynamic_section::BLOB ? std::size_t(end[a.section]) : bytes) - base;
+        }
+        return base;
+    }
+
+private:
+    bool compute(const unsigned char* packet, std::size_t bytes, int s) {
+        const dynamic_type& t = mutator.dynamic_types[s];
+        const bool swap = mutator.to_network_byte_order;
+        if (t.opcode_offset >= 0) {
+            const int size = data_size_from_type(t.opcode_type);
+            if (std::size_t(t.opcode_offset + size) > bytes ||
+                read_unsigned(packet + t.opcode_offset, size, swap) != uint64_t(t.opcode)) {
+                return false;
+            }
+        }
+        slot = s;
+        valid = 0;
+        for (const auto& sec : t.sections) {
+            const long at = (sec.anchor < 0 ? 0 : end[sec.anchor]) + sec.offset;
+            const long count_at = (sec.count_anchor < 0 ? 0 : end[sec.count_anchor]) + sec.count_offset;
+            const int count_size = data_size_from_type(sec.count_type);
+            if (std::size_t(count_at + count_size) > bytes) {
+                break;
+            }
+            const uint64_t n = read_unsigned(packet + count_at, count_size, swap);
+            if (n > bytes) {
+                break;
+            }
+            const std::size_t length = sec.kind == dynamic_section::ARRAY
+                                     ? n * sec.element_size
+                                     : (n + sec.length_divisor - 1) / sec.length_divisor;
+            if (std::size_t(at) + length > bytes) {
+                break;
+            }
+            start[valid] = at;
+            end[valid] = at + long(length);
+            count[valid] = sec.kind == dynamic_section::ARRAY ? n : length;
+            ++valid;
+        }
+        return true;
+    }
+
+    const json_rule_based_mutator& mutator;
+    int slot = -1;             // dynamic_types entry the offsets below are for
+    uint64_t mismatched = 0;   // entries whose opcode didn't match
+    int valid = 0;             // sections that fit in the packet
+    long start[MAX_SECTIONS];
+    long end[MAX_SECTIONS];
+    std::size_t count[MAX_SECTIONS];   // elements, or bytes for a blob
+};
+
+void json_rule_based_mutator::bind_dynamic_sections() {
+    dynamic_types.clear();
+    dynamic_slot.assign(packet_types_list.size(), -1);
+    std::vector<std::pair<int, int>> layout_bytes;   // fixed [begin, end) ranges sections are placed by
+    std::vector<bool> chained;                       // a count inside a section moves later sections
+    for (std::size_t i = 0; i < packet_types_list.size(); ++i) {
+        const auto& pd = packet_types_list[i];
+        if (pd.sections.empty()) {
+            continue;
+        }
+        dynamic_type t{-1, INVALID_DATA_TYPE, pd.opcode, pd.sections};
+        find_opcode_field(pd, t.opcode_offset, t.opcode_type);
+        if (t.sections.size() > std::size_t(layout_cache::MAX_SECTIONS)) {
+            spdlog::error("{} has more than {} dynamic sections, ignoring the rest", pd.name, layout_cache::MAX_SECTIONS);
+            t.sections.resize(layout_cache::MAX_SECTIONS);
+        }
+        if (t.opcode_offset >= 0) {
+            layout_bytes.push_back({t.opcode_offset, t.opcode_offset + data_size_from_type(t.opcode_type)});
+        }
+        bool moves = false;
+        for (const auto& sec : t.sections) {
+            if (sec.count_anchor < 0) {
+                layout_bytes.push_back({sec.count_offset, sec.count_offset + data_size_from_type(sec.count_type)});
+            }
+            else {
+                moves = true;
+            }
+        }
+        dynamic_slot[i] = int(dynamic_types.size());
+        chained.push_back(moves);
+        dynamic_types.push_back(std::move(t));
+    }
+
+    for (auto& rule : rules) {
+        rule.touches_layout = false;
+        for (const auto& m : rule.mutations) {
+            if (m.anchor.packet >= 0) {
+                const int slot = std::size_t(m.anchor.packet) < dynamic_slot.size() ? dynamic_slot[m.anchor.packet] : -1;
+                rule.touches_layout = rule.touches_layout || (slot >= 0 && chained[slot]);
+                continue;
+            }
+            if (m.fuzz.kind && m.data_size == 0) {
+                rule.touches_layout = true;
+                continue;
+            }
+            for (const auto& [begin, end] : layout_bytes) {
+                rule.touches_layout = rule.touches_layout || overlaps(m.data_offset, m.data_offset + m.data_size, begin, end);
+            }
+        }
+    }
+    if (!dynamic_types.empty()) {
+        spdlog::debug("{} packet types with dynamic sections", dynamic_types.size());
+    }
+}
+
+// Only the packet type whose opcode matches is recomputed; a rule touching
+// offset N marks every type's fields covering N.
+void json_rule_based_mutator::fix_derived_fields(unsigned char* packet, std::size_t bytes, uint64_t dirty) const {
+    for (const auto& set : derived_sets) {
+        if (!(dirty & set.mask)) {
+            continue;
+        }
+        if (set.opcode_offset >= 0) {
+            const int size = data_size_from_type(set.opcode_type);
+            if (std::size_t(set.opcode_offset + size) > bytes ||
+                read_unsigned(packet + set.opcode_offset, size, to_network_byte_order) != uint64_t(set.opcode)) {
+                continue;
+            }
+        }
+        for (std::size_t i = 0; i < set.fields.size(); ++i) {
+            if (!(dirty & set.bits[i])) {
+                continue;
+            }
+            const derived_field& d = set.fields[i];
+            if (std::size_t(d.offset + d.size) > bytes) {
+                continue;
+            }
+            uint64_t value = 0;
+            if (d.kind == derived_field::LENGTH) {
+                value = uint64_t(int64_t(bytes) + d.adjust);
+            }
+            else {
+                const std::size_t begin = std::min<std::size_t>(d.range_begin, bytes);
+                const std::size_t end = d.range_end < 0 ? bytes : std::min<std::size_t>(d.range_end, bytes);
+                if (begin >= end) {
+                    continue;
+                }
+                std::memset(packet + d.offset, 0, d.size);
+                const unsigned char* data = packet + begin;
+                const std::size_t size = end - begin;
+                switch (d.kind) {
+                    case derived_field::CRC16:             value = checksum::crc16(data, size); break;
+                    case derived_field::CRC32:             value = checksum::crc32(data, size); break;
+                    case derived_field::CRC32C:            value = checksum::crc32c(data, size); break;
+                    case derived_field::INTERNET_CHECKSUM: value = checksum::internet(data, size); break;
+                    default: break;
+                }
+            }
+            write_unsigned(packet + d.offset, d.size, value, to_network_byte_order);
+            dirty |= set.dependents[i];
+        }
+    }
+}
+
+// Looks a rule's field name up. "articulated_parts[2].value" is the
+// articulated_parts[].value field of element 2; an element field named
+// without an index means element 0.
+static const packet_description::field* find_rule_field(const packet_types& types, const field_index& fields, const std::string& name, field_anchor& anchor) {
+    std::string key = name;
+    long element = -1;
+    const auto open = name.find('[');
+    if (open != std::string::npos) {
+        const auto close = name.find(']', open);
+        if (close == std::string::npos) {
+            spdlog::error("Unbalanced [ in field {}", name);
+            return nullptr;
+        }
+        const std::string index = name.substr(open + 1, close - open - 1);
+        if (!index.empty()) {
+            char* index_end = nullptr;
+            element = std::strtol(index.c_str(), &index_end, 10);
+            if (*index_end || element < 0 || element > std::numeric_limits<int32_t>::max()) {
+                spdlog::error("Bad array index in field {}", name);
+                return nullptr;
+            }
+        }
+        key = name.substr(0, open + 1) + name.substr(close);
+    }
+    const field_index::entry* e = fields.find_entry(key);
+    if (!e) {
+        return nullptr;
+    }
+    if (e->field->anchor < 0) {
+        if (element >= 0) {
+            spdlog::error("Field {} is not in an array", name);
+            return nullptr;
+        }
+        return e->field;
+    }
+    anchor.packet = int16_t(e->packet - types.data());
+    anchor.section = int16_t(e->field->anchor);
+    anchor.element = e->field->element ? int32_t(std::max(element, 0L)) : -1;
+    return e->field;
+}
+
+// A byte array value: a string taken byte for byte, an array of byte
+// values, or {"hex": "de ad be ef"}
+static bool parse_bytes(const json& value, std::string& out) {
+    out.clear();
+    if (value.is_string()) {
+        out = value.get<std::string>();
+        return true;
+    }
+    if (value.is_array()) {
+        for (const auto& b : value) {
+            const int v = b.get<int>();
+            if (v < 0 || v > 255) {
+                return false;
+            }
+            out.push_back(char(v));
+        }
+        return true;
+    }
+    if (value.is_object() && value.contains("hex")) {
+        std::string digits;
+        for (char c : value["hex"].get<std::string>()) {
+            if (std::isxdigit(static_cast<unsigned char>(c))) {
+                digits.push_back(c);
+            }
+            else if (!std::isspace(static_cast<unsigned char>(c))) {
+                return false;
+            }
+        }
+        if (digits.size() % 2) {
+            return false;
+        }
+        for (std::size_t i = 0; i < digits.size(); i += 2) {
+            out.push_back(char(std::stoi(digits.substr(i, 2), nullptr, 16)));
+        }
+        return true;
+    }
+    return false;
+}
+
+// "10.0.0.9:3000" or "[::1]:3000"
+static bool parse_endpoint(const std::string& text, mm::network::Endpoint& out) {
+    const auto colon = text.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    std::string host = text.substr(0, colon);
+    if (host.size() > 1 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    boost::system::error_code ec;
+    const auto address = boost::asio::ip::make_address(host, ec);
+    char* end = nullptr;
+    const long port = std::strtol(text.c_str() + colon + 1, &end, 10);
+    if (ec || *end || port <= 0 || port > 65535) {
+        return false;
+    }
+    out = {address, static_cast<unsigned short>(port)};
+    return true;
+}
+
+static bool parse_action(const json& j, rule_action& action) {
+    if (j.is_array()) {
+        for (const auto& each : j) {
+            if (!parse_action(each, action)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    const std::string kind = j.is_string() ? j.get<std::string>() : j.value("kind", "");
+    if (kind == "drop") {
+        action.drop = true;
+    }
+    else if (kind == "forward") {
+    }
+    else if (kind == "duplicate") {
+        const int copies = j.is_object() ? j.value("copies", 2) : 2;
+        if (copies < 1 || copies > 1000) {
+            spdlog::error("duplicate action needs 1 to 1000 copies, not {}", copies);
+            return false;
+        }
+        action.copies = uint16_t(copies);
+    }
+    else if (kind == "delay") {
+        const double ms = j.is_object() ? j.value("ms", 0.0) : 0.0;
+        if (!(ms >= 0) || ms > 60000) {
+            spdlog::error("delay action needs 0 to 60000 ms, not {}", ms);
+            return false;
+        }
+        action.delay_us = uint32_t(ms * 1000);
+    }
+    else if (kind == "redirect") {
+        const std::string to = j.is_object() ? j.value("to", "") : "";
+        if (!parse_endpoint(to, action.redirect_to)) {
+            spdlog::error("redirect action needs \"to\": \"host:port\", got \"{}\"", to);
+            return false;
+        }
+        action.redirect = true;
+    }
+    else {
+        spdlog::error("Unknown rule action {}", j.dump());
+        return false;
+    }
+    return true;
+}
+
+// "2026-10-18T14:00:00Z", UTC, fractional seconds allowed
+static bool parse_utc_time(const std::string& text, int64_t& ns) {
+    int year, month, day, hour, minute;
+    double second;
+    char zone = 'Z';
+    const int n = std::sscanf(text.c_str(), "%d-%d-%dT%d:%d:%lf%c", &year, &month, &day, &hour, &minute, &second, &zone);
+    if (n < 6 || zone != 'Z' || month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour > 23 || minute > 59 || !(second >= 0 && second < 61)) {
+        return false;
+    }
+    std::tm tm{};
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+#ifdef _WIN32
+    const int64_t seconds = _mkgmtime(&tm);
+#else
+    const int64_t seconds = timegm(&tm);
+#endif
+    ns = seconds * 1000000000 + int64_t(second * 1e9);
+    return true;
+}
+
+// One end of "active"; a "hits" trigger's rule name is resolved once all
+// rules are parsed
+static bool parse_trigger(const json& j, rule_trigger& trigger, std::string& rule_name) {
+    if (!j.is_object()) {
+        return false;
+    }
+    if (j.contains("seconds")) {
+        const double seconds = j["seconds"].get<double>();
+        if (!(seconds >= 0)) {
+            return false;
+        }
+        trigger.kind = rule_trigger::ELAPSED;
+        trigger.value = int64_t(seconds * 1e9);
+        return true;
+    }
+    if (j.contains("time")) {
+        trigger.kind = rule_trigger::WALL_CLOCK;
+        return j["time"].is_string() && parse_utc_time(j["time"].get<std::string>(), trigger.value);
+    }
+    if (j.contains("packets")) {
+        trigger.kind = rule_trigger::PACKETS;
+        trigger.value = j["packets"].get<int64_t>();
+        return trigger.value >= 0;
+    }
+    if (j.contains("hits")) {
+        trigger.kind = rule_trigger::HITS;
+        trigger.value = j["hits"].get<int64_t>();
+        rule_name = j.value("rule", "");
+        return trigger.value >= 0 && !rule_name.empty();
+    }
+    return false;
+}
+
+static uint64_t bit_mask(const packet_description::field& f);
+
+// A mutation with "fuzz" (see fuzz_spec); "field" is optional
+static bool parse_fuzz(const packet_types& types, const field_index& fields, const json& j, Mutation& m) {
+    const std::string kind = j["fuzz"].get<std::string>();
+    m = Mutation{
+        .data_offset = 0,
+        .data_size = 0,
+        .type = ARRAY_TYPE,
+        .new_value_d = 0,
+        .new_value_u = 0,
+        .new_value_i = 0,
+    };
+    if (kind == "random") {
+        m.fuzz.kind = fuzz_spec::RANDOM;
+    }
+    else if (kind == "bitflip") {
+        m.fuzz.kind = fuzz_spec::BITFLIP;
+        m.fuzz.count = j.value("bits", 1u);
+    }
+    else if (kind == "truncate") {
+        m.fuzz.kind = fuzz_spec::TRUNCATE;
+        m.fuzz.count = j.value("min", 0u);
+        if (j.contains("field")) {
+            spdlog::error("truncate fuzzing applies to the whole datagram, it takes no field");
+            return false;
+        }
+        return true;
+    }
+    else {
+        spdlog::error("Unknown fuzz kind {}, expected random, bitflip or truncate", kind);
+        return false;
+    }
+
+    if (j.contains("field")) {
+        const std::string field_name = j["field"].get<std::string>();
+        const packet_description::field* field = find_rule_field(types, fields, field_name, m.anchor);
+        if (!field) {
+            spdlog::error("Failed to find field {} for fuzz mutation", field_name);
+            return false;
+        }
+        m.data_offset = field->offset;
+        m.type = field->type;
+        m.data_size = field->type == ARRAY_TYPE ? field->size : data_size_from_type(field->type);
+        m.mask = bit_mask(*field);
+        m.shift = field->bit_offset;
+    }
+
+    if (j.contains("min") || j.contains("max")) {
+        if (m.fuzz.kind != fuzz_spec::RANDOM || m.type == ARRAY_TYPE || !j.contains("min") || !j.contains("max")) {
+            spdlog::error("min and max go together, on random fuzzing of a numeric field");
+            return false;
+        }
+        m.fuzz.ranged = true;
+        m.fuzz.min_d = j["min"].get<double>();
+        m.fuzz.max_d = j["max"].get<double>();
+        m.fuzz.min_i = j["min"].get<int64_t>();
+        m.fuzz.max_i = j["max"].get<int64_t>();
+        if (m.fuzz.max_d < m.fuzz.min_d) {
+            spdlog::error("Fuzz range min {} is above max {}", m.fuzz.min_d, m.fuzz.max_d);
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint64_t bit_mask(const packet_description::field& f) {
+    if (!f.bit_width) {
+        return 0;
+    }
+    return (f.bit_width == 64 ? ~0ull : (1ull << f.bit_width) - 1) << f.bit_offset;
+}
+
+static bool same_word(const Condition& a, const Condition& b) {
+    return a.data_offset == b.data_offset && a.data_size == b.data_size &&
+           a.anchor.packet == b.anchor.packet && a.anchor.section == b.anchor.section && a.anchor.element == b.anchor.element;
+}
+
+static bool same_word(const Mutation& a, const Mutation& b) {
+    return a.data_offset == b.data_offset && a.data_size == b.data_size &&
+           a.anchor.packet == b.anchor.packet && a.anchor.section == b.anchor.section && a.anchor.element == b.anchor.element;
+}
+
+// Equality tests on bits of the same word become one masked compare (the
+// conditions of a rule are and-ed, so order doesn't matter). Consecutive
+// constant stores to one word become one read-modify-write.
+static void merge_bitfields(Rule& rule) {
+    Conditions conditions;
+    for (Condition c : rule.conditions) {
+        if (c.mask && c.operation == OP_EQUAL && c.value_u <= (c.mask >> c.shift)) {
+            c.value_u <<= c.shift;
+            c.shift = 0;
+            auto same = std::find_if(conditions.begin(), conditions.end(), [&](const Condition& o) {
+                return o.mask && o.shift == 0 && o.operation == OP_EQUAL && same_word(o, c) && !(o.mask & c.mask);
+            });
+            if (same != conditions.end()) {
+                same->mask |= c.mask;
+                same->value_u |= c.value_u;
+                continue;
+            }
+        }
+        conditions.push_back(c);
+    }
+    rule.conditions = std::move(conditions);
+
+    Mutations mutations;
+    for (Mutation& m : rule.mutations) {
+        if (m.mask && m.program.empty() && !m.fuzz.kind) {
+            m.new_value_u = (m.new_value_u << m.shift) & m.mask;
+            m.shift = 0;
+            if (!mutations.empty()) {
+                Mutation& prev = mutations.back();
+                if (prev.mask && prev.shift == 0 && prev.program.empty() && !prev.fuzz.kind && same_word(prev, m)) {
+                    prev.new_value_u = (prev.new_value_u & ~m.mask) | m.new_value_u;
+                    prev.mask |= m.mask;
+                    continue;
+                }
+            }
+        }
+        mutations.push_back(std::move(m));
+    }
+    rule.mutations = std::move(mutations);
+}
+
+std::vector<Rule> json_rule_based_mutator::parse_rules(const packet_types& types, const field_index& fields, json data) {
+    if (spdlog::should_log(spdlog::level::debug)) {
+        spdlog::debug(data.dump(2));
+    }
     std::vector<Rule> rules;
+    int32_t counter_slots = 0;
+    std::unordered_map<std::string, int32_t> rule_names;
+    std::vector<std::array<std::string, 2>> hit_names;
 
     if (!data.contains("rules")) {
         spdlog::error("rules file does not contain a 'rules' object");
         return rules;
     }
 
+    std::size_t rule_number = 0;
     for (auto& rule_json : data["rules"]) {
+        ++rule_number;
+        const std::string rule_label = rule_json.contains("name") && rule_json["name"].is_string()
+            ? "\"" + rule_json["name"].get<std::string>() + "\""
+            : "#" + std::to_string(rule_number);
         if (!rule_json.contains("conditions")) {
             spdlog::error("rule does not contain a 'conditions' object");
             continue;
         }
-        if (!rule_json.contains("mutations")) {
-            spdlog::error("rule does not contain a 'mutation' object");
+        // A named rule without either can still be counted by triggers
+        if (!rule_json.contains("mutations") && !rule_json.contains("action") && !rule_json.contains("name")) {
+            spdlog::error("rule does not contain a 'mutation' or 'action' object");
             continue;
         }
 
@@ -81,18 +911,86 @@ std::vector<Rule> json_rule_based_mutator::parse_rules(const packet_types& packe
             continue;
         }
 
+        bool ok = true;
         for (const json& condition_json : conditions_json) {
             try {
+                if (condition_json.contains("payload")) {
+                    Condition cd{
+                        .data_offset = 0,
+                        .data_size = 0,
+                        .type = ARRAY_TYPE,
+                        .operation = OP_PAYLOAD,
+                        .value_d = 0,
+                        .value_u = 0,
+                        .value_i = 0,
+                    };
+                    const json& list = condition_json["payload"];
+                    bool patterns_ok = true;
+                    for (const json& p : list.is_array() ? list : json::array({list})) {
+                        std::string pattern;
+                        patterns_ok = patterns_ok && parse_bytes(p, pattern);
+                        cd.patterns.push_back(std::move(pattern));
+                    }
+                    if (!patterns_ok || cd.patterns.empty()) {
+                        spdlog::error("Bad payload pattern list");
+                        ok = false;
+                        continue;
+                    }
+                    rule.conditions.push_back(std::move(cd));
+                    continue;
+                }
                 std::string condition_field = condition_json["field"].get<std::string>();
                 std::string operator_type = condition_json["operator"].get<std::string>();
-                const packet_description::field* condition_field_ptr = get_field_ptr(condition_field, packet_types);
+                field_anchor anchor;
+                const packet_description::field* condition_field_ptr = find_rule_field(types, fields, condition_field, anchor);
                 if (!condition_field_ptr) {
                     spdlog::error("Failed to find field {} for condition", condition_field);
+                    ok = false;
+                    continue;
+                }
+                if (condition_field_ptr->type == ARRAY_TYPE) {
+                    // Blobs (size 0) are compared over their actual length
+                    Condition cd{
+                        .data_offset = condition_field_ptr->offset,
+                        .data_size = condition_field_ptr->size,
+                        .type = ARRAY_TYPE,
+                        .operation = condition_operation_from_string(operator_type),
+                        .value_d = 0,
+                        .value_u = 0,
+                        .value_i = 0,
+                        .anchor = anchor,
+                    };
+                    if (cd.operation != OP_EQUAL && cd.operation != OP_NOT_EQUAL &&
+                        cd.operation != OP_PREFIX && cd.operation != OP_CONTAINS) {
+                        spdlog::error("Byte array field {} only supports ==, !=, prefix and contains", condition_field);
+                        ok = false;
+                        continue;
+                    }
+                    if (!parse_bytes(condition_json["value"], cd.bytes)) {
+                        spdlog::error("Bad byte array value for condition on {}", condition_field);
+                        ok = false;
+                        continue;
+                    }
+                    if (cd.data_size > 0 && cd.bytes.size() > std::size_t(cd.data_size)) {
+                        spdlog::error("Value for {} is longer than the field's {} bytes", condition_field, cd.data_size);
+                        ok = false;
+                        continue;
+                    }
+                    if (cd.data_size > 0 && (cd.operation == OP_EQUAL || cd.operation == OP_NOT_EQUAL)) {
+                        cd.bytes.resize(cd.data_size, '\0');
+                    }
+                    rule.conditions.push_back(std::move(cd));
+                    continue;
+                }
+                if (operator_type == "prefix" || operator_type == "contains") {
+                    spdlog::error("{} is only supported on byte array fields, not {}", operator_type, condition_field);
+                    ok = false;
                     continue;
                 }
                 int data_size = data_size_from_type(condition_field_ptr->type);
                 if (data_size <= 0) {
                     spdlog::error("Failed to find data size for condition field {}", condition_field); 
+                    ok = false;
                     continue;
                 }
                 Condition cd{
@@ -103,70 +1001,218 @@ std::vector<Rule> json_rule_based_mutator::parse_rules(const packet_types& packe
                         .value_d = condition_json["value"].get<double>(),
                         .value_u = condition_json["value"].get<uint64_t>(),
                         .value_i = condition_json["value"].get<int64_t>(),
+                        .anchor = anchor,
+                        .mask = bit_mask(*condition_field_ptr),
+                        .shift = condition_field_ptr->bit_offset,
                 };
 
                 if (cd.operation == OP_INVALID) {
                     spdlog::error("Failed to convert " + operator_type + " to a valid cond_operation ");
+                    ok = false;
                     continue;
                 }
 
                 if (cd.type == INVALID_DATA_TYPE) {
                     spdlog::error("Could not find valid data type for condition field " + condition_field);
+                    ok = false;
                     continue;
                 }
                 rule.conditions.push_back(cd);
             }
             catch(...) {
                 spdlog::error("Failed to parse condition");
+                ok = false;
+            }
+        }
+        // A rule missing a condition would act on far more packets than
+        // meant, and may drop or redirect them
+        if (!ok) {
+            spdlog::error("Skipping rule {}: one of its conditions is invalid", rule_label);
+            continue;
+        }
+
+        if (rule_json.contains("action") && !parse_action(rule_json["action"], rule.action)) {
+            continue;
+        }
+
+        if (rule_json.contains("from")) {
+            const json& from = rule_json["from"];
+            for (const json& each : from.is_array() ? from : json::array({from})) {
+                mm::mutators::sender_scope scopes[2];
+                int count = 0;
+                if (!each.is_string() || !parse_sender_scope(each.get<std::string>(), scopes, count)) {
+                    spdlog::error("Bad sender {} in rule \"from\", expected an address, CIDR range or *, with an optional :port", each.dump());
+                    ok = false;
+                    break;
+                }
+                rule.from.insert(rule.from.end(), scopes, scopes + count);
+            }
+            if (!ok || rule.from.empty()) {
+                continue;
+            }
+        }
+
+        rule.name = rule_json.value("name", "");
+        std::array<std::string, 2> counted;
+        if (rule_json.contains("active")) {
+            const json& active = rule_json["active"];
+            ok = active.is_object() && (active.contains("from") || active.contains("until"));
+            try {
+                if (ok && active.contains("from")) {
+                    ok = parse_trigger(active["from"], rule.active.from, counted[0]);
+                }
+                if (ok && active.contains("until")) {
+                    ok = parse_trigger(active["until"], rule.active.until, counted[1]);
+                }
+            }
+            catch (...) {
+                ok = false;
+            }
+            if (!ok) {
+                spdlog::error("Bad \"active\" {}, expected \"from\" and/or \"until\" with seconds, time, packets or hits", active.dump());
+                continue;
+            }
+        }
+
+        if (rule_json.contains("probability")) {
+            rule.probability = rule_json["probability"].get<double>();
+            if (!(rule.probability >= 0 && rule.probability <= 1)) {
+                spdlog::error("Rule probability {} is not between 0 and 1", rule.probability);
+                continue;
             }
         }
 
-        for (const auto& mutation_json : rule_json["mutations"]) {
+        for (const auto& mutation_json : rule_json.value("mutations", json::array())) {
             try {
+                if (mutation_json.contains("fuzz")) {
+                    Mutation m;
+                    if (parse_fuzz(types, fields, mutation_json, m)) {
+                        rule.mutations.push_back(std::move(m));
+                    }
+                    continue;
+                }
                 std::string field_name = mutation_json["field"].get<std::string>();
-                const packet_description::field* field = get_field_ptr(field_name, packet_types);
+                field_anchor anchor;
+                const packet_description::field* field = find_rule_field(types, fields, field_name, anchor);
                 if (!field) {
                     spdlog::error("Failed to find field {} for mutation", field_name);
                     continue;
                 }
-                rule.mutations.push_back(Mutation{
+                if (mutation_json.contains("expr")) {
+                    // e.g. "value + 10", "value * 0.5", "entity_id.site", "counter"
+                    if (field->type == ARRAY_TYPE || field->type == INVALID_DATA_TYPE) {
+                        spdlog::error("Field {} can't take an expression", field_name);
+                        continue;
+                    }
+                    Mutation m{
+                        .data_offset = field->offset,
+                        .data_size = data_size_from_type(field->type),
+                        .type = field->type,
+                        .new_value_d = 0,
+                        .new_value_u = 0,
+                        .new_value_i = 0,
+                        .anchor = anchor,
+                        .mask = bit_mask(*field),
+                        .shift = field->bit_offset,
+                    };
+                    if (!compile_expression(mutation_json["expr"].get<std::string>(), fields, m, counter_slots)) {
+                        continue;
+                    }
+                    rule.mutations.push_back(std::move(m));
+                    continue;
+                }
+                if (field->type == ARRAY_TYPE) {
+                    Mutation m{
+                        .data_offset = field->offset,
+                        .data_size = field->size,
+                        .type = ARRAY_TYPE,
+                        .new_value_d = 0,
+                        .new_value_u = 0,
+                        .new_value_i = 0,
+                        .anchor = anchor,
+                    };
+                    if (!parse_bytes(mutation_json["new_value"], m.bytes)) {
+                        spdlog::error("Bad byte array value for mutation of {}", field_name);
+                        continue;
+                    }
+                    if (m.data_size > 0) {
+                        if (m.bytes.size() > std::size_t(m.data_size)) {
+                            spdlog::warn("Value for {} is longer than the field's {} bytes and will be truncated", field_name, m.data_size);
+                        }
+                        m.bytes.resize(m.data_size, '\0');
+                    }
+                    rule.mutations.push_back(std::move(m));
+                    continue;
+                }
+                Mutation m{
                         .data_offset = field->offset,
                         .data_size = data_size_from_type(field->type),
                         .type = field->type,
                         .new_value_d = mutation_json["new_value"].get<double>(),
                         .new_value_u = mutation_json["new_value"].get<uint64_t>(),
                         .new_value_i = mutation_json["new_value"].get<int64_t>(),
-                        });
+                        .anchor = anchor,
+                        .mask = bit_mask(*field),
+                        .shift = field->bit_offset,
+                        };
+                if (m.mask && m.new_value_u > (m.mask >> m.shift)) {
+                    spdlog::warn("{} is {} bits wide, {} will be truncated", field_name, +field->bit_width, m.new_value_u);
+                }
+                rule.mutations.push_back(std::move(m));
             }
             catch(...) {
                 spdlog::error("Failed to parse mutation");
             }
         }
+        merge_bitfields(rule);
+        if (!rule.name.empty() && !rule_names.emplace(rule.name, int32_t(rules.size())).second) {
+            spdlog::warn("Rule name \"{}\" is used more than once, triggers count the first", rule.name);
+        }
         rules.push_back(rule);
+        hit_names.push_back(counted);
+    }
+
+    for (std::size_t i = 0; i < rules.size(); ++i) {
+        for (int end = 0; end < 2; ++end) {
+            rule_trigger& t = end ? rules[i].active.until : rules[i].active.from;
+            if (t.kind != rule_trigger::HITS) {
+                continue;
+            }
+            auto it = rule_names.find(hit_names[i][end]);
+            if (it == rule_names.end()) {
+                spdlog::error("Trigger counts hits of unknown rule \"{}\", it will never fire", hit_names[i][end]);
+                continue;
+            }
+            t.rule = it->second;
+        }
     }
 
     return rules;
 }
 
 
+// The field is decoded before comparing, as the generated accessors do; a
+// swapped constant only orders correctly for == and !=
 template<typename T>
 static bool evaluate_operation(const void* field, int operation, T value, int size, bool byteswap) {
+    T v;
+    std::memcpy(&v, field, sizeof(T));
     if (byteswap) {
-        swap_bytes(&value, size);
+        swap_bytes(&v, size);
     }
     switch(operation) {
         case OP_EQUAL | OP_LESS_THAN:
-            return (*static_cast<const T*>(field) <= value);
+            return v <= value;
         case OP_EQUAL | OP_GREATER_THAN:
-            return (*static_cast<const T*>(field) >= value);
+            return v >= value;
         case OP_LESS_THAN:
-            return (*static_cast<const T*>(field) < value);
+            return v < value;
         case OP_GREATER_THAN:
-            return (*static_cast<const T*>(field) > value);
+            return v > value;
         case OP_EQUAL:
-            return (*static_cast<const T*>(field) == value);
+            return v == value;
         case OP_NOT_EQUAL:
-            return (*static_cast<const T*>(field) != value);
+            return v != value;
         case OP_INVALID:
             spdlog::error("Tried to evaluate a condition with an invalid operation");
             return false;
@@ -176,8 +1222,43 @@ static bool evaluate_operation(const void* field, int operation, T value, int si
     }
 }
 
-static bool evaluate_condition(const Condition& condition, mm::network::BufferPtr buffer, bool to_network_byte_order = false) {
-    const void* data_ptr = static_cast<const void*>(&buffer->data()[condition.data_offset]);
+static bool evaluate_bytes(const Condition& c, const unsigned char* field, std::size_t size) {
+    const auto* pattern = reinterpret_cast<const unsigned char*>(c.bytes.data());
+    const std::size_t n = c.bytes.size();
+    switch (c.operation) {
+        case OP_EQUAL:     return size == n && std::memcmp(field, pattern, n) == 0;
+        case OP_NOT_EQUAL: return size != n || std::memcmp(field, pattern, n) != 0;
+        case OP_PREFIX:    return size >= n && std::memcmp(field, pattern, n) == 0;
+        case OP_CONTAINS:  return find_bytes(field, size, pattern, n) != nullptr;
+        default:           return false;
+    }
+}
+
+// Bitfields are read as an unsigned word and compared unsigned
+static bool evaluate_bits(const Condition& c, const unsigned char* packet, bool byteswap) {
+    const uint64_t v = (read_unsigned(packet + c.data_offset, c.data_size, byteswap) & c.mask) >> c.shift;
+    switch (c.operation) {
+        case OP_EQUAL | OP_LESS_THAN:    return v <= c.value_u;
+        case OP_EQUAL | OP_GREATER_THAN: return v >= c.value_u;
+        case OP_LESS_THAN:               return v < c.value_u;
+        case OP_GREATER_THAN:            return v > c.value_u;
+        case OP_EQUAL:                   return v == c.value_u;
+        case OP_NOT_EQUAL:               return v != c.value_u;
+        default:                         return false;
+    }
+}
+
+static void set_bits(unsigned char* packet, const Mutation& m, bool byteswap) {
+    unsigned char* p = packet + m.data_offset;
+    const uint64_t word = read_unsigned(p, m.data_size, byteswap);
+    write_unsigned(p, m.data_size, (word & ~m.mask) | ((m.new_value_u << m.shift) & m.mask), byteswap);
+}
+
+static bool evaluate_condition(const Condition& condition, const unsigned char* packet, bool to_network_byte_order = false) {
+    if (condition.mask) {
+        return evaluate_bits(condition, packet, to_network_byte_order);
+    }
+    const void* data_ptr = static_cast<const void*>(&packet[condition.data_offset]);
     switch(condition.type) {
         case FLOAT_TYPE:
             return evaluate_operation<float>(data_ptr, condition.operation, condition.value_d, condition.data_size, to_network_byte_order);
@@ -200,9 +1281,7 @@ static bool evaluate_condition(const Condition& condition, mm::network::BufferPt
         case ULONG_TYPE:
             return evaluate_operation<uint64_t>(data_ptr, condition.operation, condition.value_u,  condition.data_size, to_network_byte_order);
         case ARRAY_TYPE:
-            // TODO:
-            return false;
-            // return evaluate_operation<uint64_t>(data_ptr, condition.operation, condition.value_u,  condition.data_size, to_network_byte_order);
+            return evaluate_bytes(condition, packet + condition.data_offset, condition.data_size);
         default:
             break;
     }
@@ -218,20 +1297,223 @@ static void set_field(void* field, const T value, int size, bool byteswap = fals
     }
 }
 
-bool json_rule_based_mutator::mutate_packet(mm::network::BufferPtr readBuf,
-                   mm::network::EndpointPtr sender,
-                   std::size_t bytes) {
+// A random or bitflip fuzz mutation. span is the field's size, or the
+// blob's or datagram's when the mutation has no size of its own.
+static void apply_fuzz(const Mutation& m, unsigned char* target, std::size_t span, fuzz_rng& rng, bool byteswap) {
+    unsigned char* p = target + m.data_offset;
+    const std::size_t size = m.data_size ? std::size_t(m.data_size) : span;
+
+    if (m.fuzz.kind == fuzz_spec::BITFLIP) {
+        // Bitfields flip within their bits, anything else anywhere
+        const uint64_t width = m.mask ? __builtin_popcountll(m.mask) : size * 8;
+        for (uint32_t i = 0; width && i < m.fuzz.count; ++i) {
+            const uint64_t bit = rng.below(width);
+            if (m.mask) {
+                const uint64_t word = read_unsigned(p, m.data_size, byteswap);
+                write_unsigned(p, m.data_size, word ^ (1ull << (m.shift + bit)), byteswap);
+            }
+            else {
+                p[bit >> 3] ^= uint8_t(0x80 >> (bit & 7));
+            }
+        }
+        return;
+    }
+
+    if (!m.fuzz.ranged) {
+        if (m.mask) {
+            const uint64_t word = read_unsigned(p, m.data_size, byteswap);
+            write_unsigned(p, m.data_size, (word & ~m.mask) | (rng.next() & m.mask), byteswap);
+        }
+        else {
+            rng.fill(p, size);
+        }
+        return;
+    }
+    if (m.type == FLOAT_TYPE || m.type == DOUBLE_TYPE) {
+        const double v = m.fuzz.min_d + rng.unit() * (m.fuzz.max_d - m.fuzz.min_d);
+        if (m.type == FLOAT_TYPE) {
+            set_field<float>(p, float(v), 4, byteswap);
+        }
+        else {
+            set_field<double>(p, v, 8, byteswap);
+        }
+        return;
+    }
+    // A range of 2^64 wraps to 0, which is every value
+    const uint64_t range = uint64_t(m.fuzz.max_i) - uint64_t(m.fuzz.min_i) + 1;
+    const uint64_t v = uint64_t(m.fuzz.min_i) + (range ? rng.below(range) : rng.next());
+    if (m.mask) {
+        const uint64_t word = read_unsigned(p, m.data_size, byteswap);
+        write_unsigned(p, m.data_size, (word & ~m.mask) | ((v << m.shift) & m.mask), byteswap);
+    }
+    else {
+        write_unsigned(p, m.data_size, v, byteswap);
+    }
+}
+
+// Conditions read from view. The first mutation of a packet asks
+// writable() where to write, which may repoint view at a private copy so
+// later rules see the mutated bytes.
+expression_context json_rule_based_mutator::context_for(const Mutation& m, const mm::network::Endpoint* sender) const {
+    expression_context ctx;
+    if (m.program.counter_slot >= 0) {
+        ctx.counter = counters.next(sender, m.program.counter_slot);
+    }
+    if (m.program.uses_clock) {
+        ctx.elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - loaded_at).count();
+    }
+    return ctx;
+}
 
+template<typename Writable>
+packet_verdict json_rule_based_mutator::run_rules(const unsigned char*& view, std::size_t bytes, const mm::network::Endpoint* sender, Writable&& writable, uint64_t index) const {
+    packet_verdict verdict;
     bool mutated = false;
-    for (const auto& rule : rules) {
+    uint64_t touched_derived = 0;
+    uint64_t set_derived = 0;
+    unsigned char* packet = nullptr;
+    layout_cache layout(*this);
+    payload_matcher::matches matched;
+    bool scanned = false;
+
+    // With scoped or scheduled rules, only visit those that apply to this
+    // sender and are active now
+    const uint64_t* selected = nullptr;
+    uint64_t local[sender_index::LOCAL_WORDS];
+    std::vector<uint64_t> heap;
+    if (!senders.empty() || !schedule.empty()) {
+        const std::size_t words = (rules.size() + 63) / 64;
+        uint64_t* mask = local;
+        if (words > sender_index::LOCAL_WORDS) {
+            heap.resize(words);
+            mask = heap.data();
+        }
+        if (!schedule.empty()) {
+            schedule.on_packet();
+        }
+        if (senders.empty()) {
+            schedule.fill(mask);
+        }
+        else {
+            senders.select(sender, mask);
+            if (!schedule.empty()) {
+                schedule.restrict(mask);
+            }
+        }
+        selected = mask;
+    }
+
+    // This packet's random stream, made on first use
+    std::optional<fuzz_rng> rng;
+    auto random = [&]() -> fuzz_rng& {
+        if (!rng) {
+            rng.emplace(fuzz_seed, index);
+        }
+        return *rng;
+    };
+    bool fuzzed = false;
+
+    const std::size_t num_rules = rules.size();
+    for (std::size_t i = sender_index::next(selected, 0, num_rules); i < num_rules; i = sender_index::next(selected, i + 1, num_rules)) {
+        const Rule& rule = rules[i];
         bool passed = true;
         for (const auto& condition : rule.conditions) {
-            passed &= evaluate_condition(condition, readBuf, to_network_byte_order);
+            if (condition.operation == OP_PAYLOAD) {
+                // One scan for every payload condition, on first use and
+                // again only after a rule changed the bytes
+                if (!scanned) {
+                    payload.scan(view, bytes, matched);
+                    scanned = true;
+                }
+                passed = condition.value_u < payload_matcher::MAX_SLOTS && matched[condition.value_u];
+            }
+            else if (condition.anchor.packet >= 0) {
+                std::size_t span = 0;
+                const long base = layout.resolve(view, bytes, condition.anchor, condition.data_offset + condition.data_size, &span);
+                if (base >= 0 && condition.type == ARRAY_TYPE && condition.data_size == 0) {
+                    passed = evaluate_bytes(condition, view + base + condition.data_offset, span - condition.data_offset);
+                }
+                else {
+                    passed = base >= 0 && evaluate_condition(condition, view + base, to_network_byte_order);
+                }
+            }
+            else {
+                passed = condition.evaluate ? condition.evaluate(view, condition)
+                                            : evaluate_condition(condition, view, to_network_byte_order);
+            }
+            if (!passed) {
+                break;
+            }
+        }
+
+        if (passed && rule.probability < 1) {
+            passed = random().unit() < rule.probability;
         }
 
         if (passed) {
+            schedule.on_hit(i);
+            if (rule.action.any()) {
+                const rule_action& a = rule.action;
+                if (a.drop) {
+                    // Nothing else matters for a dropped packet, not even
+                    // its derived fields
+                    verdict.drop = true;
+                    verdict.mutated = mutated;
+                    return verdict;
+                }
+                verdict.copies = std::max(verdict.copies, a.copies);
+                verdict.delay = std::max(verdict.delay, std::chrono::microseconds(a.delay_us));
+                if (a.redirect) {
+                    verdict.redirect = &a.redirect_to;
+                }
+            }
+            if (!packet && !rule.mutations.empty()) {
+                packet = writable();
+            }
+            touched_derived |= rule.touches_derived;
+            set_derived |= rule.sets_derived;
             for (const auto& mutation : rule.mutations) {
-                void* data_ptr = static_cast<void*>(&readBuf->data()[mutation.data_offset]);
+                if (mutation.apply) {
+                    mutation.apply(packet, mutation);
+                    mutated = true;
+                    continue;
+                }
+                if (mutation.fuzz.kind == fuzz_spec::TRUNCATE) {
+                    if (bytes > mutation.fuzz.count) {
+                        bytes = mutation.fuzz.count + random().below(bytes - mutation.fuzz.count);
+                        verdict.length = bytes;
+                        layout.invalidate();
+                        mutated = fuzzed = true;
+                    }
+                    continue;
+                }
+                unsigned char* target = packet;
+                std::size_t span = mutation.data_size ? std::size_t(mutation.data_size) : bytes;
+                if (mutation.anchor.packet >= 0) {
+                    const long base = layout.resolve(packet, bytes, mutation.anchor, mutation.data_offset + mutation.data_size, &span);
+                    if (base < 0) {
+                        continue;
+                    }
+                    target = packet + base;
+                    span = mutation.data_size ? mutation.data_size : span - mutation.data_offset;
+                }
+                if (!mutation.program.empty()) {
+                    run_expression(mutation, packet, target, to_network_byte_order, context_for(mutation, sender));
+                    mutated = true;
+                    continue;
+                }
+                if (mutation.fuzz.kind) {
+                    apply_fuzz(mutation, target, span, random(), to_network_byte_order);
+                    mutated = fuzzed = true;
+                    continue;
+                }
+                if (mutation.mask) {
+                    set_bits(target, mutation, to_network_byte_order);
+                    mutated = true;
+                    continue;
+                }
+                void* data_ptr = static_cast<void*>(&target[mutation.data_offset]);
 
                 switch(mutation.type) {
                     case FLOAT_TYPE:
@@ -265,8 +1547,7 @@ bool json_rule_based_mutator::mutate_packet(mm::network::BufferPtr readBuf,
                         set_field<uint64_t>(data_ptr, mutation.new_value_u,  mutation.data_size, to_network_byte_order);
                         break;
                     case ARRAY_TYPE:
-                        // TODO:
-                        // set_field<uint64_t>(data_ptr, mutation.new_value_u,  mutation.data_size, to_network_byte_order);
+                        std::memcpy(data_ptr, mutation.bytes.data(), std::min(mutation.bytes.size(), span));
                         break;
                     default:
                         spdlog::error("Could not execute mutation: invalid type %d ", +mutation.type) ;
@@ -274,84 +1555,81 @@ bool json_rule_based_mutator::mutate_packet(mm::network::BufferPtr readBuf,
                 }
                 mutated = true;
             }
+            if (rule.touches_layout) {
+                layout.invalidate();
+            }
+            scanned = scanned && rule.mutations.empty();
         }
     }
-    
-    return mutated;
-}
 
-} // end namespace mm::mutators
+    // A rule that writes a derived field itself wins, so tests can still
+    // send deliberately bad checksums
+    if (touched_derived & ~set_derived) {
+        fix_derived_fields(packet, bytes, touched_derived & ~set_derived);
+    }
+    if (fuzzed) {
+        spdlog::debug("fuzzed packet {} (seed {})", index, fuzz_seed);
+    }
+    verdict.mutated = mutated;
+    return verdict;
+}
 
-static packet_types packet_description_from_json(json j) {
-    packet_types pds;
-    int cur_data_offset = 0;
-    for (auto& packet_json : j["packets"]) {
-        std::vector<packet_description::field> fields;
-        std::string name = packet_json["name"].get<std::string>();
-        std::string opcode_field = packet_json["opcode_field"].get<std::string>();
-        int opcode = packet_json["opcode"].get<int>();
-        const json& data = packet_json["data"];
+bool json_rule_based_mutator::mutate_packet(mm::network::BufferPtr readBuf,
+                   mm::network::EndpointPtr sender,
+                   std::size_t bytes) {
+    return process_packet(std::move(readBuf), std::move(sender), bytes, number_packet()).mutated;
+}
 
-        std::string field_name_prefix = "";
-        cur_data_offset += parse_packets_data_field(data, cur_data_offset, field_name_prefix, fields);
-        pds.push_back(packet_description(name, opcode_field, opcode, fields));
-    }
-    return pds;
+bool json_rule_based_mutator::mutate_copy(const mm::network::BufferPtr& in,
+                   mm::network::EndpointPtr sender,
+                   std::size_t bytes,
+                   mm::network::Buffer& out) {
+    return process_copy(in, std::move(sender), bytes, out, number_packet()).mutated;
 }
 
+uint64_t json_rule_based_mutator::number_packet() {
+    return fuzzing ? fuzz_packets.fetch_add(1, std::memory_order_relaxed) : 0;
+}
 
-// returns the new offset after parsing the data array
-static int parse_packets_data_field(const json& data, int offset, std::string field_name_prefix, std::vector<packet_description::field>& fields) {
-    for (auto& d : data)  {
-        if (d.contains("struct")) {
-            std::string struct_name = d["struct"].get<std::string>();
-            spdlog::info("struct=" + struct_name);
+packet_verdict json_rule_based_mutator::process_packet(mm::network::BufferPtr readBuf,
+                   mm::network::EndpointPtr sender,
+                   std::size_t bytes,
+                   uint64_t index) {
+    const unsigned char* view = readBuf->data();
+    return run_rules(view, bytes, sender.get(), [&]{ return readBuf->data(); }, index);
+}
 
-            if (d.contains("data")) {
-                const json& nested_data = d["data"];
-                offset = parse_packets_data_field(nested_data, offset, struct_name + ".", fields);
-            }
-            else {
-                spdlog::error("data entry is marked as a struct but is missing a data field");
-            }
-        }
-        else {
-            std::string field_name = d["value"].get<std::string>();
-
-            if (d.contains("type")) {
-                std::string field_type = d["type"].get<std::string>();
-
-                fields.push_back({
-                    .name = field_name_prefix + field_name,
-                    .offset = offset,
-                    .type = data_type_from_string(field_type),
-                    .type_str = field_type,
-                });
-                // TODO: already string comped once, just use enum
-                offset += data_size_from_type_string(field_type);
-            }
-            else if (d.contains("size")) {
-                int field_size = d["size"].get<int>();
-
-                fields.push_back({
-                    .name = field_name_prefix + field_name,
-                    .offset = offset,
-                    .type = ARRAY_TYPE,
-                    .type_str = "",
-                });
-                offset += field_size;
-            }
-            else {
-                spdlog::error("Failed to parse field {} in types file", field_name);
-            }
+packet_verdict json_rule_based_mutator::process_copy(const mm::network::BufferPtr& in,
+                   mm::network::EndpointPtr sender,
+                   std::size_t bytes,
+                   mm::network::Buffer& out,
+                   uint64_t index) {
+    const unsigned char* view = in->data();
+    return run_rules(view, bytes, sender.get(), [&]{
+        // Sized like the receive buffer so offsets past 'bytes' behave as
+        // they do in place; only the received bytes are copied.
+        if (out.size() < in->size()) {
+            out.resize(in->size());
         }
-    }
-    return offset;
+        std::memcpy(out.data(), in->data(), bytes);
+        view = out.data();
+        return out.data();
+    }, index);
+}
+
+packet_verdict json_rule_based_mutator::replay(mm::network::BufferPtr readBuf,
+                   mm::network::EndpointPtr sender,
+                   std::size_t bytes,
+                   uint64_t packet_index) {
+    const unsigned char* view = readBuf->data();
+    return run_rules(view, bytes, sender.get(), [&]{ return readBuf->data(); }, packet_index);
 }
 
+} // end namespace mm::mutators
+
 std::shared_ptr<mm::mutators::json_rule_based_mutator> mm::mutators::json_rule_based_mutator::fromJsonString(const std::string& typesFile, const std::string& jsonStr, bool to_big_endian){
-    auto mutator = std::make_shared<mm::mutators::json_rule_based_mutator>(typesFile, "", to_big_endian);
-    mutator->rules = parse_rules(mutator->packet_types_list, json::parse(jsonStr));
+    std::shared_ptr<json_rule_based_mutator> mutator(new json_rule_based_mutator(to_big_endian));
+    mutator->load(typesFile, read_file(typesFile), jsonStr, typesFile + ".rules.mmcache");
     return mutator;
 }
 
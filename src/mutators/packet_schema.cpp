@@ -0,0 +1,285 @@
+#include <mm/mutators/json_rule_based_mutator.hpp>
+
+#include <algorithm>
+
+using derived_specs = std::vector<std::pair<std::size_t, json>>; // field index, "derived" object
+
+// Where the next field goes: its offset from the start of the packet, or
+// from the end of the last dynamic section, or from the start of an element
+struct layout_cursor {
+    int anchor = -1;
+    int offset = 0;
+    bool element = false;
+};
+
+static void parse_packets_data_field(const json& data, layout_cursor& at, std::string field_name_prefix, std::vector<packet_description::field>& fields, derived_specs& derived, std::vector<dynamic_section>& sections);
+static std::vector<derived_field> resolve_derived_fields(const std::string& packet, const std::vector<packet_description::field>& fields, const derived_specs& specs);
+
+packet_types packet_description_from_json(json j) {
+    packet_types pds;
+    for (auto& packet_json : j["packets"]) {
+        std::vector<packet_description::field> fields;
+        std::string name = packet_json["name"].get<std::string>();
+        std::string opcode_field = packet_json["opcode_field"].get<std::string>();
+        int opcode = packet_json["opcode"].get<int>();
+        const json& data = packet_json["data"];
+
+        // offsets are relative to the start of each packet
+        std::string field_name_prefix = "";
+        derived_specs derived;
+        std::vector<dynamic_section> sections;
+        layout_cursor at;
+        parse_packets_data_field(data, at, field_name_prefix, fields, derived, sections);
+        pds.push_back(packet_description(name, opcode_field, opcode, fields));
+        pds.back().derived = resolve_derived_fields(name, fields, derived);
+        pds.back().sections = std::move(sections);
+    }
+    return pds;
+}
+
+// The count or length field of a dynamic section: a fixed-size integer
+// declared before it, outside any array element
+static const packet_description::field* find_count_field(const std::vector<packet_description::field>& fields, const std::string& prefix, const std::string& name) {
+    auto find = [&](const std::string& n) -> const packet_description::field* {
+        auto it = std::find_if(fields.rbegin(), fields.rend(), [&](const auto& f) { return f.name == n; });
+        return it == fields.rend() ? nullptr : &*it;
+    };
+    const packet_description::field* f = find(prefix + name);
+    if (!f) {
+        f = find(name);
+    }
+    if (!f || f->element || f->bit_width || f->type == ARRAY_TYPE || f->type == FLOAT_TYPE || f->type == DOUBLE_TYPE || f->type == INVALID_DATA_TYPE) {
+        return nullptr;
+    }
+    return f;
+}
+
+// Parses an "array" or "blob" entry and moves the cursor past it
+static void parse_dynamic_section(const json& d, layout_cursor& at, const std::string& field_name_prefix, std::vector<packet_description::field>& fields, derived_specs& derived, std::vector<dynamic_section>& sections) {
+    const bool array = d.contains("array");
+    const std::string name = field_name_prefix + d[array ? "array" : "blob"].get<std::string>();
+    if (at.element) {
+        spdlog::error("{}: dynamic sections can't be nested in an array", name);
+        return;
+    }
+    const std::string count_key = array ? "count" : "length";
+    if (!d.contains(count_key)) {
+        spdlog::error("{}: missing \"{}\"", name, count_key);
+        return;
+    }
+    const auto* count = find_count_field(fields, field_name_prefix, d[count_key].get<std::string>());
+    if (!count) {
+        spdlog::error("{}: {} must name an integer field declared before it", name, count_key);
+        return;
+    }
+
+    const int index = int(sections.size());
+    dynamic_section s{
+        .kind = array ? dynamic_section::ARRAY : dynamic_section::BLOB,
+        .anchor = at.anchor,
+        .offset = at.offset,
+        .count_anchor = count->anchor,
+        .count_offset = count->offset,
+        .count_type = count->type,
+        .element_size = 1,
+        .length_divisor = d.value("units", "bytes") == "bits" ? 8 : 1,
+    };
+    if (array) {
+        layout_cursor element{index, 0, true};
+        parse_packets_data_field(d["data"], element, name + "[].", fields, derived, sections);
+        s.element_size = element.offset;
+        if (s.element_size == 0) {
+            spdlog::error("{}: array elements must have a size", name);
+            return;
+        }
+    }
+    else {
+        fields.push_back({
+            .name = name,
+            .offset = 0,
+            .type = ARRAY_TYPE,
+            .type_str = "",
+            .size = 0,
+            .anchor = index,
+            .element = true,
+        });
+    }
+    sections.push_back(s);
+    at = {index, 0, false};
+}
+
+// Parses a "bitfield" entry: the word itself plus one field per member
+static void parse_bitfield(const json& d, layout_cursor& at, const std::string& field_name_prefix, std::vector<packet_description::field>& fields) {
+    const std::string name = field_name_prefix + d["bitfield"].get<std::string>();
+    const std::string type_str = d.value("type", "");
+    const data_type type = data_type_from_string(type_str);
+    if (type != UCHAR_TYPE && type != USHORT_TYPE && type != UINT_TYPE && type != ULONG_TYPE) {
+        spdlog::error("{}: bitfields must be in an unsigned integer word", name);
+        return;
+    }
+    const int size = data_size_from_type(type);
+    const packet_description::field word{
+        .name = name,
+        .offset = at.offset,
+        .type = type,
+        .type_str = type_str,
+        .size = size,
+        .anchor = at.anchor,
+        .element = at.element,
+    };
+    fields.push_back(word);
+
+    int next_bit = 0;
+    for (const auto& b : d.value("data", json::array())) {
+        const std::string member = b["value"].get<std::string>();
+        const int bits = b.value("bits", 0);
+        const int bit = b.value("bit", next_bit);
+        if (bits <= 0 || bit < 0 || bit + bits > size * 8) {
+            spdlog::error("{}.{}: bits {}..{} don't fit in a {}", name, member, bit, bit + bits - 1, type_str);
+            continue;
+        }
+        packet_description::field f = word;
+        f.name = name + "." + member;
+        f.bit_offset = uint8_t(bit);
+        f.bit_width = uint8_t(bits);
+        fields.push_back(f);
+        next_bit = bit + bits;
+    }
+    at.offset += size;
+}
+
+static void parse_packets_data_field(const json& data, layout_cursor& at, std::string field_name_prefix, std::vector<packet_description::field>& fields, derived_specs& derived, std::vector<dynamic_section>& sections) {
+    for (auto& d : data)  {
+        if (d.contains("struct")) {
+            std::string struct_name = d["struct"].get<std::string>();
+            spdlog::debug("struct=" + struct_name);
+
+            if (d.contains("data")) {
+                const json& nested_data = d["data"];
+                parse_packets_data_field(nested_data, at, field_name_prefix + struct_name + ".", fields, derived, sections);
+            }
+            else {
+                spdlog::error("data entry is marked as a struct but is missing a data field");
+            }
+        }
+        else if (d.contains("array") || d.contains("blob")) {
+            parse_dynamic_section(d, at, field_name_prefix, fields, derived, sections);
+        }
+        else if (d.contains("bitfield")) {
+            parse_bitfield(d, at, field_name_prefix, fields);
+        }
+        else {
+            std::string field_name = d["value"].get<std::string>();
+
+            if (d.contains("type")) {
+                std::string field_type = d["type"].get<std::string>();
+
+                data_type type = data_type_from_string(field_type);
+                int size = data_size_from_type(type);
+                fields.push_back({
+                    .name = field_name_prefix + field_name,
+                    .offset = at.offset,
+                    .type = type,
+                    .type_str = field_type,
+                    .size = size,
+                    .anchor = at.anchor,
+                    .element = at.element,
+                });
+                at.offset += size;
+                if (d.contains("derived")) {
+                    derived.push_back({fields.size() - 1, d["derived"]});
+                }
+            }
+            else if (d.contains("size")) {
+                // "size" is in bits, same as the schema editor reads it
+                int field_size = (d["size"].get<int>() + 7) / 8;
+
+                fields.push_back({
+                    .name = field_name_prefix + field_name,
+                    .offset = at.offset,
+                    .type = ARRAY_TYPE,
+                    .type_str = "",
+                    .size = field_size,
+                    .anchor = at.anchor,
+                    .element = at.element,
+                });
+                at.offset += field_size;
+            }
+            else {
+                spdlog::error("Failed to parse field {} in types file", field_name);
+            }
+        }
+    }
+}
+
+// A field name, the name of a struct (its first field) or a byte offset
+static int resolve_offset(const std::vector<packet_description::field>& fields, const json& where, bool& ok) {
+    if (where.is_number_integer()) {
+        return where.get<int>();
+    }
+    const std::string name = where.get<std::string>();
+    for (const auto& f : fields) {
+        if (f.name == name || f.name.compare(0, name.size() + 1, name + ".") == 0) {
+            ok = ok && f.anchor < 0;
+            return f.offset;
+        }
+    }
+    ok = false;
+    return 0;
+}
+
+static std::vector<derived_field> resolve_derived_fields(const std::string& packet, const std::vector<packet_description::field>& fields, const derived_specs& specs) {
+    static const std::pair<const char*, derived_field::kind_t> kinds[] = {
+        {"length", derived_field::LENGTH},
+        {"crc16",  derived_field::CRC16},
+        {"crc32",  derived_field::CRC32},
+        {"crc32c", derived_field::CRC32C},
+        {"inet",   derived_field::INTERNET_CHECKSUM},
+    };
+
+    std::vector<derived_field> derived;
+    for (const auto& [index, spec] : specs) {
+        const packet_description::field& f = fields[index];
+        try {
+            const std::string kind = spec["kind"].get<std::string>();
+            auto k = std::find_if(std::begin(kinds), std::end(kinds), [&](const auto& e) { return kind == e.first; });
+            if (k == std::end(kinds)) {
+                spdlog::error("{}.{}: unknown derived kind {}", packet, f.name, kind);
+                continue;
+            }
+            if (f.anchor >= 0) {
+                spdlog::error("{}.{}: derived fields must be at a fixed offset", packet, f.name);
+                continue;
+            }
+            if (f.type == FLOAT_TYPE || f.type == DOUBLE_TYPE || f.type == INVALID_DATA_TYPE) {
+                spdlog::error("{}.{}: derived fields must be integers", packet, f.name);
+                continue;
+            }
+
+            bool ok = true;
+            derived_field d{
+                .kind = k->second,
+                .offset = f.offset,
+                .type = f.type,
+                .size = f.size,
+                .range_begin = spec.contains("from") ? resolve_offset(fields, spec["from"], ok) : 0,
+                .range_end = (!spec.contains("to") || spec["to"] == "end") ? -1 : resolve_offset(fields, spec["to"], ok),
+                .adjust = spec.value("adjust", 0),
+            };
+            if (!ok) {
+                spdlog::error("{}.{}: derived range names an unknown field or one without a fixed offset", packet, f.name);
+                continue;
+            }
+            const int needed = d.kind == derived_field::CRC32 || d.kind == derived_field::CRC32C ? 4
+                             : d.kind == derived_field::LENGTH ? 1 : 2;
+            if (f.size < needed) {
+                spdlog::warn("{}.{} is {} bytes, the {} value will be truncated", packet, f.name, f.size, kind);
+            }
+            derived.push_back(d);
+        }
+        catch (const std::exception& e) {
+            spdlog::error("{}.{}: bad derived field: {}", packet, f.name, e.what());
+        }
+    }
+    return derived;
+}
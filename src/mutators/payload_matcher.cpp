@@ -0,0 +1,141 @@
+#include <mm/mutators/payload_matcher.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace mm::mutators {
+
+void payload_matcher::clear() {
+    patterns.clear();
+    next.clear();
+    out_begin.clear();
+    out_slots.clear();
+    always.reset();
+    classes = 0;
+    states = 0;
+}
+
+void payload_matcher::add(const std::string& pattern, std::size_t slot) {
+    if (slot < MAX_SLOTS) {
+        patterns.push_back({pattern, slot});
+    }
+}
+
+void payload_matcher::build() {
+    next.clear();
+    out_begin.clear();
+    out_slots.clear();
+    always.reset();
+    states = 0;
+    if (patterns.empty()) {
+        return;
+    }
+
+    // Class 0 is every byte no pattern contains
+    byte_class.fill(0);
+    classes = 1;
+    for (const auto& p : patterns) {
+        for (unsigned char c : p.first) {
+            if (!byte_class[c]) {
+                byte_class[c] = uint8_t(classes++);
+            }
+        }
+    }
+    // With all 256 byte values in use class 0 doesn't fit; every byte then
+    // gets a class of its own, which is only a bigger table
+    if (classes > 256) {
+        for (int c = 0; c < 256; ++c) {
+            byte_class[c] = uint8_t(c);
+        }
+        classes = 256;
+    }
+
+    // Trie, with -1 for a missing edge
+    std::vector<int32_t> go(classes, -1);
+    std::vector<std::vector<uint16_t>> output(1);
+    for (const auto& [pattern, slot] : patterns) {
+        if (pattern.empty()) {
+            always.set(slot);
+            continue;
+        }
+        std::size_t s = 0;
+        for (unsigned char c : pattern) {
+            int32_t& edge = go[s * classes + byte_class[c]];
+            if (edge < 0) {
+                edge = int32_t(output.size());
+                output.emplace_back();
+                go.resize(go.size() + classes, -1);
+            }
+            s = std::size_t(go[s * classes + byte_class[c]]);
+        }
+        output[s].push_back(uint16_t(slot));
+    }
+    states = output.size();
+
+    // Breadth first: a state's failure link is shorter than itself, so it
+    // is complete (edges and outputs) before the state needs it. Missing
+    // edges are filled in from the failure link, which turns the trie into
+    // a DFA.
+    std::vector<uint32_t> fail(states, 0);
+    std::vector<uint32_t> queue;
+    queue.reserve(states);
+    for (std::size_t c = 0; c < classes; ++c) {
+        int32_t& edge = go[c];
+        if (edge < 0) {
+            edge = 0;
+        }
+        else {
+            queue.push_back(uint32_t(edge));
+        }
+    }
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+        const uint32_t s = queue[head];
+        auto& out = output[s];
+        out.insert(out.end(), output[fail[s]].begin(), output[fail[s]].end());
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+        for (std::size_t c = 0; c < classes; ++c) {
+            int32_t& edge = go[s * classes + c];
+            const int32_t via_fail = go[fail[s] * classes + c];
+            if (edge < 0) {
+                edge = via_fail;
+            }
+            else {
+                fail[edge] = uint32_t(via_fail);
+                queue.push_back(uint32_t(edge));
+            }
+        }
+    }
+
+    next.assign(go.begin(), go.end());
+    out_begin.reserve(states + 1);
+    for (const auto& out : output) {
+        out_begin.push_back(uint32_t(out_slots.size()));
+        out_slots.insert(out_slots.end(), out.begin(), out.end());
+    }
+    out_begin.push_back(uint32_t(out_slots.size()));
+
+    spdlog::debug("payload matcher: {} patterns, {} states, {} byte classes, {} KiB",
+                  patterns.size(), states, classes, next.size() * sizeof(uint32_t) / 1024);
+}
+
+void payload_matcher::scan(const unsigned char* data, std::size_t size, matches& out) const {
+    out = always;
+    if (!states) {
+        return;
+    }
+    const uint32_t* table = next.data();
+    const uint32_t* begin = out_begin.data();
+    uint32_t s = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        s = table[s * classes + byte_class[data[i]]];
+        if (begin[s] != begin[s + 1]) {
+            for (uint32_t k = begin[s]; k < begin[s + 1]; ++k) {
+                out.set(out_slots[k]);
+            }
+        }
+    }
+}
+
+}
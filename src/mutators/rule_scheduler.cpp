@@ -0,0 +1,193 @@
+#include <mm/mutators/rule_scheduler.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace mm::mutators {
+
+void rule_scheduler::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    num_words = 0;
+    active.reset();
+    scheduled.clear();
+    started.clear();
+    stopped.clear();
+    names.clear();
+    packets = 0;
+    packet_triggers.clear();
+    hit_slot.clear();
+    hits.reset();
+    hit_triggers.clear();
+    timed.clear();
+    next_timed = 0;
+}
+
+void rule_scheduler::build(const std::vector<rule_activation>& activations,
+                           const std::vector<std::string>& rule_names,
+                           std::chrono::steady_clock::time_point loaded) {
+    clear();
+    if (std::none_of(activations.begin(), activations.end(), [](const auto& a) { return a.any(); })) {
+        return;
+    }
+
+    num_words = (activations.size() + 63) / 64;
+    scheduled.assign(num_words, 0);
+    started.assign(num_words, 0);
+    stopped.assign(num_words, 0);
+    names = rule_names;
+    loaded_at = loaded;
+
+    std::size_t num_slots = 0;
+    for (std::size_t i = 0; i < activations.size(); ++i) {
+        const rule_activation& a = activations[i];
+        if (!a.any()) {
+            continue;
+        }
+        scheduled[i >> 6] |= 1ull << (i & 63);
+        if (a.from.kind == rule_trigger::NONE) {
+            started[i >> 6] |= 1ull << (i & 63);
+        }
+
+        for (const bool until : {false, true}) {
+            const rule_trigger& t = until ? a.until : a.from;
+            switch (t.kind) {
+                case rule_trigger::NONE:
+                    break;
+                case rule_trigger::ELAPSED:
+                case rule_trigger::WALL_CLOCK:
+                    timed.push_back({t, uint32_t(i), until, {}});
+                    break;
+                case rule_trigger::PACKETS:
+                    packet_triggers.push_back({uint64_t(t.value), uint32_t(i), until});
+                    break;
+                case rule_trigger::HITS:
+                    if (t.rule < 0 || std::size_t(t.rule) >= activations.size()) {
+                        break;
+                    }
+                    if (hit_slot.empty()) {
+                        hit_slot.assign(activations.size(), -1);
+                    }
+                    if (hit_slot[t.rule] < 0) {
+                        hit_slot[t.rule] = int32_t(num_slots++);
+                        hit_triggers.emplace_back();
+                    }
+                    hit_triggers[hit_slot[t.rule]].push_back({uint64_t(t.value), uint32_t(i), until});
+                    break;
+            }
+        }
+    }
+    if (num_slots) {
+        hits = std::make_unique<std::atomic<uint64_t>[]>(num_slots);
+    }
+
+    active = std::make_unique<std::atomic<uint64_t>[]>(num_words);
+    for (std::size_t w = 0; w < num_words; ++w) {
+        active[w] = ~scheduled[w] | (started[w] & ~stopped[w]);
+    }
+
+    // A count of zero has already been reached
+    std::vector<std::pair<uint32_t, bool>> at_zero;
+    for (const auto& t : packet_triggers) {
+        if (!t.count) at_zero.push_back({t.rule, t.until});
+    }
+    for (const auto& triggers : hit_triggers) {
+        for (const auto& t : triggers) {
+            if (!t.count) at_zero.push_back({t.rule, t.until});
+        }
+    }
+    for (const auto& [rule, until] : at_zero) {
+        fire(rule, until);
+    }
+
+    spdlog::debug("{} rules scheduled: {} timed, {} packet count and {} hit count triggers",
+                  std::count_if(activations.begin(), activations.end(), [](const auto& a) { return a.any(); }),
+                  timed.size(), packet_triggers.size(), num_slots);
+}
+
+void rule_scheduler::start(boost::asio::io_context& ctx) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (timer || timed.empty()) {
+        return;
+    }
+    // Wall clock times are placed on the steady clock once, here
+    const auto now = std::chrono::steady_clock::now();
+    const auto wall_now = std::chrono::system_clock::now().time_since_epoch();
+    for (auto& t : timed) {
+        if (t.trigger.kind == rule_trigger::ELAPSED) {
+            t.due = loaded_at + std::chrono::nanoseconds(t.trigger.value);
+        }
+        else {
+            t.due = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::nanoseconds(t.trigger.value) - wall_now);
+        }
+    }
+    std::stable_sort(timed.begin(), timed.end(), [](const auto& a, const auto& b) { return a.due < b.due; });
+    next_timed = 0;
+    timer = std::make_unique<boost::asio::steady_timer>(ctx);
+    arm();
+}
+
+// Called with mutex held
+void rule_scheduler::arm() {
+    if (next_timed >= timed.size()) {
+        return;
+    }
+    timer->expires_at(timed[next_timed].due);
+    timer->async_wait([this](const boost::system::error_code& ec) {
+        if (ec) {
+            return;
+        }
+        std::vector<std::pair<uint32_t, bool>> due;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto now = std::chrono::steady_clock::now();
+            for (; next_timed < timed.size() && timed[next_timed].due <= now; ++next_timed) {
+                due.push_back({timed[next_timed].rule, timed[next_timed].until});
+            }
+        }
+        for (const auto& [rule, until] : due) {
+            fire(rule, until);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        arm();
+    });
+}
+
+void rule_scheduler::count(uint64_t n, const std::vector<count_trigger>& triggers) {
+    for (const auto& t : triggers) {
+        if (t.count == n) {
+            fire(t.rule, t.until);
+        }
+    }
+}
+
+void rule_scheduler::fire(uint32_t rule, bool until) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::size_t w = rule >> 6;
+    const uint64_t bit = 1ull << (rule & 63);
+    const bool was_active = (started[w] & ~stopped[w]) & bit;
+    (until ? stopped : started)[w] |= bit;
+    const uint64_t now_active = started[w] & ~stopped[w];
+    active[w].store(~scheduled[w] | now_active, std::memory_order_release);
+
+    if (was_active != bool(now_active & bit)) {
+        const std::string& name = rule < names.size() ? names[rule] : std::string();
+        spdlog::info("Rule {} {}", name.empty() ? "#" + std::to_string(rule) : "\"" + name + "\"",
+                     until ? "deactivated" : "activated");
+    }
+}
+
+void rule_scheduler::fill(uint64_t* mask) const {
+    for (std::size_t w = 0; w < num_words; ++w) {
+        mask[w] = active[w].load(std::memory_order_acquire);
+    }
+}
+
+void rule_scheduler::restrict(uint64_t* mask) const {
+    for (std::size_t w = 0; w < num_words; ++w) {
+        mask[w] &= active[w].load(std::memory_order_acquire);
+    }
+}
+
+}
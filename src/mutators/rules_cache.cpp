@@ -0,0 +1,385 @@
+#include <mm/mutators/rules_cache.hpp>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace {
+
+// FNV-1a, 64 bit
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+struct cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint64_t payload_size;
+};
+
+class cache_writer {
+public:
+    template<typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "cache_writer::put needs a POD");
+        buf.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void put_string(const std::string& s) {
+        put<uint32_t>(s.size());
+        buf.append(s);
+    }
+
+    std::string buf;
+};
+
+// Bounds-checked reader over the mapped file; any overrun marks it failed.
+class cache_reader {
+public:
+    cache_reader(const char* data, size_t size) : cur(data), end(data + size) {}
+
+    template<typename T>
+    T get() {
+        T value{};
+        if (!take(&value, sizeof(T))) return T{};
+        return value;
+    }
+
+    std::string get_string() {
+        uint32_t size = get<uint32_t>();
+        if (!ok || size > size_t(end - cur)) { ok = false; return {}; }
+        std::string s(cur, size);
+        cur += size;
+        return s;
+    }
+
+    bool good() const { return ok; }
+
+private:
+    bool take(void* dst, size_t size) {
+        if (!ok || size > size_t(end - cur)) { ok = false; return false; }
+        std::memcpy(dst, cur, size);
+        cur += size;
+        return true;
+    }
+
+    const char* cur;
+    const char* end;
+    bool ok = true;
+};
+
+void write_condition(cache_writer& w, const Condition& c) {
+    w.put<int32_t>(c.data_offset);
+    w.put<int32_t>(c.data_size);
+    w.put<int32_t>(c.type);
+    w.put<int32_t>(c.operation);
+    w.put(c.value_d);
+    w.put(c.value_u);
+    w.put(c.value_i);
+    w.put(c.anchor);
+    w.put(c.mask);
+    w.put(c.shift);
+    w.put_string(c.bytes);
+    w.put<uint32_t>(c.patterns.size());
+    for (const auto& p : c.patterns) {
+        w.put_string(p);
+    }
+}
+
+Condition read_condition(cache_reader& r) {
+    Condition c{};
+    c.data_offset = r.get<int32_t>();
+    c.data_size   = r.get<int32_t>();
+    c.type        = static_cast<data_type>(r.get<int32_t>());
+    c.operation   = r.get<int32_t>();
+    c.value_d     = r.get<double>();
+    c.value_u     = r.get<uint64_t>();
+    c.value_i     = r.get<int64_t>();
+    c.anchor      = r.get<field_anchor>();
+    c.mask        = r.get<uint64_t>();
+    c.shift       = r.get<uint8_t>();
+    c.bytes       = r.get_string();
+    uint32_t num_patterns = r.get<uint32_t>();
+    for (uint32_t i = 0; i < num_patterns && r.good(); ++i) {
+        c.patterns.push_back(r.get_string());
+    }
+    return c;
+}
+
+void write_mutation(cache_writer& w, const Mutation& m) {
+    w.put<int32_t>(m.data_offset);
+    w.put<int32_t>(m.data_size);
+    w.put<int32_t>(m.type);
+    w.put(m.new_value_d);
+    w.put(m.new_value_u);
+    w.put(m.new_value_i);
+    w.put<uint8_t>(m.program.floating);
+    w.put<uint8_t>(m.program.uses_clock);
+    w.put<int32_t>(m.program.counter_slot);
+    w.put<uint32_t>(m.program.code.size());
+    for (const auto& in : m.program.code) {
+        w.put(in);
+    }
+    w.put(m.anchor);
+    w.put(m.mask);
+    w.put(m.shift);
+    w.put_string(m.bytes);
+    w.put(m.fuzz);
+}
+
+Mutation read_mutation(cache_reader& r) {
+    Mutation m{};
+    m.data_offset = r.get<int32_t>();
+    m.data_size   = r.get<int32_t>();
+    m.type        = static_cast<data_type>(r.get<int32_t>());
+    m.new_value_d = r.get<double>();
+    m.new_value_u = r.get<uint64_t>();
+    m.new_value_i = r.get<int64_t>();
+    m.program.floating     = r.get<uint8_t>() != 0;
+    m.program.uses_clock   = r.get<uint8_t>() != 0;
+    m.program.counter_slot = r.get<int32_t>();
+    uint32_t code_size = r.get<uint32_t>();
+    for (uint32_t i = 0; i < code_size && r.good(); ++i) {
+        m.program.code.push_back(r.get<mm::mutators::expression_insn>());
+    }
+    m.anchor = r.get<field_anchor>();
+    m.mask   = r.get<uint64_t>();
+    m.shift  = r.get<uint8_t>();
+    m.bytes  = r.get_string();
+    m.fuzz   = r.get<fuzz_spec>();
+    return m;
+}
+
+void write_action(cache_writer& w, const rule_action& a) {
+    w.put<uint8_t>(a.drop);
+    w.put(a.copies);
+    w.put(a.delay_us);
+    w.put<uint8_t>(a.redirect);
+    w.put_string(a.redirect ? a.redirect_to.address().to_string() : std::string());
+    w.put<uint16_t>(a.redirect_to.port());
+}
+
+rule_action read_action(cache_reader& r) {
+    rule_action a;
+    a.drop     = r.get<uint8_t>() != 0;
+    a.copies   = r.get<uint16_t>();
+    a.delay_us = r.get<uint32_t>();
+    a.redirect = r.get<uint8_t>() != 0;
+    const std::string address = r.get_string();
+    const uint16_t port = r.get<uint16_t>();
+    if (a.redirect) {
+        boost::system::error_code ec;
+        a.redirect_to = {boost::asio::ip::make_address(address, ec), port};
+        a.redirect = !ec;
+    }
+    return a;
+}
+
+void write_packet(cache_writer& w, const packet_description& pd) {
+    w.put_string(pd.name);
+    w.put_string(pd.opcode_field);
+    w.put<int32_t>(pd.opcode);
+    w.put<uint32_t>(pd.fields.size());
+    for (const auto& f : pd.fields) {
+        w.put_string(f.name);
+        w.put<int32_t>(f.offset);
+        w.put<int32_t>(f.type);
+        w.put_string(f.type_str);
+        w.put<int32_t>(f.size);
+        w.put<int32_t>(f.anchor);
+        w.put<uint8_t>(f.element);
+        w.put<uint8_t>(f.bit_offset);
+        w.put<uint8_t>(f.bit_width);
+    }
+    w.put<uint32_t>(pd.derived.size());
+    for (const auto& d : pd.derived) {
+        w.put(d);
+    }
+    w.put<uint32_t>(pd.sections.size());
+    for (const auto& s : pd.sections) {
+        w.put(s);
+    }
+}
+
+void read_packet(cache_reader& r, packet_types& out) {
+    std::string name = r.get_string();
+    std::string opcode_field = r.get_string();
+    int opcode = r.get<int32_t>();
+    uint32_t count = r.get<uint32_t>();
+    std::vector<packet_description::field> fields;
+    for (uint32_t i = 0; i < count && r.good(); ++i) {
+        packet_description::field f;
+        f.name     = r.get_string();
+        f.offset   = r.get<int32_t>();
+        f.type     = static_cast<data_type>(r.get<int32_t>());
+        f.type_str = r.get_string();
+        f.size     = r.get<int32_t>();
+        f.anchor   = r.get<int32_t>();
+        f.element  = r.get<uint8_t>() != 0;
+        f.bit_offset = r.get<uint8_t>();
+        f.bit_width  = r.get<uint8_t>();
+        fields.push_back(std::move(f));
+    }
+    std::vector<derived_field> derived;
+    uint32_t num_derived = r.get<uint32_t>();
+    for (uint32_t i = 0; i < num_derived && r.good(); ++i) {
+        derived.push_back(r.get<derived_field>());
+    }
+    std::vector<dynamic_section> sections;
+    uint32_t num_sections = r.get<uint32_t>();
+    for (uint32_t i = 0; i < num_sections && r.good(); ++i) {
+        sections.push_back(r.get<dynamic_section>());
+    }
+    if (r.good()) {
+        out.push_back(packet_description(name, opcode_field, opcode, fields));
+        out.back().derived = std::move(derived);
+        out.back().sections = std::move(sections);
+    }
+}
+
+}
+
+namespace mm::mutators {
+
+uint64_t rules_cache::source_hash(const std::string& types_text, const std::string& rules_text) {
+    uint64_t h = fnv1a(&VERSION, sizeof(VERSION));
+    h = fnv1a(types_text.data(), types_text.size(), h);
+    // Separator so moving bytes between the two sources changes the key
+    const char sep = '\0';
+    h = fnv1a(&sep, 1, h);
+    return fnv1a(rules_text.data(), rules_text.size(), h);
+}
+
+bool rules_cache::load(const std::string& path, uint64_t hash,
+                       packet_types& types, std::vector<Rule>& rules) {
+    namespace bip = boost::interprocess;
+
+    std::ifstream probe(path, std::ios::binary);
+    if (!probe) {
+        return false;
+    }
+    probe.close();
+
+    try {
+        bip::file_mapping file(path.c_str(), bip::read_only);
+        bip::mapped_region region(file, bip::read_only);
+        const char* base = static_cast<const char*>(region.get_address());
+        const size_t size = region.get_size();
+
+        cache_header header{};
+        if (size < sizeof(header)) return false;
+        std::memcpy(&header, base, sizeof(header));
+        if (header.magic != MAGIC || header.version != VERSION || header.hash != hash ||
+            header.payload_size != size - sizeof(header)) {
+            spdlog::debug("rules cache {} is stale", path);
+            return false;
+        }
+
+        cache_reader r(base + sizeof(header), header.payload_size);
+        packet_types loaded_types;
+        uint32_t num_types = r.get<uint32_t>();
+        loaded_types.reserve(std::min<size_t>(num_types, header.payload_size));
+        for (uint32_t i = 0; i < num_types && r.good(); ++i) {
+            read_packet(r, loaded_types);
+        }
+
+        std::vector<Rule> loaded_rules;
+        uint32_t num_rules = r.get<uint32_t>();
+        for (uint32_t i = 0; i < num_rules && r.good(); ++i) {
+            Rule rule{};
+            uint32_t num_conditions = r.get<uint32_t>();
+            for (uint32_t c = 0; c < num_conditions && r.good(); ++c) {
+                rule.conditions.push_back(read_condition(r));
+            }
+            uint32_t num_mutations = r.get<uint32_t>();
+            for (uint32_t m = 0; m < num_mutations && r.good(); ++m) {
+                rule.mutations.push_back(read_mutation(r));
+            }
+            rule.action = read_action(r);
+            uint32_t num_from = r.get<uint32_t>();
+            for (uint32_t f = 0; f < num_from && r.good(); ++f) {
+                rule.from.push_back(r.get<mm::mutators::sender_scope>());
+            }
+            rule.name = r.get_string();
+            rule.active.from = r.get<mm::mutators::rule_trigger>();
+            rule.active.until = r.get<mm::mutators::rule_trigger>();
+            rule.probability = r.get<double>();
+            loaded_rules.push_back(std::move(rule));
+        }
+
+        if (!r.good()) {
+            spdlog::warn("rules cache {} is malformed, ignoring it", path);
+            return false;
+        }
+        types = std::move(loaded_types);
+        rules = std::move(loaded_rules);
+        return true;
+    }
+    catch (const bip::interprocess_exception& e) {
+        spdlog::warn("Failed to map rules cache {}: {}", path, e.what());
+        return false;
+    }
+}
+
+bool rules_cache::store(const std::string& path, uint64_t hash,
+                        const packet_types& types, const std::vector<Rule>& rules) {
+    cache_writer w;
+    w.put<uint32_t>(types.size());
+    for (const auto& pd : types) {
+        write_packet(w, pd);
+    }
+    w.put<uint32_t>(rules.size());
+    for (const auto& rule : rules) {
+        w.put<uint32_t>(rule.conditions.size());
+        for (const auto& c : rule.conditions) write_condition(w, c);
+        w.put<uint32_t>(rule.mutations.size());
+        for (const auto& m : rule.mutations) write_mutation(w, m);
+        write_action(w, rule.action);
+        w.put<uint32_t>(rule.from.size());
+        for (const auto& scope : rule.from) w.put(scope);
+        w.put_string(rule.name);
+        w.put(rule.active.from);
+        w.put(rule.active.until);
+        w.put(rule.probability);
+    }
+
+    cache_header header{MAGIC, VERSION, hash, w.buf.size()};
+
+    // Write next to the target and rename so readers never map a partial file
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            spdlog::debug("Could not write rules cache {}", tmp_path);
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(w.buf.data(), w.buf.size());
+        if (!out) {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        // Windows won't rename over an existing file
+        std::remove(path.c_str());
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+}
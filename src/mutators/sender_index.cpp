@@ -0,0 +1,291 @@
+#include <mm/mutators/sender_index.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace mm::mutators {
+
+namespace {
+
+// Decimal digits only; strtol alone would take signs and spaces
+bool parse_number(const std::string& text, long max, long& value) {
+    if (text.empty() || text.size() > 5 ||
+        !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return false;
+    }
+    value = std::strtol(text.c_str(), nullptr, 10);
+    return value <= max;
+}
+
+bool parse_port(const std::string& text, uint16_t& port) {
+    long value = 0;
+    if (!parse_number(text, 65535, value) || value == 0) {
+        return false;
+    }
+    port = uint16_t(value);
+    return true;
+}
+
+bool is_v4_mapped(const unsigned char* addr) {
+    for (int i = 0; i < 10; ++i) {
+        if (addr[i]) {
+            return false;
+        }
+    }
+    return addr[10] == 0xff && addr[11] == 0xff;
+}
+
+mm::network::flow_key host_key(const sender_scope& scope, uint16_t port) {
+    mm::network::flow_key key;
+    if (scope.v4) {
+        key.addr[10] = key.addr[11] = 0xff;
+        std::memcpy(key.addr.data() + 12, scope.addr.data(), 4);
+    }
+    else {
+        key.addr = scope.addr;
+    }
+    key.port = port;
+    return key;
+}
+
+}
+
+bool parse_sender_scope(const std::string& text, sender_scope (&out)[2], int& count) {
+    std::string host = text;
+    uint16_t port = 0;
+    count = 0;
+
+    // Split off the port: "[v6]:port", "v4:port" or "*:port". A bare IPv6
+    // address has more than one colon and no port.
+    if (!host.empty() && host.front() == '[') {
+        const auto close = host.find(']');
+        if (close == std::string::npos) {
+            return false;
+        }
+        if (close + 1 < host.size()) {
+            if (host[close + 1] != ':' || !parse_port(host.substr(close + 2), port)) {
+                return false;
+            }
+        }
+        host = host.substr(1, close - 1);
+    }
+    else if (std::count(host.begin(), host.end(), ':') == 1) {
+        const auto colon = host.find(':');
+        if (!parse_port(host.substr(colon + 1), port)) {
+            return false;
+        }
+        host = host.substr(0, colon);
+    }
+
+    if (host == "*") {
+        out[0] = sender_scope{.prefix = 0, .v4 = 1, .port = port};
+        out[1] = sender_scope{.prefix = 0, .v4 = 0, .port = port};
+        count = 2;
+        return true;
+    }
+
+    int prefix = -1;
+    const auto slash = host.find('/');
+    if (slash != std::string::npos) {
+        long value = 0;
+        if (!parse_number(host.substr(slash + 1), 128, value)) {
+            return false;
+        }
+        prefix = int(value);
+        host = host.substr(0, slash);
+    }
+
+    boost::system::error_code ec;
+    auto address = boost::asio::ip::make_address(host, ec);
+    if (ec) {
+        return false;
+    }
+    if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+        // Mapped senders are matched as IPv4, so the prefix has to stay
+        // inside the mapped range
+        if (prefix >= 0 && prefix < 96) {
+            return false;
+        }
+        address = boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, address.to_v6());
+        prefix = prefix < 0 ? -1 : prefix - 96;
+    }
+
+    sender_scope& scope = out[0];
+    scope = sender_scope{};
+    scope.port = port;
+    if (address.is_v4()) {
+        const auto bytes = address.to_v4().to_bytes();
+        std::memcpy(scope.addr.data(), bytes.data(), 4);
+        scope.v4 = 1;
+    }
+    else {
+        scope.addr = address.to_v6().to_bytes();
+    }
+    const int bits = scope.v4 ? 32 : 128;
+    if (prefix > bits) {
+        return false;
+    }
+    scope.prefix = uint8_t(prefix < 0 ? bits : prefix);
+
+    // Host bits past the prefix are ignored, "10.1.2.3/16" means 10.1.0.0/16
+    for (int i = scope.prefix; i < bits; ++i) {
+        scope.addr[i >> 3] &= uint8_t(~(0x80u >> (i & 7)));
+    }
+    count = 1;
+    return true;
+}
+
+void sender_index::clear() {
+    scoped.clear();
+    unscoped.clear();
+    num_words = 0;
+    masks.clear();
+    hosts.clear();
+    trie_v4.clear();
+    trie_v6.clear();
+}
+
+void sender_index::add(const sender_scope& scope, std::size_t rule) {
+    scoped.push_back({scope, rule});
+}
+
+void sender_index::add_any(std::size_t rule) {
+    unscoped.push_back(rule);
+}
+
+uint32_t sender_index::new_entry() {
+    masks.resize(masks.size() + num_words, 0);
+    return uint32_t(masks.size() / num_words - 1);
+}
+
+void sender_index::set_bit(uint32_t entry, std::size_t rule) {
+    masks[entry * num_words + (rule >> 6)] |= 1ull << (rule & 63);
+}
+
+void sender_index::or_entry(uint32_t entry, uint64_t* out) const {
+    const uint64_t* mask = masks.data() + entry * num_words;
+    for (std::size_t w = 0; w < num_words; ++w) {
+        out[w] |= mask[w];
+    }
+}
+
+void sender_index::build(std::size_t num_rules) {
+    masks.clear();
+    hosts.clear();
+    trie_v4.clear();
+    trie_v6.clear();
+    num_words = (num_rules + 63) / 64;
+    if (scoped.empty() || !num_words) {
+        return;
+    }
+
+    new_entry();
+    for (std::size_t rule : unscoped) {
+        set_bit(0, rule);
+    }
+
+    for (const auto& [scope, rule] : scoped) {
+        const int bits = scope.v4 ? 32 : 128;
+        if (scope.prefix == bits) {
+            auto [it, inserted] = hosts.try_emplace(host_key(scope, scope.port), 0);
+            if (inserted) {
+                it->second = new_entry();
+            }
+            set_bit(it->second, rule);
+            continue;
+        }
+
+        auto& trie = scope.v4 ? trie_v4 : trie_v6;
+        if (trie.empty()) {
+            trie.emplace_back();
+        }
+        int32_t n = 0;
+        for (int i = 0; i < scope.prefix; ++i) {
+            const int bit = (scope.addr[i >> 3] >> (7 - (i & 7))) & 1;
+            if (trie[n].child[bit] < 0) {
+                trie[n].child[bit] = int32_t(trie.size());
+                trie.emplace_back();
+            }
+            n = trie[n].child[bit];
+        }
+        uint32_t entry;
+        if (!scope.port) {
+            if (trie[n].any_port < 0) {
+                trie[n].any_port = int32_t(new_entry());
+            }
+            entry = uint32_t(trie[n].any_port);
+        }
+        else {
+            auto& ports = trie[n].ports;
+            auto it = std::find_if(ports.begin(), ports.end(), [&](const auto& p) { return p.first == scope.port; });
+            if (it == ports.end()) {
+                ports.push_back({scope.port, new_entry()});
+                it = ports.end() - 1;
+            }
+            entry = it->second;
+        }
+        set_bit(entry, rule);
+    }
+
+    spdlog::debug("{} scoped rules: {} hosts, {} + {} trie nodes",
+                  scoped.size(), hosts.size(), trie_v4.size(), trie_v6.size());
+}
+
+void sender_index::walk(const std::vector<node>& trie, const unsigned char* addr, int bits, uint16_t port, uint64_t* out) const {
+    if (trie.empty()) {
+        return;
+    }
+    int32_t n = 0;
+    for (int i = 0;; ++i) {
+        const node& at = trie[n];
+        if (at.any_port >= 0) {
+            or_entry(uint32_t(at.any_port), out);
+        }
+        for (const auto& [p, entry] : at.ports) {
+            if (p == port) {
+                or_entry(entry, out);
+            }
+        }
+        if (i == bits) {
+            return;
+        }
+        n = at.child[(addr[i >> 3] >> (7 - (i & 7))) & 1];
+        if (n < 0) {
+            return;
+        }
+    }
+}
+
+void sender_index::select(const mm::network::Endpoint* sender, uint64_t* out) const {
+    if (masks.empty()) {
+        return;
+    }
+    std::memcpy(out, masks.data(), num_words * sizeof(uint64_t));
+    if (!sender) {
+        return;
+    }
+
+    mm::network::flow_key key(*sender);
+    if (!hosts.empty()) {
+        if (auto it = hosts.find(key); it != hosts.end()) {
+            or_entry(it->second, out);
+        }
+        const uint16_t port = key.port;
+        key.port = 0;
+        if (auto it = hosts.find(key); it != hosts.end()) {
+            or_entry(it->second, out);
+        }
+        key.port = port;
+    }
+    if (is_v4_mapped(key.addr.data())) {
+        walk(trie_v4, key.addr.data() + 12, 32, key.port, out);
+    }
+    else {
+        walk(trie_v6, key.addr.data(), 128, key.port, out);
+    }
+}
+
+}
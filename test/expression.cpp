@@ -0,0 +1,156 @@
+// Expression-valued mutations, compiled from rule text and run on packets.
+#include <mm/mutators/json_rule_based_mutator.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace mm::mutators;
+using mm::network::Buffer;
+using mm::network::Endpoint;
+
+static const char* TYPES_FILE = "expression_test_types.json";
+
+// Big endian on the wire
+static const int I16 = 1, U32 = 3, F = 7, D = 11, U8 = 19, I64 = 20, SIZE = 28;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::printf("FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+template<typename T>
+static void put(Buffer& b, int offset, T v) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &v, sizeof(T));
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        b[offset + i] = bytes[sizeof(T) - 1 - i];
+    }
+}
+
+template<typename T>
+static T get(const Buffer& b, int offset) {
+    unsigned char bytes[sizeof(T)];
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        bytes[sizeof(T) - 1 - i] = b[offset + i];
+    }
+    T v;
+    std::memcpy(&v, bytes, sizeof(T));
+    return v;
+}
+
+static std::shared_ptr<json_rule_based_mutator> mutator_for(const std::string& field, const std::string& expr) {
+    const std::string rules = R"({"rules":[{"conditions":[],"mutations":[{"field":")" + field +
+                              R"(","expr":")" + expr + R"("}]}]})";
+    return json_rule_based_mutator::fromJsonString(TYPES_FILE, rules, true);
+}
+
+static std::shared_ptr<Buffer> packet() {
+    auto b = std::make_shared<Buffer>(64, 0);
+    (*b)[0] = 7;
+    put<int16_t>(*b, I16, -3);
+    put<uint32_t>(*b, U32, 7);
+    put<float>(*b, F, 10.0f);
+    put<double>(*b, D, 0.0);
+    put<uint8_t>(*b, U8, 10);
+    put<int64_t>(*b, I64, 0x4000000000000001);
+    return b;
+}
+
+static const auto sender_a = std::make_shared<Endpoint>(boost::asio::ip::make_address("10.0.0.1"), 1000);
+static const auto sender_b = std::make_shared<Endpoint>(boost::asio::ip::make_address("10.0.0.2"), 1000);
+
+// Runs expr on field of a fresh packet and returns the packet
+static std::shared_ptr<Buffer> run(const std::string& field, const std::string& expr) {
+    auto b = packet();
+    mutator_for(field, expr)->mutate_packet(b, sender_a, SIZE);
+    return b;
+}
+
+static void expect_u32(const std::string& expr, uint32_t want) {
+    const uint32_t got = get<uint32_t>(*run("u32", expr), U32);
+    check(got == want, "\"" + expr + "\" gave " + std::to_string(got) + ", expected " + std::to_string(want));
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::off);
+    std::ofstream(TYPES_FILE) << R"({"packets":[{"name":"msg","opcode_field":"kind","opcode":7,"data":[
+        {"value":"kind","type":"uint8"},{"value":"i16","type":"int16"},{"value":"u32","type":"uint32"},
+        {"value":"f","type":"float"},{"value":"d","type":"double"},{"value":"u8","type":"uint8"},
+        {"value":"i64","type":"int64"}]}]})";
+
+    // Constants fold, with the usual precedence and left associativity
+    expect_u32("2 + 3 * 4", 14);
+    expect_u32("(2 + 3) * 4", 20);
+    expect_u32("10 - 4 - 3", 3);
+    expect_u32("100 / 7 % 4", 2);
+    expect_u32("-(3 - 5)", 2);
+    expect_u32("+5", 5);
+    expect_u32("0x10 + 1", 17);
+    expect_u32("010 + 1", 11);
+    expect_u32("1e2", 100);
+
+    // Fields and the mutated value
+    expect_u32("value + 10", 17);
+    expect_u32("value * 0.5", 3);
+    expect_u32("i16 * 2 + u8", 4);
+    expect_u32("u8 - value", 3);
+    expect_u32("(value + 1) * (value - 1)", 48);
+    expect_u32("value / 0", 0);
+    expect_u32("value % 0", 0);
+    expect_u32("msg.u8 * 3", 30);
+
+    // Integer arithmetic wraps, doubles saturate at the field's range
+    check(get<int64_t>(*run("i64", "value * 2"), I64) == int64_t(0x8000000000000002ull), "int64 wraps");
+    check(get<uint8_t>(*run("u8", "value * 1000.0"), U8) == 255, "uint8 saturates high");
+    check(get<uint8_t>(*run("u8", "value - 300.0"), U8) == 0, "uint8 saturates low");
+    check(get<uint8_t>(*run("u8", "-1.5"), U8) == 0, "negative constant saturates");
+
+    // Floating point targets or operands compute in double
+    check(get<float>(*run("f", "value / 4"), F) == 2.5f, "float target");
+    check(get<double>(*run("d", "u32 / 2"), D) == 3.5, "double target from integer field");
+    check(get<double>(*run("d", "f * i16"), D) == -30.0, "float and integer operands");
+
+    // counter is per sender
+    {
+        auto m = mutator_for("u32", "counter");
+        uint32_t seen[4];
+        for (int i = 0; i < 3; ++i) {
+            auto b = packet();
+            m->mutate_packet(b, sender_a, SIZE);
+            seen[i] = get<uint32_t>(*b, U32);
+        }
+        auto b = packet();
+        m->mutate_packet(b, sender_b, SIZE);
+        seen[3] = get<uint32_t>(*b, U32);
+        check(seen[0] == 0 && seen[1] == 1 && seen[2] == 2 && seen[3] == 0, "counter per sender");
+    }
+
+    check(get<uint32_t>(*run("u32", "elapsed_ms"), U32) < 60000, "elapsed_ms");
+
+    // Bad expressions leave the field alone
+    for (const char* bad : {"value +", "nosuch + 1", "(1", "1)", "1 2", "12abc", "1.5.5", "0x", "value $ 2",
+                            "()", "*3", "1a", "08x"}) {
+        const uint32_t got = get<uint32_t>(*run("u32", bad), U32);
+        check(got == 7, std::string("bad expression \"") + bad + "\" was applied");
+    }
+
+    // Each right-nested operand takes a register; 16 values fit
+    std::string nested = "value", too_deep;
+    for (int i = 0; i < 15; ++i) {
+        nested = "value + (" + nested + ")";
+    }
+    too_deep = "value + (" + nested + ")";
+    expect_u32(nested, 16 * 7);
+    check(get<uint32_t>(*run("u32", too_deep), U32) == 7, "too deeply nested expression was applied");
+
+    std::remove(TYPES_FILE);
+    std::remove((std::string(TYPES_FILE) + ".rules.mmcache").c_str());
+    std::printf("%s\n", failures ? "expression: FAILED" : "expression: ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+// A bidirectional proxy with room for one flow: the first client is
+// forwarded, the second is turned away without touching a freed flow.
+#include <mm/network/middleman_proxy.hpp>
+
+#include <cstdio>
+
+using namespace mm::network;
+
+int main() {
+    spdlog::set_level(spdlog::level::warn);
+    boost::asio::io_context ctx;
+    const auto loopback = boost::asio::ip::make_address("127.0.0.1");
+
+    int received = 0;
+    auto server = std::make_shared<UDPTransport>(&ctx);
+    server->setReadCallback([&](auto, BufferPtr, EndpointPtr, auto&, std::size_t) { ++received; });
+    server->startListening(Endpoint(loopback, 3601));
+
+    middleman_proxy::settings settings{
+        .local_host = "127.0.0.1",
+        .local_port = 3600,
+        .remote_host = "127.0.0.1",
+        .remote_port = 3601,
+        .multicast_enabled = false,
+        .multicast_group = "",
+        .multicast_ttl = 1,
+        .mutator = nullptr,
+        .log_to_stdout = false,
+        .bidirectional = true,
+        .max_flows = 1,
+    };
+    middleman_proxy proxy(&ctx, settings);
+
+    auto first = std::make_shared<UDPTransport>(&ctx);
+    auto second = std::make_shared<UDPTransport>(&ctx);
+    for (int i = 0; i < 5; ++i) {
+        first->send_to("first", Endpoint(loopback, 3600));
+        second->send_to("second", Endpoint(loopback, 3600));
+    }
+    ctx.run_for(std::chrono::milliseconds(300));
+    server->stopListening();
+
+    const bool ok = proxy.getFlowCount() == 1 && proxy.getRejectedFlowCount() == 5 && received == 5;
+    std::printf("flows %zu, rejected %lu, received %d: %s\n", proxy.getFlowCount(),
+                (unsigned long)proxy.getRejectedFlowCount(), received, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
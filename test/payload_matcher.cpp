@@ -0,0 +1,143 @@
+// The Aho-Corasick matcher against a plain search for every pattern.
+#include <mm/mutators/payload_matcher.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+using namespace mm::mutators;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+using pattern_list = std::vector<std::pair<std::string, std::size_t>>;
+
+static payload_matcher::matches expected(const pattern_list& patterns, const std::string& data) {
+    payload_matcher::matches m;
+    for (const auto& [pattern, slot] : patterns) {
+        if (std::search(data.begin(), data.end(), pattern.begin(), pattern.end()) != data.end()) {
+            m.set(slot);
+        }
+    }
+    return m;
+}
+
+static payload_matcher::matches scan(const payload_matcher& matcher, const std::string& data) {
+    payload_matcher::matches m;
+    matcher.scan(reinterpret_cast<const unsigned char*>(data.data()), data.size(), m);
+    return m;
+}
+
+static payload_matcher build(const pattern_list& patterns) {
+    payload_matcher matcher;
+    for (const auto& [pattern, slot] : patterns) {
+        matcher.add(pattern, slot);
+    }
+    matcher.build();
+    return matcher;
+}
+
+int main() {
+    // Overlapping patterns, one a suffix or prefix of another
+    {
+        const pattern_list patterns = {{"he", 0}, {"she", 1}, {"his", 2}, {"hers", 3}, {"s", 4}, {"ushers", 5}};
+        const payload_matcher matcher = build(patterns);
+        for (const char* text : {"ushers", "ahishers", "she", "h", "", "xyz", "hehehe", "sssss"}) {
+            if (scan(matcher, text) != expected(patterns, text)) {
+                std::printf("FAILED: overlapping patterns in \"%s\"\n", text);
+                ++failures;
+            }
+        }
+        check(scan(matcher, "ushers").count() == 5, "all but \"his\" in \"ushers\"");
+    }
+
+    // Several patterns per slot: any of them matches the slot
+    {
+        const pattern_list patterns = {{"abc", 7}, {"xyz", 7}, {"abc", 9}};
+        const payload_matcher matcher = build(patterns);
+        check(scan(matcher, "--xyz--").test(7) && !scan(matcher, "--xyz--").test(9), "slot shared by two patterns");
+        check(scan(matcher, "abc").test(7) && scan(matcher, "abc").test(9), "pattern shared by two slots");
+    }
+
+    // Binary patterns, including NUL and 0xff, and a match at either end
+    {
+        const pattern_list patterns = {{std::string("\0\0", 2), 0}, {"\xff\xfe", 1}, {std::string("\x01\0\x02", 3), 2}};
+        const payload_matcher matcher = build(patterns);
+        const std::string data = std::string("\xff\xfe\x01\0\x02\x33\0\0", 8);
+        check(scan(matcher, data) == expected(patterns, data) && scan(matcher, data).count() == 3, "binary patterns");
+        check(scan(matcher, std::string("\0", 1)).none(), "partial binary pattern");
+    }
+
+    // An empty pattern matches every datagram, even an empty one
+    {
+        const payload_matcher matcher = build({{"", 3}, {"q", 4}});
+        check(scan(matcher, "").test(3) && !scan(matcher, "").test(4), "empty pattern");
+        check(scan(matcher, "zzq").count() == 2, "empty pattern beside another");
+    }
+
+    // Every byte value in use leaves no spare byte class
+    {
+        pattern_list patterns;
+        for (int c = 0; c < 256; ++c) {
+            patterns.push_back({std::string(1, char(c)) + char(255 - c), std::size_t(c)});
+        }
+        const payload_matcher matcher = build(patterns);
+        std::string data;
+        for (int c = 0; c < 256; c += 3) {
+            data += char(c);
+            data += char(255 - c);
+            data += char(c);
+        }
+        check(scan(matcher, data) == expected(patterns, data), "all 256 byte values");
+    }
+
+    // No patterns, and rebuilding after clear()
+    {
+        payload_matcher matcher;
+        matcher.build();
+        check(matcher.empty() && scan(matcher, "abc").none(), "no patterns");
+        matcher.add("abc", 1);
+        matcher.build();
+        matcher.clear();
+        matcher.add("xy", 2);
+        matcher.build();
+        check(scan(matcher, "abcxy").count() == 1 && scan(matcher, "abcxy").test(2), "rebuilt after clear");
+    }
+
+    // Random patterns over a small alphabet, so matches and partial
+    // matches are frequent
+    std::mt19937 rng(12345);
+    for (int round = 0; round < 200; ++round) {
+        const int alphabet = 2 + int(rng() % 6);
+        auto random_string = [&](std::size_t max) {
+            std::string s(1 + rng() % max, '\0');
+            for (char& c : s) {
+                c = char('a' + rng() % alphabet);
+            }
+            return s;
+        };
+        pattern_list patterns;
+        const std::size_t count = 1 + rng() % 40;
+        for (std::size_t i = 0; i < count; ++i) {
+            patterns.push_back({random_string(8), rng() % payload_matcher::MAX_SLOTS});
+        }
+        const payload_matcher matcher = build(patterns);
+        for (int k = 0; k < 20; ++k) {
+            const std::string data = random_string(200);
+            if (scan(matcher, data) != expected(patterns, data)) {
+                std::printf("FAILED: random round %d\n", round);
+                ++failures;
+                break;
+            }
+        }
+    }
+
+    std::printf("%s\n", failures ? "payload_matcher: FAILED" : "payload_matcher: ok");
+    return failures ? 1 : 0;
+}
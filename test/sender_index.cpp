@@ -0,0 +1,150 @@
+// Parsing of rule "from" entries and matching senders against them.
+#include <mm/mutators/sender_index.hpp>
+
+#include <cstdio>
+#include <initializer_list>
+
+using namespace mm::mutators;
+using mm::network::Endpoint;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+static bool parses(const char* text, int expect_count = 1) {
+    sender_scope out[2];
+    int count = 0;
+    return parse_sender_scope(text, out, count) && count == expect_count;
+}
+
+static sender_scope scope_of(const char* text) {
+    sender_scope out[2];
+    int count = 0;
+    parse_sender_scope(text, out, count);
+    return out[0];
+}
+
+// Rule i is scoped to scopes[i]; returns the rules selected for sender
+static uint64_t select(std::initializer_list<const char*> scopes, const char* address, unsigned short port) {
+    sender_index index;
+    std::size_t rule = 0;
+    for (const char* text : scopes) {
+        sender_scope out[2];
+        int count = 0;
+        parse_sender_scope(text, out, count);
+        for (int i = 0; i < count; ++i) {
+            index.add(out[i], rule);
+        }
+        ++rule;
+    }
+    index.add_any(rule);  // one unscoped rule, always selected
+    index.build(rule + 1);
+    uint64_t mask = 0;
+    const Endpoint sender(boost::asio::ip::make_address(address), port);
+    index.select(&sender, &mask);
+    return mask;
+}
+
+int main() {
+    // Accepted forms
+    check(parses("10.0.0.5"), "v4 host");
+    check(parses("10.0.0.5:3000"), "v4 host and port");
+    check(parses("10.1.0.0/16"), "v4 prefix");
+    check(parses("10.1.0.0/16:3000"), "v4 prefix and port");
+    check(parses("fe80::1"), "v6 host");
+    check(parses("[fe80::1]:3000"), "bracketed v6 host and port");
+    check(parses("[fe80::1]"), "bracketed v6 host");
+    check(parses("fe80::/10"), "v6 prefix");
+    check(parses("[fe80::/10]:3000"), "bracketed v6 prefix and port");
+    check(parses("*:3000", 2), "any host, one port");
+    check(parses("::ffff:10.0.0.5"), "v4-mapped host");
+    check(parses("::ffff:10.0.0.0/104"), "v4-mapped prefix");
+
+    // Rejected forms
+    for (const char* bad : {"", "10.0.0.5:", "10.0.0.5:0", "10.0.0.5:65536", "10.0.0.5: 80", "10.0.0.5:+80",
+                            "10.0.0.0/", "10.0.0.0/33", "10.0.0.0/-1", "10.0.0.0/ 8", "10.0.0.0/8x",
+                            "fe80::/129", "[fe80::1", "[fe80::1]3000", "[fe80::1]:", "host.example",
+                            "10.0.0.5:80:90", "::ffff:10.0.0.0/95"}) {
+        sender_scope out[2];
+        int count = 0;
+        if (parse_sender_scope(bad, out, count)) {
+            std::printf("FAILED: accepted \"%s\"\n", bad);
+            ++failures;
+        }
+    }
+
+    // Host bits past the prefix are cleared, v4-mapped becomes v4
+    const sender_scope masked = scope_of("10.1.2.3/16");
+    check(masked.v4 && masked.prefix == 16 && masked.addr[0] == 10 && masked.addr[1] == 1 &&
+          masked.addr[2] == 0 && masked.addr[3] == 0, "v4 host bits masked");
+    const sender_scope masked6 = scope_of("fe80::1:2/64");
+    check(!masked6.v4 && masked6.prefix == 64 && masked6.addr[0] == 0xfe && masked6.addr[15] == 0, "v6 host bits masked");
+    const sender_scope mapped = scope_of("::ffff:10.0.0.0/104");
+    check(mapped.v4 && mapped.prefix == 8 && mapped.addr[0] == 10, "v4-mapped prefix counts as v4");
+    const sender_scope odd = scope_of("10.255.255.255/9");
+    check(odd.addr[1] == 0x80 && odd.addr[2] == 0, "prefix inside a byte");
+
+    // Matching: the unscoped rule is bit 1 (one scope) or bit n
+    check(select({"10.0.0.5"}, "10.0.0.5", 1234) == 0b11, "exact host, any port");
+    check(select({"10.0.0.5"}, "10.0.0.6", 1234) == 0b10, "other host");
+    check(select({"10.0.0.5:3000"}, "10.0.0.5", 3000) == 0b11, "exact host and port");
+    check(select({"10.0.0.5:3000"}, "10.0.0.5", 3001) == 0b10, "exact host, other port");
+    check(select({"10.1.0.0/16"}, "10.1.200.7", 9) == 0b11, "inside prefix");
+    check(select({"10.1.0.0/16"}, "10.2.0.1", 9) == 0b10, "outside prefix");
+    check(select({"10.1.0.0/16:53"}, "10.1.0.1", 53) == 0b11, "prefix and port");
+    check(select({"10.1.0.0/16:53"}, "10.1.0.1", 54) == 0b10, "prefix, other port");
+    check(select({"0.0.0.0/0"}, "192.168.1.1", 1) == 0b11, "v4 /0");
+    check(select({"0.0.0.0/0"}, "::1", 1) == 0b10, "v4 /0 leaves v6 alone");
+    check(select({"*:3000"}, "192.168.1.1", 3000) == 0b11, "any host v4");
+    check(select({"*:3000"}, "2001:db8::1", 3000) == 0b11, "any host v6");
+    check(select({"*:3000"}, "2001:db8::1", 3001) == 0b10, "any host, other port");
+    check(select({"fe80::/10"}, "fe80::1234", 1) == 0b11, "inside v6 prefix");
+    check(select({"fe80::/10"}, "fec0::1", 1) == 0b10, "outside v6 prefix");
+    check(select({"[fe80::1]:3000"}, "fe80::1", 3000) == 0b11, "v6 host and port");
+    check(select({"10.0.0.5"}, "::ffff:10.0.0.5", 1) == 0b11, "v4-mapped sender matches v4 host");
+    check(select({"10.0.0.0/8"}, "::ffff:10.9.9.9", 1) == 0b11, "v4-mapped sender matches v4 prefix");
+    check(select({"::ffff:10.0.0.0/104"}, "10.3.3.3", 1) == 0b11, "v4-mapped prefix matches v4 sender");
+
+    // Exact hosts and prefixes together, several rules per sender
+    check(select({"10.0.0.5", "10.0.0.0/24", "10.0.0.0/8:80", "10.0.0.5:80", "11.0.0.0/8"}, "10.0.0.5", 80) == 0b101111,
+          "host, nested prefixes and ports combine");
+    check(select({"10.0.0.5", "10.0.0.0/24", "10.0.0.0/8:80", "10.0.0.5:80", "11.0.0.0/8"}, "10.0.0.9", 81) == 0b100010,
+          "only the covering prefix");
+
+    // No sender: only the unscoped rules
+    {
+        sender_index index;
+        sender_scope out[2];
+        int count = 0;
+        parse_sender_scope("10.0.0.5", out, count);
+        index.add(out[0], 0);
+        index.add_any(1);
+        index.build(2);
+        uint64_t mask = 0;
+        index.select(nullptr, &mask);
+        check(mask == 0b10, "null sender");
+    }
+
+    // Rules past the first word
+    {
+        sender_index index;
+        sender_scope out[2];
+        int count = 0;
+        parse_sender_scope("10.0.0.0/8", out, count);
+        index.add(out[0], 70);
+        index.build(100);
+        uint64_t mask[2] = {};
+        const Endpoint sender(boost::asio::ip::make_address("10.1.1.1"), 1);
+        index.select(&sender, mask);
+        check(mask[0] == 0 && mask[1] == (1ull << 6), "second mask word");
+        check(sender_index::next(mask, 0, 100) == 70 && sender_index::next(mask, 71, 100) == 100, "next over words");
+    }
+
+    std::printf("%s\n", failures ? "sender_index: FAILED" : "sender_index: ok");
+    return failures ? 1 : 0;
+}